@@ -0,0 +1,42 @@
+#!/bin/sh
+
+# Benchmark example.sh with tools/bench, writing the results as JSON.
+#
+#   ./bench.sh [bench options]
+#   ./bench.sh startup [runs]
+#
+# e.g. ./bench.sh -c 1 -n 50             closed loop, one client
+#      ./bench.sh -r 5 -d 20 -k          open loop at 5 req/s with keep-alive
+#      ./bench.sh startup 20             cold start to first response, 20 times
+#
+# BENCH_PORT, BENCH_PATH and BENCH_OUTPUT override the defaults below.
+
+bench_port="${BENCH_PORT:-5050}"
+bench_path="${BENCH_PATH:-/}"
+bench_label="$(git rev-parse --short HEAD 2> /dev/null || echo unknown)"
+bench_output="${BENCH_OUTPUT:-bench-$bench_label.json}"
+
+if [ ! -x tools/bench ] || [ tools/bench.c -nt tools/bench ]; then
+    gcc -W -Wall -O2 -pthread -o tools/bench tools/bench.c || exit 1
+fi
+
+# tools/bench starts and stops the server itself for each run
+if [ "$1" = "startup" ]; then
+    PORT="$bench_port" tools/bench -s "${2:-10}" -l "$bench_label" \
+        -o "$bench_output" "http://localhost:$bench_port$bench_path" \
+        ./example.sh || exit 1
+    echo "Results written to $bench_output"
+    exit
+fi
+
+PORT="$bench_port" ./example.sh > /dev/null 2>&1 &
+bench_server="$!"
+trap 'kill $bench_server 2> /dev/null' EXIT INT TERM
+
+# wait for the server to come up
+sleep 1
+
+tools/bench -l "$bench_label" -o "$bench_output" "$@" \
+    "http://localhost:$bench_port$bench_path"
+
+echo "Results written to $bench_output"
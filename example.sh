@@ -4,21 +4,7 @@
 
 get "/" root; root () {
     header "Content-Type" "text/html; charset=utf-8"
-    cat <<EOT
-<!DOCTYPE html>
-<html>
-  <head>
-    <meta charset="utf-8">
-    <title>hello world from $PATH_INFO</title>
-  </head>
-  <body>
-    <img src="/DeanMartin.jpg">
-    <h1>hello world from $PATH_INFO</h1>
-    <a href="/ps">processes</a>
-    <a href="/redirect">redirect</a>
-  </body>
-</html>
-EOT
+    render index.tmpl
 }
 
 get "/ps" ps_handler; ps_handler () {
@@ -27,8 +13,7 @@ get "/ps" ps_handler; ps_handler () {
 }
 
 get "/DeanMartin.jpg" dean_handler; dean_handler () {
-    header "Content-Type" "image/jpeg"
-    cat "DeanMartin.jpg"
+    send_file "DeanMartin.jpg" "image/jpeg"
 }
 
 get "/redirect" redirect_handler; redirect_handler () {
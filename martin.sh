@@ -19,6 +19,31 @@ header () {
     martin_response_headers="$martin_response_headers$1: $2$LF"
 }
 
+# send a file as the response body without reading it into the shell,
+# answering Range requests from it (needs tools/sendfile)
+send_file () {
+    martin_response_body="martin_send_file"
+    martin_send_file_path="$1"
+    martin_send_file_type="${2:-application/octet-stream}"
+}
+
+# assets BUNDLE [PREFIX]: serve GET and HEAD requests under PREFIX (/ by
+# default) that no route matches from a bundle built with
+# `tools/bundle pack DIR BUNDLE` (needs tools/bundle)
+assets () {
+    if [ ! -x "$martin_tools/bundle" ]; then
+        echo "martin: assets needs $martin_tools/bundle" >&2
+        return 1
+    fi
+    martin_assets_bundle="$1"
+    martin_assets_prefix="${2%/}"
+}
+
+# render TEMPLATE [NAME=VALUE...]: values are HTML-escaped (needs tools/render)
+render () {
+    "$martin_tools/render" -c "$martin_template_cache" "$@"
+}
+
 not_found () {
     status "404"
     header "Content-type" "text/plain"
@@ -29,7 +54,60 @@ not_found () {
     fi
 }
 
-LF=$'\n'
+metrics () {
+    martin_metrics_file="${1:-$TMPDIR/martin_metrics}"
+    get "/metrics" martin_metrics_handler
+}
+
+martin_metrics_handler () {
+    header "Content-Type" "text/plain; version=0.0.4"
+    "$martin_tools/metrics" "$martin_metrics_file" dump \
+        "${wwwoosh_workers:-${WWWOOSH_WORKERS:-1}}"
+}
+
+sessions () {
+    martin_session_store="${1:-$TMPDIR/martin_sessions}"
+}
+
+session_get () {
+    martin_session_load
+    [ "$martin_session_cookie" ] || return 1
+    "$martin_tools/session" "$martin_session_store" get "$martin_session_cookie" "$1"
+}
+
+# session_set key value [ttl in seconds]
+session_set () {
+    martin_session_load
+    if [ "$martin_session_cookie" ]; then
+        "$martin_tools/session" "$martin_session_store" set "$martin_session_cookie" "$@"
+        # anything but a bad or forged cookie is final
+        [ $? -eq 2 ] || return
+    fi
+
+    martin_session_cookie="$("$martin_tools/session" "$martin_session_store" new)" || return
+    header "Set-Cookie" "martin_session=$martin_session_cookie; Path=/; HttpOnly"
+    "$martin_tools/session" "$martin_session_store" set "$martin_session_cookie" "$@"
+}
+
+LF="
+"
+
+martin_tools="./tools"
+
+# set by `metrics` to record per-route counters in this shared file
+martin_metrics_file=""
+
+# set by `sessions` to keep session data in this shared file
+martin_session_store=""
+martin_session_cookie=""
+martin_session_loaded=""
+
+# set by `assets` to serve unrouted paths under the prefix from this bundle
+martin_assets_bundle=""
+martin_assets_prefix=""
+
+# compiled templates, keyed by the template's inode and checked against its mtime
+martin_template_cache="$TMPDIR/martin_templates"
 
 # route: method, path, action
 martin_routes=""
@@ -47,41 +125,243 @@ martin_find_route () {
   done
 }
 
+martin_metrics_begin () {
+    [ "$martin_metrics_file" ] || return
+    martin_metrics_start="$("$martin_tools/metrics" "$martin_metrics_file" begin)"
+}
+
+martin_metrics_end () {
+    [ "$martin_metrics_file" ] || return
+    local route="$PATH_INFO"
+    [ "$1" = "not_found" ] && route="(unmatched)"
+    [ "$1" = "martin_assets_handler" ] && route="(assets)"
+    "$martin_tools/metrics" "$martin_metrics_file" end \
+        "$REQUEST_METHOD" "$route" "${martin_response_status%% *}" \
+        "$martin_metrics_start" "${CONTENT_LENGTH:-0}" "$2"
+}
+
+# record a phase span when running under wwwoosh with tracing enabled
+martin_trace () {
+    [ "$wwwoosh_trace_file" ] || return 0
+    wwwoosh_trace_mark "$1"
+}
+
+# pick the signed session cookie out of the request's Cookie header
+martin_session_load () {
+    [ "$martin_session_loaded" ] && return
+    martin_session_loaded="1"
+    martin_session_cookie=""
+
+    local cookies="; $HTTP_COOKIE"
+    case "$cookies" in
+        *"; martin_session="*)
+            martin_session_cookie="${cookies#*; martin_session=}"
+            martin_session_cookie="${martin_session_cookie%%;*}"
+            ;;
+    esac
+}
+
 martin_response_headers=""
 martin_response_status=""
 martin_response_file="$TMPDIR/martin_response$$"
 
+# with metrics on, body commands save "STATUS BYTES" for what they actually
+# sent in this file
+martin_status_file=""
+
 martin_reset_response () {
     martin_response_status="200 OK"
     martin_response_headers=""
+    martin_response_body=""
+    martin_session_loaded=""
 }
 
 martin_dispatch () {
+    # concurrent wwwoosh workers all have the same $$
+    [ "$WWWOOSH_WORKER" ] &&
+        martin_response_file="$TMPDIR/martin_response$$-$WWWOOSH_WORKER"
+    martin_metrics_begin
+
     local action="$(martin_find_route "$REQUEST_METHOD" "$PATH_INFO")"
+    martin_trace "route"
 
-    [ ! "$action" ] && action="not_found"
+    if [ ! "$action" ]; then
+        action="not_found"
+        martin_is_asset && action="martin_assets_handler"
+    fi
 
     martin_reset_response
 
     # execute the action, storing output in a temporary file
     "$action" > "$martin_response_file"
+    martin_trace "handler"
+
+    # a body command writes its own Status and Content-Length headers, and
+    # reports what it sent through $martin_status_file
+    if [ "$martin_response_body" ]; then
+        local status="" length=0
+        if [ "$martin_metrics_file" ]; then
+            martin_status_file="$martin_response_file.status"
+            : > "$martin_status_file"
+        fi
+        printf '%s' "$martin_response_headers"
+        "$martin_response_body"
+        martin_trace "write"
+        if [ "$martin_status_file" ]; then
+            read -r status length < "$martin_status_file"
+            [ "$status" ] && martin_response_status="$status"
+        fi
+        martin_metrics_end "$action" "${length:-0}"
+        return
+    fi
 
     # set status header and content-length header
+    local length="$(wc -c "$martin_response_file" | awk '{ print $1 }')"
     header "Status" "$martin_response_status"
-    header "Content-Length" "$(wc -c "$martin_response_file" | awk '{ print $1 }')"
+    header "Content-Length" "$length"
+    martin_trace "content-length"
 
     # echo headers, blank line, then body
     echo "$martin_response_headers"
     cat "$martin_response_file"
+    martin_trace "write"
+
+    martin_metrics_end "$action" "$length"
+}
+
+# whether a request no route matched is one for the asset bundle
+martin_is_asset () {
+    [ "$martin_assets_bundle" ] || return 1
+    case "$REQUEST_METHOD $PATH_INFO" in
+        "GET $martin_assets_prefix/"*|"HEAD $martin_assets_prefix/"*) return 0 ;;
+    esac
+    return 1
+}
+
+martin_assets_handler () {
+    martin_response_body="martin_send_asset"
+}
+
+martin_send_asset () {
+    MARTIN_STATUS_FILE="$martin_status_file" "$martin_tools/bundle" serve \
+        "$martin_assets_bundle" "${PATH_INFO#"$martin_assets_prefix"}"
+}
+
+martin_send_file () {
+    if [ -x "$martin_tools/sendfile" ]; then
+        MARTIN_STATUS_FILE="$martin_status_file" "$martin_tools/sendfile" \
+            "$martin_send_file_path" "$martin_send_file_type"
+        return
+    fi
+
+    # without the tool, always send the whole file
+    if [ ! -f "$martin_send_file_path" ]; then
+        printf 'Status: 404\nContent-Type: text/plain\nContent-Length: 10\n\nNot Found\n'
+        martin_send_status 404 10
+        return
+    fi
+    local size="$(wc -c < "$martin_send_file_path")"
+    printf 'Status: 200\nContent-Type: %s\nContent-Length: %s\n\n' \
+        "$martin_send_file_type" $size
+    cat "$martin_send_file_path"
+    martin_send_status 200 $size
+}
+
+# martin_send_status STATUS BYTES: what a body command in the shell sent
+martin_send_status () {
+    [ "$martin_status_file" ] && echo "$1 $2" > "$martin_status_file"
+}
+
+# MARTIN_SELFCHECK=1: instead of serving, run each GET route (each route
+# with MARTIN_SELFCHECK=all) once through martin_dispatch and wwwoosh's
+# response writer, all at once and without a socket, and lint what comes out
+# with tools/httplint. Header errors, or a handler slower than
+# MARTIN_SELFCHECK_SLOW ms (500 by default), make it fail.
+martin_selfcheck () {
+    . ./wwwoosh.sh
+    local dir="$TMPDIR/martin_selfcheck$$" slow="${MARTIN_SELFCHECK_SLOW:-500}"
+    local n=0 i=1 failed=0 method path action route ms summary problems=""
+    mkdir -p "$dir" || return 1
+
+    while IFS="," read -r method path action; do
+        [ "$method" ] || continue
+        [ "$method" = "GET" ] || [ "$MARTIN_SELFCHECK" = "all" ] || continue
+        n=$((n + 1))
+        echo "$method $path" > "$dir/$n.route"
+        martin_selfcheck_route "$n" "$dir" "$method" "$path" < /dev/null &
+    done <<EOF
+$martin_routes
+EOF
+    wait
+
+    printf '%-32s %10s  %s\n' "route" "handler" "httplint"
+    while [ $i -le $n ]; do
+        read -r route < "$dir/$i.route"
+        read -r ms < "$dir/$i.ms"
+        summary="$(grep '^Response ' "$dir/$i.lint")"
+        summary="${summary#*: }"
+        case "$summary" in
+            "") summary="no response"; problems="$problems $i"; failed=1 ;;
+            *", 0 errors, 0 warnings.") ;;
+            *", 0 errors,"*) problems="$problems $i" ;;
+            *) problems="$problems $i"; failed=1 ;;
+        esac
+        if [ "$ms" != "-" ] && [ "${ms%.*}" -ge "$slow" ]; then
+            summary="$summary SLOW"
+            failed=1
+        fi
+        printf '%-32s %7s ms  %s\n' "$route" "$ms" "$summary"
+        i=$((i + 1))
+    done
+
+    for i in $problems; do
+        read -r route < "$dir/$i.route"
+        printf '\n%s\n' "$route"
+        cat "$dir/$i.lint"
+    done
+
+    rm -rf "$dir"
+    return $failed
+}
+
+# run route N as a request for it would be, keeping the handler's latency
+# in DIR/N.ms (- without bash or tools/trace for a clock) and httplint's
+# report on the response in DIR/N.lint
+martin_selfcheck_route () {
+    local n="$1" dir="$2" start=""
+    export REQUEST_METHOD="$3" PATH_INFO="$4" QUERY_STRING="" \
+        CONTENT_TYPE="" CONTENT_LENGTH="" SCRIPT_NAME="" \
+        SERVER_NAME="localhost" SERVER_PORT="" HTTP_HOST="localhost"
+    WWWOOSH_WORKER="selfcheck$n"
+    martin_metrics_file=""
+    wwwoosh_trace_file=""
+
+    wwwoosh_trace_clock 2> /dev/null
+    start="$wwwoosh_trace_now"
+    martin_dispatch > "$dir/$n.cgi"
+    wwwoosh_trace_clock 2> /dev/null
+    if [ "$start" ] && [ "$wwwoosh_trace_now" ]; then
+        start=$((wwwoosh_trace_now - start))
+        echo "$((start / 1000)).$((start % 1000 / 100))" > "$dir/$n.ms"
+    else
+        echo "-" > "$dir/$n.ms"
+    fi
+    rm -f "$martin_response_file"
+
+    wwwoosh_handle_response < "$dir/$n.cgi" > "$dir/$n.http" 2> /dev/null
+    "$martin_tools/httplint" --response "$dir/$n.http" > "$dir/$n.lint" 2>&1
 }
 
 martin () {
-  if [ $REQUEST_METHOD ]; then
+  if [ "$MARTIN_SELFCHECK" ]; then
+    martin_selfcheck
+    exit
+  elif [ $REQUEST_METHOD ]; then
     # as a CGI script
     martin_dispatch
   else
     # standalone using the wwwoosh server
     . ./wwwoosh.sh
-    wwwoosh martin_dispatch $PORT
+    wwwoosh martin_dispatch ${PORT:+"$PORT"}
   fi
 }
@@ -0,0 +1,701 @@
+/*
+ * HTTP load generator and latency benchmark for wwwoosh / martin
+ * Licensed under the MIT License
+ *                http://www.opensource.org/licenses/mit-license
+ */
+
+/*
+ * Compile using
+ *   gcc -W -Wall -O2 -pthread -o bench bench.c
+ *
+ * Closed loop (-c workers, each sending the next request as soon as the
+ * previous one completes):
+ *   bench -c 4 -n 200 http://localhost:5000/
+ *
+ * Open loop (a fixed arrival rate, latency measured from the scheduled
+ * send time so that a stalled server is not hidden by a stalled client):
+ *   bench -r 10 -d 30 http://localhost:5000/
+ *
+ * Startup (-s runs, starting the server command given after the url each
+ * time and measuring from the fork to the first 2xx response, polling
+ * every millisecond; the server's process group is then stopped, and the
+ * port must be closed again before the next run):
+ *   bench -s 10 http://localhost:5000/ ./example.sh
+ *
+ * Forks per request are taken from the "processes" counter in /proc/stat,
+ * so they include every process and thread started on the box during the
+ * run, the client's own worker threads among them.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+
+#define NSEC 1000000000ULL
+#define STARTUP_TIMEOUT 30      /* seconds for a server to come up */
+
+struct options {
+  char host[256];
+  char port[16];
+  char path[1024];
+  unsigned int concurrency;
+  unsigned long requests;
+  double duration;
+  double rate;
+  bool keepalive;
+  unsigned long startup;
+  const char *output;
+  const char *label;
+};
+
+struct worker {
+  pthread_t thread;
+  unsigned int id;
+  uint64_t *latency;
+  unsigned long count;
+  unsigned long capacity;
+  unsigned long errors;
+  unsigned long refused;
+  unsigned long status[6];
+  unsigned long long bytes;
+  int fd;
+};
+
+struct options opt = { "", "80", "/", 1, 0, 0, 0, false, 0, 0, 0 };
+struct addrinfo *address;
+char request[2048];
+size_t request_len;
+uint64_t start_time, stop_time;
+unsigned long issued;
+pthread_mutex_t issued_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+void usage(void);
+void parse_url(const char *url);
+uint64_t now(void);
+void sleep_until(uint64_t t);
+bool next_request(uint64_t *scheduled, unsigned long *sequence);
+void *worker_main(void *arg);
+void startup_runs(struct worker *w, char **command);
+pid_t start_server(char **command);
+void stop_server(struct worker *w, pid_t pid);
+int do_request(struct worker *w);
+int connect_server(struct worker *w);
+void record(struct worker *w, uint64_t latency);
+unsigned long long read_forks(void);
+int compare_u64(const void *a, const void *b);
+double percentile(const uint64_t *sorted, unsigned long n, double p);
+void report(struct worker *workers, unsigned long long forks);
+void die(const char *error);
+
+
+/**
+ * Main entry point.
+ */
+int main(int argc, char *argv[])
+{
+  struct worker *workers;
+  struct addrinfo hints;
+  unsigned long long forks0, forks1;
+  unsigned int i;
+  int c, r;
+
+  while ((c = getopt(argc, argv, "+c:n:d:r:ks:o:l:")) != -1) {
+    switch (c) {
+      case 'c': opt.concurrency = atoi(optarg); break;
+      case 'n': opt.requests = strtoul(optarg, 0, 10); break;
+      case 'd': opt.duration = atof(optarg); break;
+      case 'r': opt.rate = atof(optarg); break;
+      case 'k': opt.keepalive = true; break;
+      case 's': opt.startup = strtoul(optarg, 0, 10); break;
+      case 'o': opt.output = optarg; break;
+      case 'l': opt.label = optarg; break;
+      default: usage();
+    }
+  }
+  if (opt.startup ? argc < optind + 2 : optind + 1 != argc)
+    usage();
+  if (opt.concurrency == 0 || (opt.startup && opt.rate))
+    usage();
+  if (opt.startup)
+    opt.concurrency = 1;
+  if (opt.requests == 0 && opt.duration == 0)
+    opt.requests = 100;
+
+  parse_url(argv[optind]);
+
+  memset(&hints, 0, sizeof hints);
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  r = getaddrinfo(opt.host, opt.port, &hints, &address);
+  if (r)
+    die(gai_strerror(r));
+
+  request_len = snprintf(request, sizeof request,
+      "GET %s HTTP/1.1\r\n"
+      "Host: %s:%s\r\n"
+      "User-Agent: wwwoosh-bench\r\n"
+      "Connection: %s\r\n"
+      "\r\n",
+      opt.path, opt.host, opt.port, opt.keepalive ? "keep-alive" : "close");
+
+  workers = calloc(opt.concurrency, sizeof *workers);
+  if (!workers)
+    die("Out of memory");
+
+  forks0 = read_forks();
+  start_time = now();
+  if (opt.duration)
+    stop_time = start_time + (uint64_t) (opt.duration * NSEC);
+
+  if (opt.startup) {
+    workers[0].fd = -1;
+    startup_runs(&workers[0], argv + optind + 1);
+  }
+  for (i = 0; !opt.startup && i != opt.concurrency; i++) {
+    workers[i].id = i;
+    workers[i].fd = -1;
+    if (pthread_create(&workers[i].thread, 0, worker_main, &workers[i]))
+      die("Failed to start worker thread");
+  }
+  for (i = 0; !opt.startup && i != opt.concurrency; i++)
+    pthread_join(workers[i].thread, 0);
+
+  stop_time = now();
+  forks1 = read_forks();
+
+  report(workers, forks1 - forks0);
+
+  freeaddrinfo(address);
+  return 0;
+}
+
+
+void usage(void)
+{
+  die("Usage: bench [-c concurrency] [-n requests | -d seconds] "
+      "[-r rate] [-k] [-o results.json] [-l label] http://host:port/path\n"
+      "       bench -s runs [-o results.json] [-l label] "
+      "http://host:port/path command [arg ...]");
+}
+
+
+/**
+ * Split an http url into host, port and path.
+ */
+void parse_url(const char *url)
+{
+  const char *host, *slash, *colon;
+  size_t len;
+
+  if (strncmp(url, "http://", 7))
+    die("Only http:// urls are supported");
+  host = url + 7;
+
+  slash = strchr(host, '/');
+  if (!slash)
+    slash = host + strlen(host);
+  else
+    snprintf(opt.path, sizeof opt.path, "%s", slash);
+
+  colon = memchr(host, ':', slash - host);
+  if (colon) {
+    len = slash - colon - 1;
+    if (len == 0 || sizeof opt.port <= len)
+      die("Bad port in url");
+    memcpy(opt.port, colon + 1, len);
+    opt.port[len] = 0;
+  } else {
+    colon = slash;
+  }
+
+  len = colon - host;
+  if (len == 0 || sizeof opt.host <= len)
+    die("Bad host in url");
+  memcpy(opt.host, host, len);
+  opt.host[len] = 0;
+}
+
+
+/**
+ * Monotonic clock in nanoseconds.
+ */
+uint64_t now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * NSEC + ts.tv_nsec;
+}
+
+
+void sleep_until(uint64_t t)
+{
+  struct timespec ts;
+  ts.tv_sec = t / NSEC;
+  ts.tv_nsec = t % NSEC;
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0) == EINTR)
+    ;
+}
+
+
+/**
+ * Claim the next request slot, returning false when the run is over.
+ *
+ * In open loop mode the scheduled send time of the slot is returned, which
+ * all workers share so that the arrival rate does not depend on how many
+ * workers are currently blocked on the server.
+ */
+bool next_request(uint64_t *scheduled, unsigned long *sequence)
+{
+  unsigned long n;
+
+  pthread_mutex_lock(&issued_lock);
+  n = issued++;
+  pthread_mutex_unlock(&issued_lock);
+
+  if (opt.requests && opt.requests <= n)
+    return false;
+
+  *sequence = n;
+  if (opt.rate)
+    *scheduled = start_time + (uint64_t) (n * (NSEC / opt.rate));
+  else
+    *scheduled = now();
+
+  if (stop_time && stop_time <= *scheduled)
+    return false;
+  return true;
+}
+
+
+void *worker_main(void *arg)
+{
+  struct worker *w = arg;
+  uint64_t scheduled, t1;
+  unsigned long sequence;
+
+  while (next_request(&scheduled, &sequence)) {
+    if (opt.rate)
+      sleep_until(scheduled);
+    if (do_request(w) == 0) {
+      t1 = now();
+      record(w, t1 - scheduled);
+    }
+  }
+
+  if (w->fd != -1)
+    close(w->fd);
+  return 0;
+}
+
+
+/**
+ * Start the server opt.startup times, recording how long each took to give
+ * its first 2xx response. Refused connections while it starts are counted
+ * as refused; a server that does not come up in time is an error.
+ */
+void startup_runs(struct worker *w, char **command)
+{
+  unsigned long run;
+  uint64_t t0, deadline;
+  unsigned long ok;
+  pid_t pid;
+
+  for (run = 0; run != opt.startup; run++) {
+    t0 = now();
+    deadline = t0 + STARTUP_TIMEOUT * NSEC;
+    pid = start_server(command);
+
+    while (1) {
+      ok = w->status[2];
+      if (do_request(w) == 0 && ok != w->status[2]) {
+        record(w, now() - t0);
+        break;
+      }
+      if (deadline < now() || waitpid(pid, 0, WNOHANG) == pid) {
+        fprintf(stderr, "bench: run %lu: the server did not come up\n",
+            run + 1);
+        w->errors++;
+        break;
+      }
+      sleep_until(now() + NSEC / 1000);
+    }
+
+    stop_server(w, pid);
+  }
+}
+
+
+/**
+ * Fork and exec the server command in a process group of its own, so that
+ * everything it starts can be stopped with it. Its output is discarded.
+ */
+pid_t start_server(char **command)
+{
+  pid_t pid = fork();
+  int null;
+
+  if (pid == -1)
+    die(strerror(errno));
+  if (pid == 0) {
+    setpgid(0, 0);
+    null = open("/dev/null", O_WRONLY);
+    if (null != -1) {
+      dup2(null, 1);
+      close(null);
+    }
+    execvp(command[0], command);
+    fprintf(stderr, "bench: %s: %s\n", command[0], strerror(errno));
+    _exit(127);
+  }
+  setpgid(pid, pid);
+  return pid;
+}
+
+
+/**
+ * Stop the server's process group and wait until no address of the port
+ * accepts connections. Those probes are not counted.
+ */
+void stop_server(struct worker *w, pid_t pid)
+{
+  uint64_t deadline = now() + STARTUP_TIMEOUT * NSEC;
+  unsigned long refused = w->refused, errors = w->errors;
+
+  if (w->fd != -1) {
+    close(w->fd);
+    w->fd = -1;
+  }
+  kill(-pid, SIGTERM);
+  waitpid(pid, 0, 0);
+  while (connect_server(w) == 0 && now() < deadline) {
+    close(w->fd);
+    w->fd = -1;
+    sleep_until(now() + NSEC / 100);
+  }
+  kill(-pid, SIGKILL);
+  w->refused = refused;
+  w->errors = errors;
+}
+
+
+/**
+ * Send one request and read the full response, returning 0 on success.
+ *
+ * The connection is kept for the next request only if keep-alive was
+ * requested and the response was delimited by Content-Length without
+ * "Connection: close", which wwwoosh always sends.
+ */
+int do_request(struct worker *w)
+{
+  char buf[16384];
+  char *head_end = 0, *p;
+  size_t have = 0, head_len = 0;
+  long content_length = -1;
+  bool close_after = !opt.keepalive;
+  int status = 0;
+  ssize_t n;
+  int retried = 0;
+
+again:
+  if (w->fd == -1 && connect_server(w))
+    return -1;
+
+  if (write(w->fd, request, request_len) != (ssize_t) request_len) {
+    close(w->fd);
+    w->fd = -1;
+    if (!retried++)
+      goto again;
+    w->errors++;
+    return -1;
+  }
+
+  /* read the response head */
+  while (!head_end) {
+    if (have == sizeof buf - 1) {
+      w->errors++;
+      goto fail;
+    }
+    n = read(w->fd, buf + have, sizeof buf - 1 - have);
+    if (n <= 0) {
+      /* a reused keep-alive connection may have been closed under us */
+      if (have == 0 && opt.keepalive && !retried++) {
+        close(w->fd);
+        w->fd = -1;
+        goto again;
+      }
+      w->errors++;
+      goto fail;
+    }
+    have += n;
+    buf[have] = 0;
+    head_end = strstr(buf, "\r\n\r\n");
+  }
+  head_len = head_end + 4 - buf;
+
+  if (sscanf(buf, "HTTP/%*d.%*d %d", &status) != 1 ||
+      status < 100 || 599 < status) {
+    w->errors++;
+    goto fail;
+  }
+  w->status[status / 100]++;
+  if (status / 100 == 5)
+    w->errors++;
+
+  *head_end = 0;
+  for (p = strstr(buf, "\r\n"); p; p = strstr(p, "\r\n")) {
+    p += 2;
+    if (strncasecmp(p, "Content-Length:", 15) == 0)
+      content_length = strtol(p + 15, 0, 10);
+    else if (strncasecmp(p, "Connection:", 11) == 0 &&
+        strncasecmp(p + 11 + strspn(p + 11, " \t"), "close", 5) == 0)
+      close_after = true;
+  }
+  if (content_length < 0)
+    close_after = true;
+
+  /* read the body, either to Content-Length or to end of stream */
+  w->bytes += have;
+  have -= head_len;
+  while (content_length < 0 || (long) have < content_length) {
+    n = read(w->fd, buf, sizeof buf);
+    if (n < 0) {
+      w->errors++;
+      goto fail;
+    }
+    if (n == 0) {
+      if (0 <= content_length) {
+        w->errors++;
+        goto fail;
+      }
+      break;
+    }
+    have += n;
+    w->bytes += n;
+  }
+
+  if (close_after) {
+    close(w->fd);
+    w->fd = -1;
+  }
+  return 0;
+
+fail:
+  close(w->fd);
+  w->fd = -1;
+  return -1;
+}
+
+
+/**
+ * Connect to the first of the server's addresses that accepts, so that a
+ * server listening on only one of ::1 and 127.0.0.1 is found either way.
+ * When none does, the attempt counts once: as refused if any address
+ * refused it, else as an error.
+ */
+int connect_server(struct worker *w)
+{
+  struct addrinfo *ai;
+  bool refused = false;
+  int fd, one = 1;
+
+  for (ai = address; ai; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd == -1)
+      continue;
+    if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+      w->fd = fd;
+      return 0;
+    }
+    if (errno == ECONNREFUSED)
+      refused = true;
+    close(fd);
+  }
+  if (refused)
+    w->refused++;
+  else
+    w->errors++;
+  return -1;
+}
+
+
+void record(struct worker *w, uint64_t latency)
+{
+  if (w->count == w->capacity) {
+    w->capacity = w->capacity ? w->capacity * 2 : 1024;
+    w->latency = realloc(w->latency, w->capacity * sizeof *w->latency);
+    if (!w->latency)
+      die("Out of memory");
+  }
+  w->latency[w->count++] = latency;
+}
+
+
+/**
+ * Read the number of processes created since boot from /proc/stat.
+ */
+unsigned long long read_forks(void)
+{
+  char line[256];
+  unsigned long long n = 0;
+  FILE *f = fopen("/proc/stat", "r");
+
+  if (!f)
+    return 0;
+  while (fgets(line, sizeof line, f)) {
+    if (sscanf(line, "processes %llu", &n) == 1)
+      break;
+  }
+  fclose(f);
+  return n;
+}
+
+
+int compare_u64(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+  return x < y ? -1 : x > y;
+}
+
+
+/**
+ * Nearest-rank percentile of a sorted sample, in milliseconds.
+ */
+double percentile(const uint64_t *sorted, unsigned long n, double p)
+{
+  unsigned long rank;
+
+  if (n == 0)
+    return 0;
+  rank = (unsigned long) (p / 100 * n + 0.999999);
+  if (rank < 1)
+    rank = 1;
+  if (n < rank)
+    rank = n;
+  return sorted[rank - 1] / 1e6;
+}
+
+
+/**
+ * Merge the per-worker samples and print the summary, optionally as JSON.
+ */
+void report(struct worker *workers, unsigned long long forks)
+{
+  uint64_t *all;
+  unsigned long n = 0, errors = 0, refused = 0, status[6] = { 0 };
+  unsigned long long bytes = 0, sum = 0;
+  double elapsed = (stop_time - start_time) / 1e9;
+  double throughput, fpr;
+  unsigned int i, j;
+  FILE *f;
+
+  for (i = 0; i != opt.concurrency; i++)
+    n += workers[i].count;
+  all = malloc((n ? n : 1) * sizeof *all);
+  if (!all)
+    die("Out of memory");
+
+  n = 0;
+  for (i = 0; i != opt.concurrency; i++) {
+    memcpy(all + n, workers[i].latency, workers[i].count * sizeof *all);
+    n += workers[i].count;
+    errors += workers[i].errors;
+    refused += workers[i].refused;
+    bytes += workers[i].bytes;
+    for (j = 0; j != 6; j++)
+      status[j] += workers[i].status[j];
+    free(workers[i].latency);
+  }
+  qsort(all, n, sizeof *all, compare_u64);
+  for (i = 0; i != n; i++)
+    sum += all[i];
+
+  throughput = elapsed ? n / elapsed : 0;
+  fpr = n ? (double) forks / n : 0;
+
+  if (opt.startup)
+    printf("startup %s:%s%s, %lu %s, latency from process start to the "
+        "first 2xx\n", opt.host, opt.port, opt.path, opt.startup,
+        opt.startup == 1 ? "run" : "runs");
+  else
+    printf("%s %s:%s%s, %u %s, %s\n",
+        opt.rate ? "open loop" : "closed loop", opt.host, opt.port, opt.path,
+        opt.concurrency, opt.concurrency == 1 ? "worker" : "workers",
+        opt.keepalive ? "keep-alive" : "close");
+  printf("  completed  %lu in %.3fs (%.2f req/s)\n", n, elapsed, throughput);
+  printf("  errors     %lu\n", errors);
+  printf("  refused    %lu\n", refused);
+  printf("  status     1xx=%lu 2xx=%lu 3xx=%lu 4xx=%lu 5xx=%lu\n",
+      status[1], status[2], status[3], status[4], status[5]);
+  printf("  latency    p50=%.3fms p90=%.3fms p99=%.3fms p999=%.3fms "
+      "max=%.3fms\n",
+      percentile(all, n, 50), percentile(all, n, 90),
+      percentile(all, n, 99), percentile(all, n, 99.9),
+      n ? all[n - 1] / 1e6 : 0);
+  printf("  forks      %llu (%.2f per request)\n", forks, fpr);
+
+  if (opt.output) {
+    f = fopen(opt.output, "w");
+    if (!f)
+      die("Failed to open output file");
+    fprintf(f, "{\n");
+    fprintf(f, "  \"label\": \"%s\",\n", opt.label ? opt.label : "");
+    fprintf(f, "  \"url\": \"http://%s:%s%s\",\n", opt.host, opt.port,
+        opt.path);
+    fprintf(f, "  \"mode\": \"%s\",\n", opt.startup ? "startup" :
+        opt.rate ? "open" : "closed");
+    fprintf(f, "  \"concurrency\": %u,\n", opt.concurrency);
+    fprintf(f, "  \"keepalive\": %s,\n", opt.keepalive ? "true" : "false");
+    fprintf(f, "  \"rate\": %g,\n", opt.rate);
+    fprintf(f, "  \"elapsed_s\": %.6f,\n", elapsed);
+    fprintf(f, "  \"completed\": %lu,\n", n);
+    fprintf(f, "  \"errors\": %lu,\n", errors);
+    fprintf(f, "  \"refused\": %lu,\n", refused);
+    fprintf(f, "  \"throughput_rps\": %.3f,\n", throughput);
+    fprintf(f, "  \"bytes\": %llu,\n", bytes);
+    fprintf(f, "  \"status\": { \"1xx\": %lu, \"2xx\": %lu, \"3xx\": %lu, "
+        "\"4xx\": %lu, \"5xx\": %lu },\n",
+        status[1], status[2], status[3], status[4], status[5]);
+    fprintf(f, "  \"latency_ms\": { \"min\": %.3f, \"mean\": %.3f, "
+        "\"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"p999\": %.3f, "
+        "\"max\": %.3f },\n",
+        n ? all[0] / 1e6 : 0, n ? sum / 1e6 / n : 0,
+        percentile(all, n, 50), percentile(all, n, 90),
+        percentile(all, n, 99), percentile(all, n, 99.9),
+        n ? all[n - 1] / 1e6 : 0);
+    fprintf(f, "  \"forks\": %llu,\n", forks);
+    fprintf(f, "  \"forks_per_request\": %.3f\n", fpr);
+    fprintf(f, "}\n");
+    fclose(f);
+  }
+
+  free(all);
+}
+
+
+/**
+ * Print an error message and exit.
+ */
+void die(const char *error)
+{
+  fprintf(stderr, "bench: %s\n", error);
+  exit(EXIT_FAILURE);
+}
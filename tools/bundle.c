@@ -0,0 +1,618 @@
+/*
+ * Static asset bundles for martin
+ * Licensed under the MIT License
+ *                http://www.opensource.org/licenses/mit-license
+ */
+
+/*
+ * Compile using
+ *   gcc -W -Wall -O2 -o bundle bundle.c
+ *
+ * Usage:
+ *   bundle pack DIR BUNDLE
+ *   bundle serve BUNDLE PATH
+ *   bundle list BUNDLE
+ *
+ * pack puts every regular file under DIR into the single file BUNDLE: a
+ * sorted index, then the paths and headers, then the bodies. The CGI
+ * headers of each file's response (Status, Content-Type from the
+ * extension, Content-Length, an ETag from a hash of the contents, and
+ * Last-Modified) are worked out once, here, and stored ready to write. A
+ * FILE.gz next to FILE is stored as FILE's gzip variant rather than as a
+ * file of its own, so assets compressed by the build go to clients that
+ * accept gzip, with Content-Encoding and Vary. BUNDLE is written to a
+ * temporary file and renamed into place, so a server never maps a
+ * half-written bundle.
+ *
+ * serve writes the CGI response for PATH (a PATH ending in / means its
+ * index.html). The bundle is mapped with one mmap, PATH is found by binary
+ * search of the index, and the stored headers and the body are written
+ * straight from the mapping with one writev. Nothing but the bundle is
+ * looked up on the filesystem, and PATH can only name what was packed. An
+ * If-None-Match holding the ETag gives 304, a HEAD request gets the headers
+ * only, and a path that is not in the bundle gives 404. Byte ranges are not
+ * supported; send_file is the way to serve large media. When
+ * MARTIN_STATUS_FILE is set, the status code and the number of body bytes
+ * written are saved there as "STATUS BYTES", for martin's metrics.
+ *
+ * list prints each path with its type and sizes.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+
+#define BUNDLE_MAGIC 0x6c646e62
+#define MAX_PATH 1024
+
+/* one way of sending an entry; offsets are from the start of the bundle,
+ * and an entry without a gzip variant has a gzip.headers of 0 */
+struct variant {
+  uint64_t headers;
+  uint64_t body;
+  uint64_t body_length;
+  uint32_t headers_length;
+  char etag[20];                /* quoted, NUL-terminated */
+};
+
+struct entry {
+  uint64_t path;                /* NUL-terminated, from the / */
+  struct variant plain, gzip;
+};
+
+/* the bundle starts with this, then the entries sorted by path, then the
+ * paths and headers, then the bodies */
+struct bundle {
+  uint32_t magic;
+  uint32_t entry_count;
+  uint64_t size;
+};
+
+/* a file being packed */
+struct file {
+  char *path;
+  char *data;
+  size_t length;
+  time_t mtime;
+  struct file *gzip;            /* its FILE.gz */
+  bool is_gzip;                 /* the FILE.gz of another */
+};
+
+struct buffer {
+  char *data;
+  size_t length;
+  size_t size;
+};
+
+static const struct {
+  const char *extension;
+  const char *type;
+} types[] = {
+  { "css", "text/css; charset=utf-8" },
+  { "gif", "image/gif" },
+  { "htm", "text/html; charset=utf-8" },
+  { "html", "text/html; charset=utf-8" },
+  { "ico", "image/x-icon" },
+  { "jpeg", "image/jpeg" },
+  { "jpg", "image/jpeg" },
+  { "js", "text/javascript; charset=utf-8" },
+  { "json", "application/json" },
+  { "mp4", "video/mp4" },
+  { "pdf", "application/pdf" },
+  { "png", "image/png" },
+  { "svg", "image/svg+xml" },
+  { "txt", "text/plain; charset=utf-8" },
+  { "wasm", "application/wasm" },
+  { "webp", "image/webp" },
+  { "woff", "font/woff" },
+  { "woff2", "font/woff2" },
+  { "xml", "application/xml" },
+};
+
+struct file *files;
+size_t file_count, file_size;
+size_t root_length;
+
+
+void pack(const char *dir, const char *bundle_path);
+int add_file(const char *path, const struct stat *st, int flag,
+    struct FTW *ftw);
+int file_compare(const void *a, const void *b);
+void add_variant(struct variant *v, struct buffer *strings, uint64_t base,
+    const struct file *f, const struct file *body, bool vary);
+const char *content_type(const char *path);
+void serve(const char *bundle_path, const char *path);
+const struct entry *find(const struct bundle *b, const char *path);
+bool accepts_gzip(const char *header);
+bool etag_matches(const char *header, const char *etag);
+void report_status(int status, uint64_t bytes);
+void list(const char *bundle_path);
+const struct bundle *map_bundle(const char *bundle_path);
+bool valid_variant(const struct bundle *b, const struct variant *v);
+bool inside(const struct bundle *b, uint64_t offset, uint64_t length);
+void append(struct buffer *b, const char *p, size_t n);
+void write_all(int fd, const char *p, size_t n);
+void die(const char *error);
+
+
+/**
+ * Main entry point.
+ */
+int main(int argc, char *argv[])
+{
+  if (argc == 4 && strcmp(argv[1], "pack") == 0)
+    pack(argv[2], argv[3]);
+  else if (argc == 4 && strcmp(argv[1], "serve") == 0)
+    serve(argv[2], argv[3]);
+  else if (argc == 3 && strcmp(argv[1], "list") == 0)
+    list(argv[2]);
+  else
+    die("Usage: bundle pack DIR BUNDLE | serve BUNDLE PATH | list BUNDLE");
+  return 0;
+}
+
+
+/**
+ * Read every file under DIR and write them to BUNDLE_PATH.
+ */
+void pack(const char *dir, const char *bundle_path)
+{
+  struct bundle b = { BUNDLE_MAGIC, 0, 0 };
+  struct buffer strings = { 0, 0, 0 };
+  struct entry *entries;
+  struct file *f, key;
+  char tmp[MAX_PATH + 32];
+  uint64_t base, body;
+  size_t i, n;
+  int fd;
+
+  root_length = strlen(dir);
+  while (1 < root_length && dir[root_length - 1] == '/')
+    root_length--;
+  if (nftw(dir, add_file, 16, FTW_PHYS))
+    die(errno ? strerror(errno) : "Failed to read the directory");
+  qsort(files, file_count, sizeof *files, file_compare);
+
+  /* pair each FILE.gz with its FILE */
+  for (i = 0; i != file_count; i++) {
+    n = strlen(files[i].path);
+    if (n < 5 || strcmp(files[i].path + n - 3, ".gz"))
+      continue;
+    key.path = strndup(files[i].path, n - 3);
+    if (!key.path)
+      die("Out of memory");
+    f = bsearch(&key, files, file_count, sizeof *files, file_compare);
+    free(key.path);
+    if (f) {
+      f->gzip = &files[i];
+      files[i].is_gzip = true;
+    }
+  }
+  for (i = 0; i != file_count; i++)
+    b.entry_count += !files[i].is_gzip;
+
+  entries = calloc(b.entry_count + 1, sizeof *entries);
+  if (!entries)
+    die("Out of memory");
+
+  /* the paths and headers, at offsets from where they will start */
+  base = sizeof b + b.entry_count * sizeof *entries;
+  for (i = n = 0; i != file_count; i++) {
+    f = &files[i];
+    if (f->is_gzip)
+      continue;
+    entries[n].path = base + strings.length;
+    append(&strings, f->path, strlen(f->path) + 1);
+    add_variant(&entries[n].plain, &strings, base, f, f, f->gzip);
+    if (f->gzip)
+      add_variant(&entries[n].gzip, &strings, base, f, f->gzip, true);
+    n++;
+  }
+
+  /* then the bodies */
+  body = base + strings.length;
+  for (i = n = 0; i != file_count; i++) {
+    f = &files[i];
+    if (f->is_gzip)
+      continue;
+    entries[n].plain.body = body;
+    body += f->length;
+    if (f->gzip) {
+      entries[n].gzip.body = body;
+      body += f->gzip->length;
+    }
+    n++;
+  }
+  b.size = body;
+
+  snprintf(tmp, sizeof tmp, "%s.%ld", bundle_path, (long) getpid());
+  fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1)
+    die(strerror(errno));
+  write_all(fd, (const char *) &b, sizeof b);
+  write_all(fd, (const char *) entries, b.entry_count * sizeof *entries);
+  write_all(fd, strings.data, strings.length);
+  for (i = 0; i != file_count; i++) {
+    f = &files[i];
+    if (f->is_gzip)
+      continue;
+    write_all(fd, f->data, f->length);
+    if (f->gzip)
+      write_all(fd, f->gzip->data, f->gzip->length);
+  }
+  if (close(fd) || rename(tmp, bundle_path)) {
+    unlink(tmp);
+    die(strerror(errno));
+  }
+}
+
+
+/**
+ * nftw callback: read a regular file into files.
+ */
+int add_file(const char *path, const struct stat *st, int flag,
+    struct FTW *ftw)
+{
+  struct file *f;
+  ssize_t r;
+  size_t got;
+  int fd;
+
+  (void) ftw;
+  if (flag != FTW_F || !S_ISREG(st->st_mode))
+    return 0;
+  if (MAX_PATH <= strlen(path + root_length))
+    die("Path too long");
+
+  if (file_count == file_size) {
+    file_size = file_size ? file_size * 2 : 64;
+    files = realloc(files, file_size * sizeof *files);
+    if (!files)
+      die("Out of memory");
+  }
+  f = &files[file_count++];
+  f->path = strdup(path + root_length);
+  f->data = malloc(st->st_size + 1);
+  if (!f->path || !f->data)
+    die("Out of memory");
+  f->length = st->st_size;
+  f->mtime = st->st_mtime;
+  f->gzip = 0;
+  f->is_gzip = false;
+
+  fd = open(path, O_RDONLY);
+  if (fd == -1)
+    die(strerror(errno));
+  for (got = 0; got < f->length; got += r) {
+    r = read(fd, f->data + got, f->length - got);
+    if (r <= 0)
+      die("File changed while being read");
+  }
+  close(fd);
+  return 0;
+}
+
+
+int file_compare(const void *a, const void *b)
+{
+  return strcmp(((const struct file *) a)->path,
+      ((const struct file *) b)->path);
+}
+
+
+/**
+ * Fill in V for sending BODY as the response for F (BODY is F itself or
+ * its FILE.gz), appending the headers to STRINGS.
+ */
+void add_variant(struct variant *v, struct buffer *strings, uint64_t base,
+    const struct file *f, const struct file *body, bool vary)
+{
+  char headers[600], last_modified[64];
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  struct tm tm;
+  size_t i;
+  int n;
+
+  /* FNV-1a, so the ETag only changes with the contents */
+  for (i = 0; i != body->length; i++)
+    hash = (hash ^ (unsigned char) body->data[i]) * 0x100000001b3ULL;
+  snprintf(v->etag, sizeof v->etag, "\"%016llx\"", (unsigned long long) hash);
+
+  gmtime_r(&f->mtime, &tm);
+  strftime(last_modified, sizeof last_modified, "%a, %d %b %Y %H:%M:%S GMT",
+      &tm);
+  n = snprintf(headers, sizeof headers, "Status: 200 OK\nContent-Type: %s\n"
+      "Content-Length: %llu\n%s%sETag: %s\nLast-Modified: %s\n\n",
+      content_type(f->path), (unsigned long long) body->length,
+      body != f ? "Content-Encoding: gzip\n" : "",
+      vary ? "Vary: Accept-Encoding\n" : "", v->etag, last_modified);
+
+  v->headers = base + strings->length;
+  v->headers_length = n;
+  v->body_length = body->length;
+  append(strings, headers, n);
+}
+
+
+/**
+ * The Content-Type for a path, from its extension.
+ */
+const char *content_type(const char *path)
+{
+  const char *dot = strrchr(path, '.');
+  size_t i;
+
+  if (dot && !strchr(dot, '/'))
+    for (i = 0; i != sizeof types / sizeof types[0]; i++)
+      if (strcasecmp(dot + 1, types[i].extension) == 0)
+        return types[i].type;
+  return "application/octet-stream";
+}
+
+
+/**
+ * Write the response for PATH from the bundle.
+ */
+void serve(const char *bundle_path, const char *path)
+{
+  const struct bundle *b = map_bundle(bundle_path);
+  const struct entry *e;
+  const struct variant *v;
+  const char *method = getenv("REQUEST_METHOD");
+  const char *if_none_match = getenv("HTTP_IF_NONE_MATCH");
+  char index[MAX_PATH + 16], not_modified[120];
+  struct iovec iov[2];
+  ssize_t w;
+  int n;
+
+  if (*path && path[strlen(path) - 1] == '/') {
+    snprintf(index, sizeof index, "%.*sindex.html", MAX_PATH, path);
+    path = index;
+  }
+  e = find(b, path);
+  if (!e) {
+    printf("Status: 404 Not Found\nContent-Type: text/plain\n"
+        "Content-Length: 10\n\nNot Found\n");
+    report_status(404, 10);
+    return;
+  }
+
+  v = e->gzip.headers && accepts_gzip(getenv("HTTP_ACCEPT_ENCODING")) ?
+      &e->gzip : &e->plain;
+
+  if (if_none_match && etag_matches(if_none_match, v->etag)) {
+    n = snprintf(not_modified, sizeof not_modified,
+        "Status: 304 Not Modified\nETag: %s\n%s\n", v->etag,
+        e->gzip.headers ? "Vary: Accept-Encoding\n" : "");
+    write_all(1, not_modified, n);
+    report_status(304, 0);
+    return;
+  }
+
+  iov[0].iov_base = (char *) b + v->headers;
+  iov[0].iov_len = v->headers_length;
+  iov[1].iov_base = (char *) b + v->body;
+  iov[1].iov_len = method && strcmp(method, "HEAD") == 0 ? 0 :
+      v->body_length;
+  w = writev(1, iov, 2);
+  if (w < 0)
+    die(strerror(errno));
+
+  /* finish a short write the slow way */
+  if ((size_t) w < iov[0].iov_len) {
+    write_all(1, (char *) iov[0].iov_base + w, iov[0].iov_len - w);
+    w = 0;
+  } else {
+    w -= iov[0].iov_len;
+  }
+  write_all(1, (char *) iov[1].iov_base + w, iov[1].iov_len - w);
+  report_status(200, iov[1].iov_len);
+}
+
+
+/**
+ * Binary search of the index for PATH.
+ */
+const struct entry *find(const struct bundle *b, const char *path)
+{
+  const struct entry *entries = (const struct entry *) (b + 1);
+  uint32_t low = 0, high = b->entry_count, mid;
+  int c;
+
+  while (low < high) {
+    mid = low + (high - low) / 2;
+    c = strcmp(path, (const char *) b + entries[mid].path);
+    if (c == 0)
+      return &entries[mid];
+    if (c < 0)
+      high = mid;
+    else
+      low = mid + 1;
+  }
+  return 0;
+}
+
+
+/**
+ * Whether an Accept-Encoding header allows gzip, ie. names it without
+ * q=0 [RFC 9110 12.5.3].
+ */
+bool accepts_gzip(const char *header)
+{
+  const char *p;
+
+  for (p = header; p && (p = strcasestr(p, "gzip")); p += 4) {
+    if ((p != header && !strchr(" \t,", p[-1])) ||
+        !strchr(" \t,;", p[4]))
+      continue;
+    p += 4 + strspn(p + 4, " \t");
+    if (*p != ';')
+      return true;
+    p += 1 + strspn(p + 1, " \t");
+    return strncasecmp(p, "q=", 2) || strtod(p + 2, 0) > 0;
+  }
+  return false;
+}
+
+
+/**
+ * Whether If-None-Match is * or lists ETAG, weakly or not [RFC 9110
+ * 13.1.2].
+ */
+bool etag_matches(const char *header, const char *etag)
+{
+  size_t n = strlen(etag);
+  const char *p;
+
+  if (header[strspn(header, " \t")] == '*')
+    return true;
+  for (p = header; (p = strstr(p, etag)); p += n)
+    if (p[n] == 0 || strchr(" \t,", p[n]))
+      return true;
+  return false;
+}
+
+
+/**
+ * Save the status and the body bytes written in MARTIN_STATUS_FILE, if set.
+ */
+void report_status(int status, uint64_t bytes)
+{
+  const char *path = getenv("MARTIN_STATUS_FILE");
+  FILE *f;
+
+  if (!path || !*path || !(f = fopen(path, "w")))
+    return;
+  fprintf(f, "%d %llu\n", status, (unsigned long long) bytes);
+  fclose(f);
+}
+
+
+/**
+ * Print each path in the bundle with its type and sizes.
+ */
+void list(const char *bundle_path)
+{
+  const struct bundle *b = map_bundle(bundle_path);
+  const struct entry *entries = (const struct entry *) (b + 1);
+  const char *path;
+  uint32_t i;
+
+  for (i = 0; i != b->entry_count; i++) {
+    path = (const char *) b + entries[i].path;
+    printf("%-40s %-32s %10llu", path, content_type(path),
+        (unsigned long long) entries[i].plain.body_length);
+    if (entries[i].gzip.headers)
+      printf(" %10llu gzip", (unsigned long long) entries[i].gzip.body_length);
+    printf("\n");
+  }
+}
+
+
+/**
+ * Map the whole bundle. Its size comes from its header, and is checked
+ * against the end of the file rather than with a stat, so a truncated copy
+ * is refused instead of faulting. Every offset in the index is checked once
+ * here, so find() and serve() can follow them as they are.
+ */
+const struct bundle *map_bundle(const char *bundle_path)
+{
+  const struct entry *entries;
+  const struct bundle *p;
+  struct bundle b;
+  uint32_t i;
+  int fd;
+
+  fd = open(bundle_path, O_RDONLY);
+  if (fd == -1)
+    die(strerror(errno));
+  if (read(fd, &b, sizeof b) != (ssize_t) sizeof b ||
+      b.magic != BUNDLE_MAGIC || lseek(fd, 0, SEEK_END) != (off_t) b.size ||
+      (b.size - sizeof b) / sizeof *entries < b.entry_count)
+    die("Not a bundle");
+  p = mmap(0, b.size, PROT_READ, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED)
+    die(strerror(errno));
+  close(fd);
+
+  entries = (const struct entry *) (p + 1);
+  for (i = 0; i != p->entry_count; i++) {
+    if (entries[i].path >= p->size ||
+        !memchr((const char *) p + entries[i].path, 0,
+        p->size - entries[i].path) ||
+        !valid_variant(p, &entries[i].plain) ||
+        (entries[i].gzip.headers && !valid_variant(p, &entries[i].gzip)))
+      die("Not a bundle");
+  }
+  return p;
+}
+
+
+/**
+ * Whether a variant's headers and body lie inside the bundle and its ETag
+ * is terminated.
+ */
+bool valid_variant(const struct bundle *b, const struct variant *v)
+{
+  return inside(b, v->headers, v->headers_length) &&
+      inside(b, v->body, v->body_length) &&
+      memchr(v->etag, 0, sizeof v->etag);
+}
+
+
+bool inside(const struct bundle *b, uint64_t offset, uint64_t length)
+{
+  return offset <= b->size && length <= b->size - offset;
+}
+
+
+void append(struct buffer *b, const char *p, size_t n)
+{
+  if (b->length + n > b->size) {
+    b->size = b->size * 2 > b->length + n ? b->size * 2 :
+        b->length + n + 4096;
+    b->data = realloc(b->data, b->size);
+    if (!b->data)
+      die("Out of memory");
+  }
+  memcpy(b->data + b->length, p, n);
+  b->length += n;
+}
+
+
+void write_all(int fd, const char *p, size_t n)
+{
+  ssize_t w;
+
+  while (n) {
+    w = write(fd, p, n);
+    if (w <= 0)
+      die(strerror(errno));
+    p += w;
+    n -= w;
+  }
+}
+
+
+/**
+ * Print an error message and exit.
+ */
+void die(const char *error)
+{
+  fprintf(stderr, "bundle: %s\n", error);
+  exit(EXIT_FAILURE);
+}
@@ -0,0 +1,139 @@
+#!/bin/sh
+
+# Check query.c's multipart/form-data handling (read_multipart in util.c)
+# against crafted bodies: a plain form, LF-only line endings, a part header
+# and a field over their limits, and a delimiter split across the reader's
+# 256 KB blocks. Spooled uploads must be gone afterwards. A url-encoded
+# body over 1 MB must be refused. text/plain bodies check the line reader
+# (lr_next): CRLF endings, a CRLF split across reads, an overlong line, a
+# last line without LF, and stopping at CONTENT_LENGTH.
+#
+#   tools/formtest.sh
+#
+# It builds tools/query with AddressSanitizer where the compiler has it.
+
+formtest_dir="$(mktemp -d)" || exit 1
+trap 'rm -rf "$formtest_dir"' EXIT INT TERM
+formtest_failed=0
+cd "$(dirname "$0")" || exit 1
+
+${CC:-gcc} -g -fsanitize=address -o "$formtest_dir/query" query.c util.c \
+    2> /dev/null ||
+    ${CC:-gcc} -O2 -o "$formtest_dir/query" query.c util.c 2> /dev/null ||
+    { echo "formtest: failed to build query"; exit 1; }
+mkdir "$formtest_dir/spool"
+
+# formtest_post TYPE LENGTH: post stdin to query as TYPE
+formtest_post () {
+    REQUEST_METHOD=POST HTTP_ACCEPT=application/json CONTENT_TYPE="$1" \
+        CONTENT_LENGTH="$2" TMPDIR="$formtest_dir/spool" \
+        "$formtest_dir/query" 2>&1
+}
+
+# formtest_check NAME EXPECTED OUTPUT: look for EXPECTED in OUTPUT
+formtest_check () {
+    case "$3" in
+        *"$2"*) echo "ok    $1" ;;
+        *)
+            echo "FAIL  $1"
+            printf '%s\n' "$3" | head -5 | sed 's/^/      /'
+            formtest_failed=1
+            ;;
+    esac
+}
+
+# formtest_run NAME EXPECTED [TYPE]: post $formtest_dir/body, as multipart
+# unless TYPE is given, and look for EXPECTED in the output
+formtest_run () {
+    formtest_check "$1" "$2" "$(formtest_post \
+        "${3:-multipart/form-data; boundary=XyZ}" \
+        "$(wc -c < "$formtest_dir/body")" < "$formtest_dir/body")"
+}
+
+# formtest_part NAME [FILENAME]: the headers of a part, CRLF ended
+formtest_part () {
+    printf -- '--XyZ\r\nContent-Disposition: form-data; name="%s"' "$1"
+    [ "$2" ] && printf '; filename="%s"\r\nContent-Type: text/plain' "$2"
+    printf '\r\n\r\n'
+}
+
+{
+    formtest_part a; printf '1\r\n'
+    formtest_part up notes.txt; printf 'hello\r\n'
+    printf -- '--XyZ--\r\n'
+} > "$formtest_dir/body"
+formtest_run "fields and a file" '[["a","1"],["up","notes.txt (5 bytes, text/plain)"]]'
+
+{
+    printf -- '--XyZ\nContent-Disposition: form-data; name="a"\n\n1\n'
+    printf -- '--XyZ--\n'
+} > "$formtest_dir/body"
+formtest_run "LF line endings" "Malformed form data."
+
+{
+    printf -- '--XyZ\r\nContent-Disposition: form-data; name="'
+    head -c 20000 /dev/zero | tr '\0' a
+    printf '"\r\n\r\n1\r\n--XyZ--\r\n'
+} > "$formtest_dir/body"
+formtest_run "oversized part header" "Request body too large."
+
+{
+    formtest_part a
+    head -c 1100000 /dev/zero | tr '\0' a
+    printf '\r\n--XyZ--\r\n'
+} > "$formtest_dir/body"
+formtest_run "oversized field" "Request body too large."
+
+# the first block holds the 2 byte CRLF the reader adds, so a delimiter
+# ending near 262144 - 2 bytes into the body straddles the first read
+formtest_header="$(formtest_part up big.txt | wc -c)"
+for formtest_delim in 0 1 3 5 7 9; do
+    formtest_size=$((262142 - formtest_header - formtest_delim))
+    {
+        formtest_part up big.txt
+        head -c "$formtest_size" /dev/zero | tr '\0' b
+        printf '\r\n--XyZ--\r\n'
+    } > "$formtest_dir/body"
+    formtest_run "delimiter split $formtest_delim bytes into a block" \
+        "big.txt ($formtest_size bytes, text/plain)"
+done
+
+printf 'a=1\r\nb=x y\r\n' > "$formtest_dir/body"
+formtest_run "text/plain CRLF lines" '[["a","1"],["b","x y"]]' text/plain
+
+printf 'a=1\r\nb=2' > "$formtest_dir/body"
+formtest_run "text/plain last line without LF" '[["a","1"],["b","2"]]' \
+    text/plain
+
+{
+    printf 'a='
+    head -c 1100000 /dev/zero | tr '\0' a
+    printf '\r\nb=2\r\n'
+} > "$formtest_dir/body"
+formtest_run "text/plain overlong line" "Request body too large." text/plain
+
+printf 'a=1&b=2' > "$formtest_dir/body"
+formtest_run "url-encoded body" '[["a","1"],["b","2"]]' \
+    application/x-www-form-urlencoded
+
+# the claimed length is refused before anything is allocated or read
+formtest_check "url-encoded body over 1 MB" "Request body too large." \
+    "$(printf 'a=1' | formtest_post application/x-www-form-urlencoded \
+        1048577)"
+
+# the CR and LF of one line end arrive in separate reads from a pipe
+formtest_check "text/plain CRLF split across reads" '[["a","1"],["b","2"]]' \
+    "$({ printf 'a=1\r'; sleep 1; printf '\nb=2\r\n'; } |
+        formtest_post text/plain 10)"
+
+formtest_check "text/plain stops at CONTENT_LENGTH" '[["a","1"]]' \
+    "$(printf 'a=1\r\nb=2\r\n' | formtest_post text/plain 5)"
+
+if [ "$(ls "$formtest_dir/spool")" ]; then
+    echo "FAIL  spooled uploads left behind"
+    formtest_failed=1
+else
+    echo "ok    no spooled uploads left behind"
+fi
+
+exit $formtest_failed
@@ -7,123 +7,189 @@
 
 /*
  * Compile using
- *   gcc -W -Wall `curl-config --cflags --libs` -o httplint httplint.c
+ *   gcc -W -Wall `curl-config --cflags --libs` -o httplint httplint.c \
+ *       libhttplint.c -lm -lz
+ *
+ * Usage:
+ *   httplint [--html] [--cache] [--body] [--cookies] [--timing] [--repeat N]
+ *            [--fresh] [--crawl] [--depth N] [--max-pages N] [--parallel N]
+ *            url [url ...]
+ *   httplint [--html] [--body] --response file [file ...]
+ *
+ * A url of - reads more urls from stdin, one per line.
+ *
+ * --cache audits how well each response can be cached. The freshness
+ * lifetime, validators, Vary and anything that keeps a shared cache from
+ * storing the response are scored out of 100, and the response is fetched
+ * again with If-None-Match / If-Modified-Since to check that the server
+ * answers 304 Not Modified. A summary of all the urls, worst first, follows
+ * the per-url output.
+ *
+ * --body reads the whole body, asking for it gzip or deflate encoded, and
+ * streams it through a byte count, an MD5 digest and a decompressor (or,
+ * for a body sent without a content coding, a compressor, to estimate what
+ * encoding it would save) without keeping it. Content-Length, Content-MD5
+ * and Content-Encoding are then checked against the body itself, and
+ * compression that saves too little, or a large body sent uncompressed
+ * that would shrink well, is pointed out. Crawled pages are not checked.
+ *
+ * --cookies keeps the cookies that each site sets, as a browser would, and
+ * after each response notes the Cookie header a request for that url now
+ * carries. A request that no longer fits in one 1500 byte MTU packet, or a
+ * cookie set again under the same name for another path or domain, is
+ * warned about. A summary of the bytes every request to each site carries
+ * follows the per-url output.
+ *
+ * --timing reports where the time of each fetch went (DNS lookup, TCP
+ * connect, TLS handshake, time to the first byte and in total) and the
+ * header and body sizes. The body is read in full rather than abandoned
+ * after the headers. --repeat N then fetches each url N more times without
+ * checking it and prints the min, median and 95th percentile of each
+ * phase. The repeats reuse the connection where the server allows it, or
+ * open a new one every time with --fresh.
+ *
+ * --crawl starts from the urls given and follows redirects and the href and
+ * src links of HTML pages, as long as they stay on the same origin (scheme,
+ * host and port) as the page they were found on. It goes at most --depth
+ * links deep (default 3) and fetches at most --max-pages pages (default
+ * 100), --parallel at a time (default 8). Each url is fetched once, then
+ * every page is checked in the order it was found, and redirect chains are
+ * listed with the time they add.
+ *
+ * --response checks HTTP responses saved in files (or - for stdin), as
+ * they would be sent, instead of fetching urls. After each one comes a
+ * summary line: "Response FILE: status N, N errors, N warnings." The exit
+ * status is 1 if any response had an error. --cache and --timing need a
+ * fetch, so they are ignored.
+ *
+ * The checks themselves are in libhttplint.c (see httplint.h); this is the
+ * program that fetches the urls and prints what the checks find.
  *
  * References of the form [6.1.1] are to RFC 2616 (HTTP/1.1).
  */
 
 #define _GNU_SOURCE
-#define __USE_XOPEN
 
-#include <limits.h>
-#include <math.h>
+#include <errno.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
-#include <sys/types.h>
-#include <regex.h>
 #include <curl/curl.h>
+#include "httplint.h"
 
 
-#define NUMBER "0123456789"
+#define USAGE "Usage: httplint [--html] [--cache] [--body] [--cookies] " \
+    "[--timing] [--repeat N] " \
+    "[--fresh] [--crawl] [--depth N] [--max-pages N] [--parallel N] " \
+    "url [url ...]\n" \
+    "       httplint [--html] [--body] --response file [file ...]"
+#define CRAWL_BODY_MAX 1048576
 #define UNUSED(x) x = x
 
-char *strndup(const char *src, size_t len) {
-    return strdup(src);
-}
-
-bool start;
 bool html = false;
+bool cache_audit = false;
+bool body_check = false;
+bool body_active = false;       /* the body of a live fetch is being read */
+bool body_incomplete = false;   /* and was cut short */
+bool cookies = false;
+bool timing = false;
+bool fresh = false;
+unsigned int repeat = 0;
+bool crawl = false;
+bool response = false;
+unsigned int crawl_depth = 3, crawl_max_pages = 100, crawl_parallel = 8;
 CURL *curl;
-int status_code;
+struct curl_slist *request_headers = 0;
+struct httplint *lint;
 char error_buffer[CURL_ERROR_SIZE];
-regex_t re_status_line, re_token, re_token_value, re_content_type, re_ugly,
-    re_absolute_uri, re_etag, re_server, re_transfer_coding, re_upgrade,
-    re_rfc1123, re_rfc1036, re_asctime, re_cookie_nameval, re_cookie_expires;
+unsigned int errors, warnings;  /* in the response being checked */
+
+/* one line of the --cache summary */
+struct cache_result {
+  char *url;
+  int score;
+  long lifetime;
+  bool etag, last_modified, revalidated;
+};
+
+struct cache_result *cache_results;
+unsigned int cache_result_count;
+
+/* one fetch for --timing, in milliseconds; dns, connect and tls are the
+ * length of each phase, first_byte and total are from the start */
+struct timing {
+  double dns, connect, tls, first_byte, total;
+  long header_size;
+  curl_off_t body_size;
+};
+
+
+/* a url found by --crawl, and what fetching it gave */
+struct page {
+  char *url;
+  char *origin;                 /* links are followed only within this */
+  unsigned int depth;
+  char *headers;                /* the raw header lines, CR LF and all */
+  size_t headers_len;
+  char *body;                   /* HTML only, up to CRAWL_BODY_MAX */
+  size_t body_len;
+  bool html_body;
+  int status;
+  char *location;               /* resolved Location of a redirect */
+  bool redirect_target;
+  double total;                 /* ms */
+  char *error;
+};
+
+struct page *pages;
+unsigned int page_count;
+
+/* every url seen by --crawl, as indexes into pages */
+int *seen;
+unsigned int seen_size;
 
 
 void init(void);
-void regcomp_wrapper(regex_t *preg, const char *regex, int cflags);
 void check_url(const char *url);
+void begin_check(const char *url, unsigned int options);
+void end_check(const char *url, const char *error, bool live);
+void crawl_site(char **seeds, int n);
+int add_page(const char *url, const char *origin, unsigned int depth);
+char *normalize_url(const char *base, const char *link, char **origin);
+uint32_t hash_url(const char *url);
+void start_fetch(CURLM *multi, unsigned int i);
+void finish_fetch(CURLM *multi, CURL *handle, CURLcode code);
+size_t crawl_header_callback(char *ptr, size_t msize, size_t nmemb,
+    void *stream);
+size_t crawl_data_callback(void *ptr, size_t size, size_t nmemb,
+    void *stream);
+void find_links(unsigned int i);
+void check_page(unsigned int i);
+void print_redirect_chains(void);
+void check_url_list(FILE *f);
+bool check_response(const char *path);
+void audit_cache(const char *url);
+bool revalidate(const char *url, const struct httplint_cache *cache);
+size_t revalidate_header_callback(char *ptr, size_t msize, size_t nmemb,
+    void *stream);
+int cache_result_compare(const void *a, const void *b);
+void print_cache_summary(void);
+void print_cookie_summary(void);
+bool get_timing(struct timing *t);
+void print_timing(const char *url);
+size_t quiet_header_callback(char *ptr, size_t msize, size_t nmemb,
+    void *stream);
+int double_compare(const void *a, const void *b);
+void print_percentiles(const char *phase, double *samples, unsigned int n);
 size_t header_callback(char *ptr, size_t msize, size_t nmemb, void *stream);
 size_t data_callback(void *ptr, size_t size, size_t nmemb, void *stream);
-void check_status_line(const char *s);
-void check_header(const char *name, const char *value);
-bool parse_date(const char *s, struct tm *tm);
-int month(const char *s);
-time_t mktime_from_utc(struct tm *t);
-const char *skip_lws(const char *s);
-bool parse_list(const char *s, regex_t *preg, unsigned int n, unsigned int m,
-    void (*callback)(const char *s, regmatch_t pmatch[]));
-void header_accept_ranges(const char *s);
-void header_age(const char *s);
-void header_allow(const char *s);
-void header_cache_control(const char *s);
-void header_cache_control_callback(const char *s, regmatch_t pmatch[]);
-void header_connection(const char *s);
-void header_content_encoding(const char *s);
-void header_content_encoding_callback(const char *s, regmatch_t pmatch[]);
-void header_content_language(const char *s);
-void header_content_length(const char *s);
-void header_content_location(const char *s);
-void header_content_md5(const char *s);
-void header_content_range(const char *s);
-void header_content_type(const char *s);
-void header_date(const char *s);
-void header_etag(const char *s);
-void header_expires(const char *s);
-void header_last_modified(const char *s);
-void header_location(const char *s);
-void header_pragma(const char *s);
-void header_retry_after(const char *s);
-void header_server(const char *s);
-void header_trailer(const char *s);
-void header_transfer_encoding(const char *s);
-void header_transfer_encoding_callback(const char *s, regmatch_t pmatch[]);
-void header_upgrade(const char *s);
-void header_vary(const char *s);
-void header_via(const char *s);
-void header_set_cookie(const char *s);
 void die(const char *error);
 void print(const char *s, size_t len);
-void lookup(const char *key);
-
-
-struct header_entry {
-  char name[40];
-  void (*handler)(const char *s);
-  int count;
-  char *missing;
-} header_table[] = {
-  { "Accept-Ranges", header_accept_ranges, 0, 0 },
-  { "Age", header_age, 0, 0 },
-  { "Allow", header_allow, 0, 0 },
-  { "Cache-Control", header_cache_control, 0, 0 },
-  { "Connection", header_connection, 0, 0 },
-  { "Content-Encoding", header_content_encoding, 0, 0 },
-  { "Content-Language", header_content_language, 0, "missingcontlang" },
-  { "Content-Length", header_content_length, 0, 0 },
-  { "Content-Location", header_content_location, 0, 0 },
-  { "Content-MD5", header_content_md5, 0, 0 },
-  { "Content-Range", header_content_range, 0, 0 },
-  { "Content-Type", header_content_type, 0, "missingcontenttype" },
-  { "Date", header_date, 0, "missingdate" },
-  { "ETag", header_etag, 0, 0 },
-  { "Expires", header_expires, 0, 0 },
-  { "Last-Modified", header_last_modified, 0, "missinglastmod" },
-  { "Location", header_location, 0, 0 },
-  { "Pragma", header_pragma, 0, 0 },
-  { "Retry-After", header_retry_after, 0, 0 },
-  { "Server", header_server, 0, 0 },
-  { "Set-Cookie", header_set_cookie, 0, 0 },
-  { "Trailer", header_trailer, 0, 0 },
-  { "Transfer-Encoding", header_transfer_encoding, 0, 0 },
-  { "Upgrade", header_upgrade, 0, 0 },
-  { "Vary", header_vary, 0, 0 },
-  { "Via", header_via, 0, 0 }
-};
+void report(void *arg, enum httplint_level level, const char *key,
+    const char *message);
+void print_message(const char *s);
 
 
 /**
@@ -131,21 +197,84 @@ struct header_entry {
  */
 int main(int argc, char *argv[])
 {
-  int i = 1;
+  int i = 1, failed;
 
   if (argc < 2)
-    die("Usage: httplint [--html] url [url ...]");
+    die(USAGE);
 
   init();
 
-  if (1 < argc && strcmp(argv[1], "--html") == 0) {
-    html = true;
-    i++;
+  for (; i != argc && strncmp(argv[i], "--", 2) == 0; i++) {
+    if (strcmp(argv[i], "--html") == 0)
+      html = true;
+    else if (strcmp(argv[i], "--cache") == 0)
+      cache_audit = true;
+    else if (strcmp(argv[i], "--body") == 0)
+      body_check = true;
+    else if (strcmp(argv[i], "--cookies") == 0)
+      cookies = true;
+    else if (strcmp(argv[i], "--timing") == 0)
+      timing = true;
+    else if (strcmp(argv[i], "--fresh") == 0)
+      fresh = true;
+    else if (strcmp(argv[i], "--repeat") == 0 && i + 1 != argc &&
+        0 < atoi(argv[i + 1])) {
+      timing = true;
+      repeat = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--crawl") == 0)
+      crawl = true;
+    else if (strcmp(argv[i], "--response") == 0)
+      response = true;
+    else if (strcmp(argv[i], "--depth") == 0 && i + 1 != argc)
+      crawl_depth = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--max-pages") == 0 && i + 1 != argc &&
+        0 < atoi(argv[i + 1]))
+      crawl_max_pages = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--parallel") == 0 && i + 1 != argc &&
+        0 < atoi(argv[i + 1]))
+      crawl_parallel = atoi(argv[++i]);
+    else
+      die(USAGE);
+  }
+
+  if (response) {
+    cache_audit = timing = crawl = false;
+    for (failed = 0; i != argc; i++)
+      failed |= !check_response(argv[i]);
+    httplint_free(lint);
+    curl_global_cleanup();
+    return failed;
+  }
+
+  if (body_check && !crawl) {
+    /* ask for an encoded body, which curl will pass on undecoded, and
+     * give up on one that stalls short of its Content-Length */
+    request_headers = curl_slist_append(request_headers,
+        "Accept-Encoding: gzip, deflate");
+    if (curl_easy_setopt(curl, CURLOPT_HTTPHEADER, request_headers) ||
+        curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L) ||
+        curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 10L))
+      die("Failed to set curl options");
+  } else {
+    body_check = false;
+  }
+
+  if (crawl)
+    crawl_site(argv + i, argc - i);
+  for (; !crawl && i != argc; i++) {
+    if (strcmp(argv[i], "-") == 0)
+      check_url_list(stdin);
+    else
+      check_url(argv[i]);
   }
 
-  for (; i != argc; i++)
-    check_url(argv[i]);
+  if (cache_audit)
+    print_cache_summary();
+  if (cookies)
+    print_cookie_summary();
 
+  httplint_free(lint);
   curl_global_cleanup();
 
   return 0;
@@ -153,12 +282,10 @@ int main(int argc, char *argv[])
 
 
 /**
- * Initialise the curl handle and compile regular expressions.
+ * Initialise the curl handle and the checker.
  */
 void init(void)
 {
-  struct curl_slist *request_headers = 0;
-
   if (curl_global_init(CURL_GLOBAL_ALL))
     die("Failed to initialise libcurl");
 
@@ -181,94 +308,55 @@ void init(void)
   if (curl_easy_setopt(curl, CURLOPT_HTTPHEADER, request_headers))
     die("Failed to set curl options");
 
-  /* compile regular expressions */
-  regcomp_wrapper(&re_status_line,
-      "^HTTP/([0-9]+)[.]([0-9]+) ([0-9][0-9][0-9]) ([\t -~-]*)$",
-      REG_EXTENDED);
-  regcomp_wrapper(&re_token,
-      "^([-0-9a-zA-Z_.!]+)",
-      REG_EXTENDED);
-  regcomp_wrapper(&re_token_value,
-      "^([-0-9a-zA-Z_.!]+)(=([-0-9a-zA-Z_.!]+|\"([^\"]|[\\].)*\"))?",
-      REG_EXTENDED);
-  regcomp_wrapper(&re_content_type,
-      "^([-0-9a-zA-Z_.]+)/([-0-9a-zA-Z_.]+)[ \t]*"
-      "(;[ \t]*([-0-9a-zA-Z_.]+)="
-       "([-0-9a-zA-Z_.]+|\"([^\"]|[\\].)*\")[ \t]*)*$",
-      REG_EXTENDED);
-  regcomp_wrapper(&re_absolute_uri,
-      "^[a-zA-Z0-9]+://[^ ]+$",
-      REG_EXTENDED);
-  regcomp_wrapper(&re_etag,
-      "^(W/[ \t]*)?\"([^\"]|[\\].)*\"$",
-      REG_EXTENDED);
-  regcomp_wrapper(&re_server,
-      "^((([-0-9a-zA-Z_.!]+(/[-0-9a-zA-Z_.]+)?)|(\\(.*\\)))[ \t]*)+$",
-      REG_EXTENDED);
-  regcomp_wrapper(&re_transfer_coding,
-      "^([-0-9a-zA-Z_.]+)[ \t]*"
-      "(;[ \t]*([-0-9a-zA-Z_.]+)="
-       "([-0-9a-zA-Z_.]+|\"([^\"]|[\\].)*\")[ \t]*)*$",
-      REG_EXTENDED);
-  regcomp_wrapper(&re_upgrade,
-      "^([-0-9a-zA-Z_.](/[-0-9a-zA-Z_.])?)+$",
-      REG_EXTENDED);
-  regcomp_wrapper(&re_ugly,
-      "^[a-zA-Z0-9]+://[^/]+[-/a-zA-Z0-9_]*$",
-      REG_EXTENDED);
-  regcomp_wrapper(&re_rfc1123,
-      "^(Mon|Tue|Wed|Thu|Fri|Sat|Sun), ([0123][0-9]) "
-      "(Jan|Feb|Mar|Apr|May|Jun|Jul|Aug|Sep|Oct|Nov|Dec) ([0-9]{4}) "
-      "([012][0-9]):([0-5][0-9]):([0-5][0-9]) GMT$",
-      REG_EXTENDED);
-  regcomp_wrapper(&re_rfc1036,
-      "^(Monday|Tuesday|Wednesday|Thursday|Friday|Saturday|Sunday), "
-      "([0123][0-9])-(Jan|Feb|Mar|Apr|May|Jun|Jul|Aug|Sep|Oct|Nov|Dec)-"
-      "([0-9][0-9]) ([012][0-9]):([0-5][0-9]):([0-5][0-9]) GMT$",
-      REG_EXTENDED);
-  regcomp_wrapper(&re_asctime,
-      "^(Mon|Tue|Wed|Thu|Fri|Sat|Sun) "
-      "(Jan|Feb|Mar|Apr|May|Jun|Jul|Aug|Sep|Oct|Nov|Dec) ([ 12][0-9]) "
-      "([012][0-9]):([0-5][0-9]):([0-5][0-9]) ([0-9]{4})$",
-      REG_EXTENDED);
-  regcomp_wrapper(&re_cookie_nameval,
-      "^[^;, ]+=[^;, ]*$",
-      REG_EXTENDED);
-  regcomp_wrapper(&re_cookie_expires,
-      "^(Mon|Tue|Wed|Thu|Fri|Sat|Sun), ([0123][0-9])-"
-      "(Jan|Feb|Mar|Apr|May|Jun|Jul|Aug|Sep|Oct|Nov|Dec)-([0-9]{4}) "
-      "([012][0-9]):([0-5][0-9]):([0-5][0-9]) GMT$",
-      REG_EXTENDED);
+  if (!httplint_init())
+    die("Failed to compile regular expressions");
+  lint = httplint_new(report, 0);
+  if (!lint)
+    die("Out of memory");
 }
 
 
 /**
- * Compile a regular expression, handling errors.
+ * Fetch and check the headers for the specified url.
  */
-void regcomp_wrapper(regex_t *preg, const char *regex, int cflags)
+void check_url(const char *url)
 {
-  char errbuf[200];
-  int r;
-  r = regcomp(preg, regex, cflags);
-  if (r) {
-    regerror(r, preg, errbuf, sizeof errbuf);
-    fprintf(stderr, "Failed to compile regexp '%s'\n", regex);
-    die(errbuf);
+  CURLcode code;
+
+  begin_check(url, (body_check ? HTTPLINT_BODY : 0) |
+      (cookies ? HTTPLINT_COOKIES : 0));
+
+  if (curl_easy_setopt(curl, CURLOPT_URL, url))
+    die("Failed to set curl options");
+
+  if (html)
+    printf("<ul>\n");
+  body_active = body_check;
+  code = curl_easy_perform(curl);
+  body_active = false;
+  if (html)
+    printf("</ul>\n");
+
+  /* a body cut short after the headers is a finding, not a failure */
+  if (body_check && httplint_status(lint) &&
+      (code == CURLE_PARTIAL_FILE || code == CURLE_OPERATION_TIMEDOUT)) {
+    body_incomplete = true;
+    code = CURLE_OK;
   }
+
+  end_check(url, code != CURLE_OK && code != CURLE_WRITE_ERROR ?
+      error_buffer : 0, true);
 }
 
 
 /**
- * Fetch and check the headers for the specified url.
+ * Reset the checker, passing it OPTIONS, and announce the url.
  */
-void check_url(const char *url)
+void begin_check(const char *url, unsigned int options)
 {
-  int i, r;
-  CURLcode code;
-
-  start = true;
-  for (i = 0; i != sizeof header_table / sizeof header_table[0]; i++)
-    header_table[i].count = 0;
+  httplint_begin(lint, options);
+  body_incomplete = false;
+  errors = warnings = 0;
 
   if (!html)
     printf("Checking URL %s\n", url);
@@ -280,38 +368,38 @@ void check_url(const char *url)
       printf("</p>");
     printf("\n");
   }
+}
 
-  if (curl_easy_setopt(curl, CURLOPT_URL, url))
-    die("Failed to set curl options");
 
-  if (html)
-    printf("<ul>\n");
-  code = curl_easy_perform(curl);
-  if (html)
-    printf("</ul>\n");
-  if (code != CURLE_OK && code != CURLE_WRITE_ERROR) {
+/**
+ * Report on the response once all its headers have been checked, or the
+ * error that stopped the fetch. The timing of a LIVE fetch, one that has
+ * just been made with the curl handle, can be reported as well.
+ */
+void end_check(const char *url, const char *error, bool live)
+{
+  if (error) {
     if (html)
       printf("<p class='error'>");
     printf("Error: ");
-    print(error_buffer, strlen(error_buffer));
+    print(error, strlen(error));
     printf(".");
     if (html)
       printf("</p>");
     printf("\n");
     return;
-  } else {
-    printf("\n");
-    if (html)
-      printf("<ul>");
-    for (i = 0; i != sizeof header_table / sizeof header_table[0]; i++) {
-      if (header_table[i].count == 0 && header_table[i].missing)
-        lookup(header_table[i].missing);
-    }
   }
 
-  r = regexec(&re_ugly, url, 0, 0, 0);
-  if (r)
-    lookup("ugly");
+  printf("\n");
+  if (html)
+    printf("<ul>");
+  httplint_end(lint, url, body_incomplete);
+
+  if (timing && live)
+    print_timing(url);
+
+  if (cache_audit)
+    audit_cache(url);
 
   if (html)
     printf("</ul>");
@@ -319,789 +407,875 @@ void check_url(const char *url)
 
 
 /**
- * Callback for received header data.
+ * Check each url in a file, one per line.
  */
-size_t header_callback(char *ptr, size_t msize, size_t nmemb, void *stream)
+void check_url_list(FILE *f)
 {
-  const size_t size = msize * nmemb;
-  char s[400], *name, *value;
-
-  UNUSED(stream);
-
-  printf(html ? "<li><code>" : "* ");
-  print(ptr, size);
-  printf(html ? "</code><ul>" : "\n");
-
-  if (size < 2 || ptr[size - 2] != 13 || ptr[size - 1] != 10) {
-    lookup("notcrlf");
-    if (html)
-      printf("</ul></li>\n");
-    return size;
-  }
-  if (sizeof s <= size) {
-    lookup("headertoolong");
-    if (html)
-      printf("</ul></li>\n");
-    return size;
+  char line[4096];
+  size_t len;
+
+  while (fgets(line, sizeof line, f)) {
+    len = strcspn(line, "\r\n");
+    line[len] = 0;
+    if (len)
+      check_url(line);
   }
-  strncpy(s, ptr, size);
-  s[size - 2] = 0;
+}
 
-  name = s;
-  value = strchr(s, ':');
 
-  if (s[0] == 0) {
-    /* empty header indicates end of headers */
-    lookup("endofheaders");
-    if (html)
-      printf("</ul></li>\n");
-    return 0;
+/**
+ * Check a saved response, from the status line to the end of the body,
+ * returning false if it has any errors.
+ */
+bool check_response(const char *path)
+{
+  FILE *f = strcmp(path, "-") ? fopen(path, "rb") : stdin;
+  char line[4096];
+  size_t len;
 
-  } else if (start) {
-    /* Status-Line [6.1] */
-    check_status_line(s);
-    start = false;
+  httplint_begin(lint, body_check ? HTTPLINT_BODY : 0);
+  errors = warnings = 0;
+  if (!html)
+    printf("Checking response %s\n", path);
+  if (!f) {
+    end_check(0, strerror(errno), false);
+    return false;
+  }
 
-  } else if (!value) {
-    lookup("missingcolon");
+  if (html)
+    printf("<ul>\n");
+  while (fgets(line, sizeof line, f)) {
+    len = strlen(line);
+    header_callback(line, 1, len, 0);
+    if (strspn(line, "\r\n") == len)
+      break;
+  }
+  if (html)
+    printf("</ul>\n");
 
-  } else {
-    *value = 0;
-    value++;
+  while (body_check && (len = fread(line, 1, sizeof line, f)))
+    httplint_body(lint, line, len);
+  if (ferror(f))
+    body_incomplete = true;
+  if (f != stdin)
+    fclose(f);
 
-    check_header(name, skip_lws(value));
-  }
+  end_check(0, 0, false);
 
   if (html)
-    printf("</ul></li>\n");
-  return size;
+    printf("<p>");
+  printf("Response ");
+  print(path, strlen(path));
+  printf(": status %i, %u error%s, %u warning%s.", httplint_status(lint),
+      errors, errors == 1 ? "" : "s", warnings, warnings == 1 ? "" : "s");
+  printf(html ? "</p>\n" : "\n\n");
+  return errors == 0;
 }
 
 
 /**
- * Callback for received body data.
- *
- * We are not interested in the body, so abort the fetch by returning 0.
+ * Crawl the sites of the seed urls, then check every page found.
  */
-size_t data_callback(void *ptr, size_t size, size_t nmemb, void *stream)
+void crawl_site(char **seeds, int n)
 {
-  UNUSED(ptr);
-  UNUSED(size);
-  UNUSED(nmemb);
-  UNUSED(stream);
+  CURLM *multi;
+  CURLMsg *msg;
+  char *url, *origin;
+  unsigned int next = 0, i;
+  int running, left;
+
+  for (; n; seeds++, n--) {
+    url = normalize_url(0, *seeds, &origin);
+    if (!url) {
+      fprintf(stderr, "httplint: not a url: %s\n", *seeds);
+      continue;
+    }
+    add_page(url, origin, 0);
+    curl_free(url);
+    free(origin);
+  }
 
-  return 0;
+  multi = curl_multi_init();
+  if (!multi)
+    die("Failed to create curl multi handle");
+
+  /* pages are started in the order they were found, so the crawl goes
+   * breadth first apart from the fetches that overlap */
+  do {
+    curl_multi_perform(multi, &running);
+    while (next != page_count && (unsigned int) running < crawl_parallel) {
+      start_fetch(multi, next++);
+      running++;
+    }
+    while ((msg = curl_multi_info_read(multi, &left)))
+      if (msg->msg == CURLMSG_DONE)
+        finish_fetch(multi, msg->easy_handle, msg->data.result);
+    if (running)
+      curl_multi_poll(multi, 0, 0, 100, 0);
+  } while (running || next != page_count);
+
+  curl_multi_cleanup(multi);
+
+  for (i = 0; i != page_count; i++)
+    check_page(i);
+  print_redirect_chains();
 }
 
 
 /**
- * Check the syntax and content of the response Status-Line [6.1].
+ * Add a url to the crawl unless it has been seen already or the crawl is
+ * full, returning its index in pages or -1.
  */
-void check_status_line(const char *s)
+int add_page(const char *url, const char *origin, unsigned int depth)
 {
-  const char *reason;
-  unsigned int major = 0, minor = 0;
-  int r;
-  regmatch_t pmatch[5];
-
-  r = regexec(&re_status_line, s, 5, pmatch, 0);
-  if (r) {
-    lookup("badstatusline");
-    return;
-  }
-
-  major = atoi(s + pmatch[1].rm_so);
-  minor = atoi(s + pmatch[2].rm_so);
-  status_code = atoi(s + pmatch[3].rm_so);
-  reason = s + pmatch[4].rm_so;
-
-  if (major < 1 || (major == 1 && minor == 0)) {
-    lookup("oldhttp");
-  } else if ((major == 1 && 1 < minor) || 1 < major) {
-    lookup("futurehttp");
-  } else {
-    if (status_code < 100 || 600 <= status_code) {
-      lookup("badstatus");
-    } else {
-      char key[] = "xxx";
-      key[0] = '0' + status_code / 100;
-      lookup(key);
+  unsigned int i, j, old_size = seen_size;
+  int *old = seen;
+
+  if (seen_size < 2 * (page_count + 1)) {
+    /* grow the set, keeping it at most half full */
+    seen_size = seen_size ? 2 * seen_size : 256;
+    seen = malloc(seen_size * sizeof *seen);
+    if (!seen)
+      die("Out of memory");
+    for (i = 0; i != seen_size; i++)
+      seen[i] = -1;
+    for (i = 0; i != old_size; i++) {
+      if (old[i] == -1)
+        continue;
+      for (j = hash_url(pages[old[i]].url) & (seen_size - 1); seen[j] != -1;
+          j = (j + 1) & (seen_size - 1))
+        ;
+      seen[j] = old[i];
     }
+    free(old);
   }
+
+  for (i = hash_url(url) & (seen_size - 1); seen[i] != -1;
+      i = (i + 1) & (seen_size - 1))
+    if (strcmp(pages[seen[i]].url, url) == 0)
+      return -1;
+  if (page_count == crawl_max_pages)
+    return -1;
+
+  pages = realloc(pages, (page_count + 1) * sizeof *pages);
+  if (!pages)
+    die("Out of memory");
+  memset(&pages[page_count], 0, sizeof *pages);
+  pages[page_count].url = strdup(url);
+  pages[page_count].origin = strdup(origin);
+  pages[page_count].depth = depth;
+  seen[i] = page_count;
+  return page_count++;
 }
 
 
 /**
- * Check the syntax and content of a header.
+ * Resolve LINK against BASE (or take it as it is if BASE is 0) and drop
+ * any fragment, returning the url and, in ORIGIN, its scheme://host:port.
+ * Returns 0 for anything that is not an http or https url.
  */
-void check_header(const char *name, const char *value)
+char *normalize_url(const char *base, const char *link, char **origin)
 {
-  struct header_entry *header;
-
-  header = bsearch(name, header_table,
-      sizeof header_table / sizeof header_table[0],
-      sizeof header_table[0],
-      (int (*)(const void *, const void *)) strcasecmp);
-
-  if (header) {
-    header->count++;
-    header->handler(value);
-  } else if ((name[0] == 'X' || name[0] == 'x') && name[1] == '-') {
-    lookup("xheader");
+  CURLU *u = curl_url();
+  char *url = 0, *scheme = 0, *host = 0, *port = 0;
+
+  if (!u)
+    die("Out of memory");
+  if ((base && curl_url_set(u, CURLUPART_URL, base, 0)) ||
+      curl_url_set(u, CURLUPART_URL, link, 0) ||
+      curl_url_set(u, CURLUPART_FRAGMENT, 0, 0) ||
+      curl_url_get(u, CURLUPART_SCHEME, &scheme, 0) ||
+      (strcmp(scheme, "http") && strcmp(scheme, "https")) ||
+      curl_url_get(u, CURLUPART_HOST, &host, 0) ||
+      curl_url_get(u, CURLUPART_PORT, &port, CURLU_DEFAULT_PORT) ||
+      curl_url_get(u, CURLUPART_URL, &url, 0)) {
+    curl_free(url);
+    url = 0;
   } else {
-    lookup("nonstandard");
+    *origin = malloc(strlen(scheme) + strlen(host) + strlen(port) + 5);
+    if (!*origin)
+      die("Out of memory");
+    sprintf(*origin, "%s://%s:%s", scheme, host, port);
   }
+
+  curl_free(scheme);
+  curl_free(host);
+  curl_free(port);
+  curl_url_cleanup(u);
+  return url;
 }
 
 
 /**
- * Attempt to parse an HTTP Full Date (3.3.1), returning true on success.
+ * FNV-1a hash of a url.
  */
-bool parse_date(const char *s, struct tm *tm)
+uint32_t hash_url(const char *url)
 {
-  int r;
-  int len = strlen(s);
-  regmatch_t pmatch[20];
-
-  tm->tm_isdst = 0;
-  tm->tm_gmtoff = 0;
-  tm->tm_zone = "GMT";
-
-  if (len == 29) {
-    /* RFC 1123 */
-    r = regexec(&re_rfc1123, s, 20, pmatch, 0);
-    if (r == 0) {
-      tm->tm_mday = atoi(s + pmatch[2].rm_so);
-      tm->tm_mon = month(s + pmatch[3].rm_so);
-      tm->tm_year = atoi(s + pmatch[4].rm_so) - 1900;
-      tm->tm_hour = atoi(s + pmatch[5].rm_so);
-      tm->tm_min = atoi(s + pmatch[6].rm_so);
-      tm->tm_sec = atoi(s + pmatch[7].rm_so);
-      return true;
-    }
+  uint32_t h = 2166136261u;
 
-  } else if (len == 24) {
-    /* asctime() format */
-    r = regexec(&re_asctime, s, 20, pmatch, 0);
-    if (r == 0) {
-      if (s[pmatch[3].rm_so] == ' ')
-        tm->tm_mday = atoi(s + pmatch[3].rm_so + 1);
-      else
-        tm->tm_mday = atoi(s + pmatch[3].rm_so);
-      tm->tm_mon = month(s + pmatch[2].rm_so);
-      tm->tm_year = atoi(s + pmatch[7].rm_so) - 1900;
-      tm->tm_hour = atoi(s + pmatch[4].rm_so);
-      tm->tm_min = atoi(s + pmatch[5].rm_so);
-      tm->tm_sec = atoi(s + pmatch[6].rm_so);
-      lookup("asctime");
-      return true;
-    }
+  for (; *url; url++)
+    h = (h ^ (unsigned char) *url) * 16777619u;
+  return h;
+}
 
-  } else {
-    /* RFC 1036 */
-    r = regexec(&re_rfc1036, s, 20, pmatch, 0);
-    if (r == 0) {
-      tm->tm_mday = atoi(s + pmatch[2].rm_so);
-      tm->tm_mon = month(s + pmatch[3].rm_so);
-      tm->tm_year = 100 + atoi(s + pmatch[4].rm_so);
-      tm->tm_hour = atoi(s + pmatch[5].rm_so);
-      tm->tm_min = atoi(s + pmatch[6].rm_so);
-      tm->tm_sec = atoi(s + pmatch[7].rm_so);
-      lookup("rfc1036");
-      return true;
-    }
 
-  }
+/**
+ * Start fetching a page on its own handle. Redirects are not followed by
+ * curl, so that each hop is a page of its own.
+ */
+void start_fetch(CURLM *multi, unsigned int i)
+{
+  CURL *handle = curl_easy_init();
+  void *index = (void *) (intptr_t) i;
 
-  lookup("baddate");
-  return false;
+  if (!handle)
+    die("Failed to create curl handle");
+  if (curl_easy_setopt(handle, CURLOPT_URL, pages[i].url) ||
+      curl_easy_setopt(handle, CURLOPT_USERAGENT, "httplint") ||
+      curl_easy_setopt(handle, CURLOPT_HTTPHEADER, request_headers) ||
+      curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION,
+      crawl_header_callback) ||
+      curl_easy_setopt(handle, CURLOPT_HEADERDATA, index) ||
+      curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, crawl_data_callback) ||
+      curl_easy_setopt(handle, CURLOPT_WRITEDATA, index) ||
+      curl_easy_setopt(handle, CURLOPT_PRIVATE, index) ||
+      curl_multi_add_handle(multi, handle))
+    die("Failed to set curl options");
 }
 
 
 /**
- * Convert a month name to the month number.
+ * Note how a fetch went, and queue the links of the page.
  */
-int month(const char *s)
+void finish_fetch(CURLM *multi, CURL *handle, CURLcode code)
 {
-  switch (s[0]) {
-    case 'J':
-      switch (s[1]) {
-        case 'a':
-          return 0;
-        case 'u':
-          return s[2] == 'n' ? 5 : 6;
-      }
-    case 'F':
-      return 1;
-    case 'M':
-      return s[2] == 'r' ? 2 : 4;
-    case 'A':
-      return s[1] == 'p' ? 3 : 7;
-    case 'S':
-      return 8;
-    case 'O':
-      return 9;
-    case 'N':
-      return 10;
-    case 'D':
-      return 11;
+  struct page *page;
+  char *index, *url, *origin;
+  curl_off_t total = 0;
+  unsigned int i;
+  int j;
+
+  curl_easy_getinfo(handle, CURLINFO_PRIVATE, &index);
+  i = (intptr_t) index;
+  page = &pages[i];
+
+  if (code != CURLE_OK && code != CURLE_WRITE_ERROR)
+    page->error = strdup(curl_easy_strerror(code));
+  curl_easy_getinfo(handle, CURLINFO_TOTAL_TIME_T, &total);
+  page->total = total / 1000.0;
+
+  curl_multi_remove_handle(multi, handle);
+  curl_easy_cleanup(handle);
+
+  if (page->location) {
+    url = normalize_url(page->url, page->location, &origin);
+    free(page->location);
+    page->location = url;
+    /* add_page may move pages */
+    if (url && strcmp(origin, page->origin) == 0) {
+      j = add_page(url, origin, page->depth);
+      if (j != -1)
+        pages[j].redirect_target = true;
+    }
+    if (url)
+      free(origin);
   }
-  return 0;
+
+  find_links(i);
 }
 
 
 /**
- * UTC version of mktime, from
- *   http://lists.debian.org/deity/2002/deity-200204/msg00082.html
+ * Header callback for crawl fetches: keep the header lines of the final
+ * response, its status and any Location.
  */
-time_t mktime_from_utc(struct tm *t)
+size_t crawl_header_callback(char *ptr, size_t msize, size_t nmemb,
+    void *stream)
 {
-  time_t tl, tb;
-  struct tm *tg;
-
-  tl = mktime (t);
-  if (tl == -1)
-    {
-      t->tm_hour--;
-      tl = mktime (t);
-      if (tl == -1)
-        return -1; /* can't deal with output from strptime */
-      tl += 3600;
-    }
-  tg = gmtime (&tl);
-  tg->tm_isdst = 0;
-  tb = mktime (tg);
-  if (tb == -1)
-    {
-      tg->tm_hour--;
-      tb = mktime (tg);
-      if (tb == -1)
-        return -1; /* can't deal with output from gmtime */
-      tb += 3600;
-    }
-  return (tl - (tb - tl));
+  const size_t size = msize * nmemb;
+  struct page *page = &pages[(intptr_t) stream];
+  const char *space;
+
+  if (5 <= size && strncmp(ptr, "HTTP/", 5) == 0) {
+    /* a new response, after a 1xx */
+    page->headers_len = 0;
+    space = memchr(ptr, ' ', size);
+    page->status = space ? atoi(space + 1) : 0;
+  }
+  if (9 < size && strncasecmp(ptr, "Location:", 9) == 0 &&
+      !page->location && 300 <= page->status && page->status < 400) {
+    page->location = malloc(size + 1);
+    if (!page->location)
+      die("Out of memory");
+    memcpy(page->location, ptr, size);
+    page->location[size] = 0;
+    page->location[strcspn(page->location, "\r\n")] = 0;
+    memmove(page->location, httplint_skip_lws(page->location + 9),
+        strlen(httplint_skip_lws(page->location + 9)) + 1);
+  }
+  if (13 < size && strncasecmp(ptr, "Content-Type:", 13) == 0 &&
+      strncasecmp(httplint_skip_lws(ptr + 13), "text/html", 9) == 0)
+    page->html_body = true;
+
+  page->headers = realloc(page->headers, page->headers_len + size);
+  if (!page->headers)
+    die("Out of memory");
+  memcpy(page->headers + page->headers_len, ptr, size);
+  page->headers_len += size;
+  return size;
 }
 
 
 /**
- * Skip optional LWS (linear white space) [2.2]
+ * Body callback for crawl fetches: keep HTML bodies that links may be
+ * followed from, and abort any other.
  */
-const char *skip_lws(const char *s)
+size_t crawl_data_callback(void *ptr, size_t size, size_t nmemb,
+    void *stream)
 {
-  if (s[0] == 13 && s[1] == 10 && (s[2] == ' ' || s[2] == '\t'))
-    s += 2;
-  while (*s == ' ' || *s == '\t')
-    s++;
-  return s;
+  struct page *page = &pages[(intptr_t) stream];
+
+  size *= nmemb;
+  if (!page->html_body || crawl_depth <= page->depth ||
+      CRAWL_BODY_MAX < page->body_len + size)
+    return 0;
+  page->body = realloc(page->body, page->body_len + size);
+  if (!page->body)
+    die("Out of memory");
+  memcpy(page->body + page->body_len, ptr, size);
+  page->body_len += size;
+  return size;
 }
 
 
 /**
- * Parse a list of elements (#rule in [2.1]).
+ * Queue the same-origin href and src links of a page one level deeper,
+ * then drop its body.
  */
-bool parse_list(const char *s, regex_t *preg, unsigned int n, unsigned int m,
-    void (*callback)(const char *s, regmatch_t pmatch[]))
+void find_links(unsigned int i)
 {
-  int r;
-  unsigned int items = 0;
-  regmatch_t pmatch[20];
+  char *body, *p, *end, *value, *url, *origin, *amp;
+  unsigned int depth = pages[i].depth + 1;
+  size_t len;
 
-  do {
-    r = regexec(preg, s, 20, pmatch, 0);
-    if (r) {
-      if (html)
-        printf("<li class='error'>");
-      printf("    Failed to match list item %i\n", items + 1);
-      if (html)
-        printf("</li>\n");
-      return false;
+  if (!pages[i].body)
+    return;
+  body = realloc(pages[i].body, pages[i].body_len + 1);
+  if (!body)
+    die("Out of memory");
+  body[pages[i].body_len] = 0;
+  pages[i].body = 0;
+
+  for (p = body; (p = strpbrk(p, "hHsS")); p++) {
+    if (strncasecmp(p, "href", 4) == 0)
+      len = 4;
+    else if (strncasecmp(p, "src", 3) == 0)
+      len = 3;
+    else
+      continue;
+    /* an attribute name, not the middle of a word */
+    if (p == body || !strchr(" \t\r\n", p[-1]))
+      continue;
+    value = (char *) httplint_skip_lws(p + len);
+    if (*value != '=')
+      continue;
+    value = (char *) httplint_skip_lws(value + 1);
+    if (*value == '"' || *value == '\'') {
+      end = strchr(value + 1, *value);
+      value++;
+    } else {
+      end = value + strcspn(value, " \t\r\n>");
     }
-
-    if (callback)
-      callback(s, pmatch);
-    items++;
-
-    s += pmatch[0].rm_eo;
-    s = skip_lws(s);
-    if (*s == 0)
+    if (!end)
       break;
-    if (*s != ',') {
-      if (html)
-        printf("<li class='error'>");
-      printf("    Expecting , after list item %i\n", items);
-      if (html)
-        printf("</li>\n");
-      return false;
-    }
-    while (*s == ',')
-      s = skip_lws(s + 1);
-  } while (*s != 0);
 
-  if (items < n || m < items) {
-    if (html)
-      printf("<li class='error'>");
-    printf("    %i items in list, but there should be ", items);
-    if (m == UINT_MAX)
-      printf("at least %i\n", n);
-    else
-      printf("between %i and %i\n", n, m);
-    if (html)
-      printf("</li>\n");
-    return false;
+    len = end - value;
+    p = end;
+    value = malloc(len + 1);
+    if (!value)
+      die("Out of memory");
+    memcpy(value, end - len, len);
+    value[len] = 0;
+    while ((amp = strstr(value, "&amp;")))
+      memmove(amp + 1, amp + 5, strlen(amp + 5) + 1);
+
+    url = normalize_url(pages[i].url, value, &origin);
+    if (url) {
+      if (strcmp(origin, pages[i].origin) == 0)
+        add_page(url, origin, depth);
+      curl_free(url);
+      free(origin);
+    }
+    free(value);
   }
-
-  return true;
+  free(body);
 }
 
 
-/* Header-specific validation. */
-void header_accept_ranges(const char *s)
+/**
+ * Check a crawled page from its saved headers, as check_url would have.
+ */
+void check_page(unsigned int i)
 {
-  if (strcmp(s, "bytes") == 0)
-    lookup("ok");
-  else if (strcmp(s, "none") == 0)
-    lookup("ok");
-  else
-    lookup("unknownrange");
-}
+  struct page *page = &pages[i];
+  char *line, *end;
 
-void header_age(const char *s)
-{
-  if (s[0] == 0 || strspn(s, NUMBER) != strlen(s))
-    lookup("badage");
-  else
-    lookup("ok");
+  begin_check(page->url, cookies ? HTTPLINT_COOKIES : 0);
+  if (html)
+    printf("<ul>\n");
+  for (line = page->headers; line && line < page->headers + page->headers_len;
+      line = end) {
+    end = memchr(line, '\n', page->headers + page->headers_len - line);
+    end = end ? end + 1 : page->headers + page->headers_len;
+    header_callback(line, 1, end - line, 0);
+  }
+  if (html)
+    printf("</ul>\n");
+  end_check(page->url, page->error, false);
 }
 
-void header_allow(const char *s)
-{
-  if (parse_list(s, &re_token, 0, UINT_MAX, 0))
-    lookup("ok");
-  else
-    lookup("badallow");
-}
 
-void header_cache_control(const char *s)
+/**
+ * List each chain of redirects found by the crawl, from its first url to
+ * where it ends, with the time the extra fetches add.
+ */
+void print_redirect_chains(void)
 {
-  if (parse_list(s, &re_token_value, 1, UINT_MAX,
-      header_cache_control_callback))
-    lookup("ok");
-  else
-    lookup("badcachecont");
+  unsigned int i, hops, j;
+  struct page *page;
+  double added;
+  int k;
+  bool any = false;
+
+  for (i = 0; i != page_count; i++) {
+    page = &pages[i];
+    if (page->redirect_target || !page->location)
+      continue;
+
+    if (!any) {
+      printf(html ? "<h2>Redirect chains</h2>\n<ul>\n" :
+          "Redirect chains\n");
+      any = true;
+    }
+    printf(html ? "<li>" : "  ");
+    print(page->url, strlen(page->url));
+
+    /* follow the chain through the pages; stop at a loop */
+    added = 0;
+    hops = 0;
+    while (page->location && hops != page_count) {
+      added += page->total;
+      hops++;
+      printf(" -> ");
+      print(page->location, strlen(page->location));
+      for (k = -1, j = hash_url(page->location) & (seen_size - 1);
+          seen[j] != -1; j = (j + 1) & (seen_size - 1))
+        if (strcmp(pages[seen[j]].url, page->location) == 0) {
+          k = seen[j];
+          break;
+        }
+      if (k == -1) {
+        printf(" (not fetched)");
+        break;
+      }
+      page = &pages[k];
+    }
+    printf(": %u redirect%s adding %.2f ms", hops, hops == 1 ? "" : "s",
+        added);
+    printf(html ? "</li>\n" : "\n");
+  }
+  if (any)
+    printf(html ? "</ul>\n" : "\n");
 }
 
-char cache_control_list[][20] = {
-  "max-age", "max-stale", "min-fresh", "must-revalidate",
-  "no-cache", "no-store", "no-transform", "only-if-cached",
-  "private", "proxy-revalidate", "public", "s-maxage"
-};
 
-void header_cache_control_callback(const char *s, regmatch_t pmatch[])
+/**
+ * Read the timings and sizes of the last fetch from curl.
+ */
+bool get_timing(struct timing *t)
 {
-  size_t len = pmatch[1].rm_eo - pmatch[1].rm_so;
-  char name[20];
-  char *dir;
-
-  if (19 < len) {
-    lookup("unknowncachecont");
-    return;
-  }
-
-  strncpy(name, s + pmatch[1].rm_so, len);
-  name[len] = 0;
-
-  dir = bsearch(name, cache_control_list,
-      sizeof cache_control_list / sizeof cache_control_list[0],
-      sizeof cache_control_list[0],
-      (int (*)(const void *, const void *)) strcasecmp);
+  curl_off_t dns, connect, tls, first_byte, total;
+
+  if (curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME_T, &dns) ||
+      curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &connect) ||
+      curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &tls) ||
+      curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &first_byte) ||
+      curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total) ||
+      curl_easy_getinfo(curl, CURLINFO_HEADER_SIZE, &t->header_size) ||
+      curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &t->body_size))
+    return false;
 
-  if (!dir) {
-    if (html)
-      printf("<li class='warning'>");
-    printf("    Cache-Control directive '");
-    print(name, strlen(name));
-    printf("':\n");
-    if (html)
-      printf("</li>\n");
-    lookup("unknowncachecont");
-  }
+  /* curl's times are all from the start; a reused connection has no dns
+   * or connect phase, and a plain http one no tls phase */
+  t->dns = dns / 1000.0;
+  t->connect = connect < dns ? 0 : (connect - dns) / 1000.0;
+  t->tls = tls < connect ? 0 : (tls - connect) / 1000.0;
+  t->first_byte = first_byte / 1000.0;
+  t->total = total / 1000.0;
+  return true;
 }
 
-void header_connection(const char *s)
-{
-  if (strcmp(s, "close") == 0)
-    lookup("ok");
-  else
-    lookup("badconnection");
-}
 
-void header_content_encoding(const char *s)
+/**
+ * Print the timing of the fetch just checked, then repeat it if asked.
+ */
+void print_timing(const char *url)
 {
-  if (parse_list(s, &re_token, 1, UINT_MAX,
-      header_content_encoding_callback))
-    lookup("ok");
-  else
-    lookup("badcontenc");
-}
-
-char content_coding_list[][20] = {
-  "compress", "deflate", "gzip", "identity"
-};
+  struct timing t;
+  double *samples;
+  unsigned int i, n = 0, failed = 0;
+  CURLcode code;
 
-void header_content_encoding_callback(const char *s, regmatch_t pmatch[])
-{
-  size_t len = pmatch[1].rm_eo - pmatch[1].rm_so;
-  char name[20];
-  char *dir;
+  if (!get_timing(&t))
+    return;
+  if (html)
+    printf("<li>");
+  printf("    Timing: dns %.2f ms, connect %.2f ms, tls %.2f ms, first byte "
+      "%.2f ms, total %.2f ms; headers %li bytes, body %lli bytes.\n",
+      t.dns, t.connect, t.tls, t.first_byte, t.total, t.header_size,
+      (long long) t.body_size);
+  if (html)
+    printf("</li>\n");
+  printf("\n");
 
-  if (19 < len) {
-    lookup("unknowncontenc");
+  if (repeat == 0)
     return;
+
+  samples = malloc(5 * repeat * sizeof *samples);
+  if (!samples)
+    die("Out of memory");
+  if (curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, quiet_header_callback) ||
+      curl_easy_setopt(curl, CURLOPT_FRESH_CONNECT, fresh ? 1L : 0L) ||
+      curl_easy_setopt(curl, CURLOPT_FORBID_REUSE, fresh ? 1L : 0L))
+    die("Failed to set curl options");
+
+  for (i = 0; i != repeat; i++) {
+    code = curl_easy_perform(curl);
+    if (code != CURLE_OK || !get_timing(&t)) {
+      failed++;
+      continue;
+    }
+    samples[n] = t.dns;
+    samples[repeat + n] = t.connect;
+    samples[2 * repeat + n] = t.tls;
+    samples[3 * repeat + n] = t.first_byte;
+    samples[4 * repeat + n] = t.total;
+    n++;
   }
 
-  strncpy(name, s + pmatch[1].rm_so, len);
-  name[len] = 0;
+  if (curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_callback) ||
+      curl_easy_setopt(curl, CURLOPT_FRESH_CONNECT, 0L) ||
+      curl_easy_setopt(curl, CURLOPT_FORBID_REUSE, 0L) ||
+      curl_easy_setopt(curl, CURLOPT_URL, url))
+    die("Failed to set curl options");
 
-  dir = bsearch(name, content_coding_list,
-      sizeof content_coding_list / sizeof content_coding_list[0],
-      sizeof content_coding_list[0],
-      (int (*)(const void *, const void *)) strcasecmp);
-  if (!dir) {
-    if (html)
-      printf("<li class='warning'>");
-    printf("    Content-Encoding '%s':\n", name);
-    if (html)
-      printf("</li>\n");
-    lookup("unknowncontenc");
+  if (html)
+    printf("<li><pre>");
+  printf("    Timing of %u more fetches on %s (%u failed):\n", n,
+      fresh ? "new connections" : "a reused connection", failed);
+  printf("      %-10s %8s    %8s    %8s\n", "", "min", "median", "p95");
+  if (n) {
+    print_percentiles("dns", samples, n);
+    print_percentiles("connect", samples + repeat, n);
+    print_percentiles("tls", samples + 2 * repeat, n);
+    print_percentiles("first byte", samples + 3 * repeat, n);
+    print_percentiles("total", samples + 4 * repeat, n);
   }
+  if (html)
+    printf("</pre></li>\n");
+  printf("\n");
+  free(samples);
 }
 
-void header_content_language(const char *s)
-{
-  if (parse_list(s, &re_token, 1, UINT_MAX, 0))
-    lookup("ok");
-  else
-    lookup("badcontlang");
-}
 
-void header_content_length(const char *s)
+/**
+ * Header callback for repeated fetches, which are not checked.
+ */
+size_t quiet_header_callback(char *ptr, size_t msize, size_t nmemb,
+    void *stream)
 {
-  if (s[0] == 0 || strspn(s, NUMBER) != strlen(s))
-    lookup("badcontlen");
-  else
-    lookup("ok");
+  UNUSED(ptr);
+  UNUSED(stream);
+  return msize * nmemb;
 }
 
-void header_content_location(const char *s)
-{
-  if (strchr(s, ' '))
-    lookup("badcontloc");
-  else
-    lookup("ok");
-}
 
-void header_content_md5(const char *s)
+int double_compare(const void *a, const void *b)
 {
-  if (strlen(s) != 24)
-    lookup("badcontmd5");
-  else
-    lookup("ok");
+  const double *x = a, *y = b;
+  return *x < *y ? -1 : *y < *x;
 }
 
-void header_content_range(const char *s)
+
+/**
+ * Print the min, median and 95th percentile (nearest rank) of N samples,
+ * sorting them in place.
+ */
+void print_percentiles(const char *phase, double *samples, unsigned int n)
 {
-  UNUSED(s);
-  lookup("contentrange");
+  qsort(samples, n, sizeof *samples, double_compare);
+  printf("      %-10s %8.2f ms %8.2f ms %8.2f ms\n", phase, samples[0],
+      samples[(n - 1) / 2], samples[(95 * n + 99) / 100 - 1]);
 }
 
-void header_content_type(const char *s)
-{
-  bool charset = false;
-  char *type, *subtype;
-  unsigned int i;
-  int r;
-  regmatch_t pmatch[30];
 
-  r = regexec(&re_content_type, s, 30, pmatch, 0);
-  if (r) {
-    lookup("badcontenttype");
+/**
+ * Score how cacheable the response just checked is, confirm that its
+ * validators work, and keep the result for the summary.
+ */
+void audit_cache(const char *url)
+{
+  const struct httplint_cache *cache = httplint_cache_info(lint);
+  const int status_code = httplint_status(lint);
+  struct cache_result *result;
+  long lifetime;
+  int score;
+  bool revalidated = false;
+
+  if (status_code < 200 || 300 <= status_code) {
+    if (html)
+      printf("<li>");
+    printf("    Cache audit: skipped, the response was not successful.\n");
+    if (html)
+      printf("</li>\n");
     return;
   }
 
-  type = strndup(s + pmatch[1].rm_so, pmatch[1].rm_eo - pmatch[1].rm_so);
-  subtype = strndup(s + pmatch[2].rm_so, pmatch[2].rm_eo - pmatch[2].rm_so);
-
-  /* parameters */
-  for (i = 3; i != 30 && pmatch[i].rm_so != -1; i += 3) {
-    char *attrib, *value;
-
-    attrib = strndup(s + pmatch[i + 1].rm_so,
-        pmatch[i + 1].rm_eo - pmatch[i + 1].rm_so);
-    value = strndup(s + pmatch[i + 2].rm_so,
-        pmatch[i + 2].rm_eo - pmatch[i + 2].rm_so);
-
-    if (strcasecmp(attrib, "charset") == 0)
-      charset = true;
-  }
+  lifetime = httplint_freshness_lifetime(lint);
+  if (!cache->no_store && (cache->etag[0] || cache->last_modified[0]))
+    revalidated = revalidate(url, cache);
+  score = httplint_cache_score(lint, revalidated);
 
-  if (strcasecmp(type, "text") == 0 && !charset)
-    lookup("nocharset");
+  if (html)
+    printf("<li>");
+  printf("    Cache audit: score %i/100, freshness lifetime ", score);
+  if (lifetime < 0)
+    printf("none");
   else
-    lookup("ok");
+    printf("%lis", lifetime);
+  printf(", %s.\n", revalidated ? "revalidates with 304" : "no 304");
+  if (html)
+    printf("</li>\n");
+  printf("\n");
+
+  cache_results = realloc(cache_results,
+      (cache_result_count + 1) * sizeof *cache_results);
+  if (!cache_results)
+    die("Out of memory");
+  result = &cache_results[cache_result_count++];
+  result->url = strdup(url);
+  result->score = score;
+  result->lifetime = lifetime;
+  result->etag = cache->etag[0] != 0;
+  result->last_modified = cache->last_modified[0] != 0;
+  result->revalidated = revalidated;
 }
 
-void header_date(const char *s)
+
+/**
+ * Fetch the url again with its validators as conditions, returning true
+ * if the server answers 304 Not Modified [14.26, 14.25].
+ */
+bool revalidate(const char *url, const struct httplint_cache *cache)
 {
-  double diff;
-  time_t time0, time1;
-  struct tm tm;
+  struct curl_slist *conditions = 0, *item;
+  char header[300];
+  int code = 0;
+
+  for (item = request_headers; item; item = item->next)
+    conditions = curl_slist_append(conditions, item->data);
+  if (cache->etag[0]) {
+    snprintf(header, sizeof header, "If-None-Match: %s", cache->etag);
+    conditions = curl_slist_append(conditions, header);
+  }
+  if (cache->last_modified[0]) {
+    snprintf(header, sizeof header, "If-Modified-Since: %s",
+        cache->last_modified);
+    conditions = curl_slist_append(conditions, header);
+  }
 
-  time0 = time(0);
-  if (!parse_date(s, &tm))
-    return;
-  time1 = mktime_from_utc(&tm);
+  if (curl_easy_setopt(curl, CURLOPT_URL, url) ||
+      curl_easy_setopt(curl, CURLOPT_HTTPHEADER, conditions) ||
+      curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION,
+      revalidate_header_callback) ||
+      curl_easy_setopt(curl, CURLOPT_HEADERDATA, &code))
+    die("Failed to set curl options");
 
-  diff = difftime(time0, time1);
-  if (10 < fabs(diff))
-    lookup("wrongdate");
-  else
-    lookup("ok");
-}
+  curl_easy_perform(curl);
 
-void header_etag(const char *s)
-{
-  int r;
-  r = regexec(&re_etag, s, 0, 0, 0);
-  if (r)
-    lookup("badetag");
-  else
-    lookup("ok");
-}
+  if (curl_easy_setopt(curl, CURLOPT_HTTPHEADER, request_headers) ||
+      curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_callback) ||
+      curl_easy_setopt(curl, CURLOPT_HEADERDATA, (void *) NULL))
+    die("Failed to set curl options");
+  curl_slist_free_all(conditions);
 
-void header_expires(const char *s)
-{
-  struct tm tm;
-  if (parse_date(s, &tm))
-    lookup("ok");
+  return code == 304;
 }
 
-void header_last_modified(const char *s)
-{
-  double diff;
-  time_t time0, time1;
-  struct tm tm;
 
-  time0 = time(0);
-  if (!parse_date(s, &tm))
-    return;
-  time1 = mktime_from_utc(&tm);
+/**
+ * Header callback for revalidate(): note the status code and stop at the
+ * end of the headers.
+ */
+size_t revalidate_header_callback(char *ptr, size_t msize, size_t nmemb,
+    void *stream)
+{
+  const size_t size = msize * nmemb;
+  int *code = stream;
+  const char *space;
 
-  diff = difftime(time1, time0);
-  if (10 < diff)
-    lookup("futurelastmod");
-  else
-    lookup("ok");
+  if (*code == 0 && strncmp(ptr, "HTTP/", 5 < size ? 5 : size) == 0) {
+    space = memchr(ptr, ' ', size);
+    if (space)
+      *code = atoi(space + 1);
+  }
+  if (size <= 2)
+    return 0;
+  return size;
 }
 
-void header_location(const char *s)
-{
-  int r;
-  r = regexec(&re_absolute_uri, s, 0, 0, 0);
-  if (r)
-    lookup("badlocation");
-  else
-    lookup("ok");
-}
 
-void header_pragma(const char *s)
+int cache_result_compare(const void *a, const void *b)
 {
-  if (parse_list(s, &re_token_value, 1, UINT_MAX, 0))
-    lookup("ok");
-  else
-    lookup("badpragma");
+  const struct cache_result *x = a, *y = b;
+  return x->score - y->score;
 }
 
-void header_retry_after(const char *s)
-{
-  struct tm tm;
 
-  if (s[0] != 0 && strspn(s, NUMBER) == strlen(s)) {
-    lookup("ok");
-    return;
-  }
+/**
+ * Print the cache audit results of every url, least cacheable first.
+ */
+void print_cache_summary(void)
+{
+  unsigned int i, total = 0, uncacheable = 0, no_304 = 0;
+  char lifetime[24], validators[16];
+  struct cache_result *r;
 
-  if (!parse_date(s, &tm))
+  if (cache_result_count == 0)
     return;
+  qsort(cache_results, cache_result_count, sizeof *cache_results,
+      cache_result_compare);
 
-  lookup("ok");
-}
-
-void header_server(const char *s)
-{
-  int r;
-  r = regexec(&re_server, s, 0, 0, 0);
-  if (r)
-    lookup("badserver");
+  if (html)
+    printf("<h2>Cache audit</h2>\n<table>\n<tr><th>Score</th>"
+        "<th>Lifetime</th><th>Validators</th><th>URL</th></tr>\n");
   else
-    lookup("ok");
-}
+    printf("Cache audit, least cacheable first\n"
+        "score  lifetime  validators  url\n");
+
+  for (i = 0; i != cache_result_count; i++) {
+    r = &cache_results[i];
+    total += r->score;
+    if (r->lifetime <= 0)
+      uncacheable++;
+    if ((r->etag || r->last_modified) && !r->revalidated)
+      no_304++;
+
+    if (r->lifetime < 0)
+      strcpy(lifetime, "-");
+    else
+      snprintf(lifetime, sizeof lifetime, "%lis", r->lifetime);
+    snprintf(validators, sizeof validators, "%s%s%s",
+        r->etag ? "E" : "", r->last_modified ? "L" : "",
+        !r->etag && !r->last_modified ? "none" :
+        r->revalidated ? " 304" : " no 304");
 
-void header_trailer(const char *s)
-{
-  if (parse_list(s, &re_token, 1, UINT_MAX, 0))
-    lookup("ok");
-  else
-    lookup("badtrailer");
-}
+    if (html)
+      printf("<tr><td>%i</td><td>%s</td><td>%s</td><td>", r->score,
+          lifetime, validators);
+    else
+      printf("%5i  %8s  %-10s  ", r->score, lifetime, validators);
+    print(r->url, strlen(r->url));
+    printf(html ? "</td></tr>\n" : "\n");
+  }
 
-void header_transfer_encoding(const char *s)
-{
-  if (parse_list(s, &re_transfer_coding, 1, UINT_MAX,
-      header_transfer_encoding_callback))
-    lookup("ok");
-  else
-    lookup("badtransenc");
+  if (html)
+    printf("</table>\n<p>");
+  printf("%u urls, mean score %u, %u never fresh, %u with validators "
+      "that do not give 304", cache_result_count, total / cache_result_count,
+      uncacheable, no_304);
+  if (html)
+    printf("</p>");
+  printf("\n");
 }
 
-char transfer_coding_list[][20] = {
-  "chunked", "compress", "deflate", "gzip", "identity"
-};
 
-void header_transfer_encoding_callback(const char *s, regmatch_t pmatch[])
+/**
+ * Print the cookies held for each site by --cookies: how many, the Cookie
+ * header that every request carries (those for path /), and the largest
+ * that any request carries.
+ */
+void print_cookie_summary(void)
 {
-  size_t len = pmatch[1].rm_eo - pmatch[1].rm_so;
-  char name[20];
-  char *dir;
+  unsigned int i;
+  struct httplint_site site;
 
-  if (19 < len) {
-    lookup("unknowntransenc");
+  if (!httplint_cookie_site(lint, 0, &site))
     return;
-  }
 
-  strncpy(name, s + pmatch[1].rm_so, len);
-  name[len] = 0;
+  if (html)
+    printf("<h2>Cookies</h2>\n<table>\n<tr><th>Cookies</th>"
+        "<th>Every request</th><th>Largest</th><th>Site</th></tr>\n");
+  else
+    printf("Cookies held per site, in bytes of Cookie header\n"
+        "cookies  every request  largest  site\n");
 
-  dir = bsearch(name, transfer_coding_list,
-      sizeof transfer_coding_list / sizeof transfer_coding_list[0],
-      sizeof transfer_coding_list[0],
-      (int (*)(const void *, const void *)) strcasecmp);
-  if (!dir) {
+  for (i = 0; httplint_cookie_site(lint, i, &site); i++) {
     if (html)
-      printf("<li class='warning'>");
-    printf("    Transfer-Encoding '%s':\n", name);
-    if (html)
-      printf("</li>\n");
-    lookup("unknowntransenc");
+      printf("<tr><td>%u</td><td>%zu</td><td>%zu</td><td>", site.cookies,
+          site.bytes, site.max_bytes);
+    else
+      printf("%7u  %13zu  %7zu  ", site.cookies, site.bytes, site.max_bytes);
+    print(site.name, strlen(site.name));
+    printf(html ? "</td></tr>\n" : "\n");
   }
-}
 
-void header_upgrade(const char *s)
-{
-  int r;
-  r = regexec(&re_upgrade, s, 0, 0, 0);
-  if (r)
-    lookup("badupgrade");
-  else
-    lookup("ok");
+  if (html)
+    printf("</table>\n");
 }
 
-void header_vary(const char *s)
-{
-  if (strcmp(s, "*") == 0 || parse_list(s, &re_token, 1, UINT_MAX, 0))
-    lookup("ok");
-  else
-    lookup("badvary");
-}
 
-void header_via(const char *s)
+/**
+ * Callback for received header data.
+ */
+size_t header_callback(char *ptr, size_t msize, size_t nmemb, void *stream)
 {
-  UNUSED(s);
-  lookup("via");
-}
+  const size_t size = msize * nmemb;
+  bool more;
 
-/* http://wp.netscape.com/newsref/std/cookie_spec.html */
-void header_set_cookie(const char *s)
-{
-  bool ok = true;
-  int r;
-  const char *semi = strchr(s, ';');
-  const char *s2;
-  struct tm tm;
-  double diff;
-  time_t time0, time1;
-  regmatch_t pmatch[20];
-
-  if (semi)
-    s2 = strndup(s, semi - s);
-  else
-    s2 = s;
+  UNUSED(stream);
 
-  r = regexec(&re_cookie_nameval, s2, 0, 0, 0);
-  if (r) {
-    lookup("cookiebadnameval");
-    ok = false;
-  }
+  printf(html ? "<li><code>" : "* ");
+  print(ptr, size);
+  printf(html ? "</code><ul>" : "\n");
 
-  if (!semi)
-    return;
+  more = httplint_header_line(lint, ptr, size);
 
-  s = skip_lws(semi + 1);
+  if (html)
+    printf("</ul></li>\n");
 
-  while (*s) {
-    semi = strchr(s, ';');
-    if (semi)
-      s2 = strndup(s, semi - s);
-    else
-      s2 = s;
-
-    if (strncasecmp(s2, "expires=", 8) == 0) {
-      s2 += 8;
-      r = regexec(&re_cookie_expires, s2, 20, pmatch, 0);
-      if (r == 0) {
-        tm.tm_mday = atoi(s2 + pmatch[2].rm_so);
-        tm.tm_mon = month(s2 + pmatch[3].rm_so);
-        tm.tm_year = atoi(s2 + pmatch[4].rm_so) - 1900;
-        tm.tm_hour = atoi(s2 + pmatch[5].rm_so);
-        tm.tm_min = atoi(s2 + pmatch[6].rm_so);
-        tm.tm_sec = atoi(s2 + pmatch[7].rm_so);
-
-        time0 = time(0);
-        time1 = mktime_from_utc(&tm);
-
-        diff = difftime(time0, time1);
-        if (10 < diff) {
-          lookup("cookiepastdate");
-          ok = false;
-        }
-      } else {
-        lookup("cookiebaddate");
-        ok = false;
-      }
-    } else if (strncasecmp(s2, "domain=", 7) == 0) {
-    } else if (strncasecmp(s2, "path=", 5) == 0) {
-      if (s2[5] != '/') {
-        lookup("cookiebadpath");
-        ok = false;
-      }
-    } else if (strcasecmp(s, "secure") == 0) {
-    } else {
-      if (html)
-        printf("<li class='warning'>");
-      printf("    Set-Cookie field '%s':\n", s2);
-      if (html)
-        printf("</li>\n");
-      lookup("cookieunknownfield");
-      ok = false;
-    }
+  /* past the end of the headers, carry on to the body only when it is
+   * being timed or checked */
+  if (!more && !timing && !body_active)
+    return 0;
+  return size;
+}
 
-    if (semi)
-      s = skip_lws(semi + 1);
-    else
-      break;
-  }
 
-  if (ok)
-    lookup("ok");
+/**
+ * Callback for received body data.
+ *
+ * We are not interested in the body, so abort the fetch by returning 0,
+ * unless it is being timed, in which case it is read and dropped, or
+ * checked.
+ */
+size_t data_callback(void *ptr, size_t size, size_t nmemb, void *stream)
+{
+  UNUSED(stream);
+
+  if (body_active)
+    httplint_body(lint, ptr, size * nmemb);
+  return timing || body_active ? size * nmemb : 0;
 }
 
 
@@ -1141,144 +1315,50 @@ void print(const char *s, size_t len)
 }
 
 
-struct message_entry {
-  const char key[20];
-  const char *value;
-} message_table[] = {
-  { "1xx", "A response status code in the range 100 - 199 indicates a "
-           "'provisional response'." },
-  { "2xx", "A response status code in the range 200 - 299 indicates that "
-           "the request was successful." },
-  { "3xx", "A response status code in the range 300 - 399 indicates that "
-           "the client should redirect to a new URL." },
-  { "4xx", "A response status code in the range 400 - 499 indicates that "
-           "the request could not be fulfilled due to client error." },
-  { "5xx", "A response status code in the range 500 - 599 indicates that "
-           "an error occurred on the server." },
-  { "asctime", "Warning: This date is in the obsolete asctime() format. "
-               "Consider using the RFC 1123 format instead." },
-  { "badage", "Error: The Age header must be one number." },
-  { "badallow", "Error: The Allow header must be a comma-separated list of "
-                "HTTP methods." },
-  { "badcachecont", "Error: The Cache-Control header must be a "
-                    "comma-separated list of directives." },
-  { "badconnection", "Warning: The only value of the Connection header "
-                     "defined by HTTP/1.1 is \"close\"." },
-  { "badcontenc", "Error: The Content-Encoding header must be a "
-                  "comma-separated list of encodings." },
-  { "badcontenttype", "Error: The Content-Type header must be of the form "
-                      "'type/subtype (; optional parameters)'." },
-  { "badcontlang", "Error: The Content-Language header must be a "
-                   "comma-separated list of language tags." },
-  { "badcontlen", "Error: The Content-Length header must be a number." },
-  { "badcontloc", "Error: The Content-Location header must be an absolute "
-                  "or relative URI." },
-  { "badcontmd5", "Error: The Content-MD5 header must be a base64 encoded "
-                  "MD5 sum." },
-  { "baddate", "Error: Failed to parse this date. Dates should be in the RFC "
-               "1123 format." },
-  { "badetag", "Error: The ETag header must be a quoted string (optionally "
-               "preceded by \"W/\" for a weak tag)." },
-  { "badlocation", "Error: The Location header must be an absolute URI. "
-                   "Relative URIs are not permitted." },
-  { "badpragma", "Error: The Pragma header must be a comma-separated list of "
-                 "directives." },
-  { "badserver", "Error: The Server header must be a space-separated list of "
-                 "products of the form Name/optional-version and comments "
-                 "in ()." },
-  { "badstatus", "Warning: The response status code is outside the standard "
-                 "range 100 - 599." },
-  { "badstatusline", "Error: Failed to parse the response Status-Line. The "
-                     "status line must be of the form 'HTTP/n.n <3-digit "
-                     "status> <reason phrase>'." },
-  { "badtrailer", "Error: The Trailer header must be a comma-separated list "
-                  "of header names." },
-  { "badtransenc", "Error: The Transfer-Encoding header must be a "
-                   "comma-separated of encodings." },
-  { "badupgrade", "Error: The Upgrade header must be a comma-separated list "
-                  "of product identifiers." },
-  { "badvary", "Error: The Vary header must be a comma-separated list "
-                  "of header names, or \"*\"." },
-  { "contentrange", "Warning: The Content-Range header should not be returned "
-                    "by the server for this request." },
-  { "cookiebaddate", "Error: The expires date must be in the form "
-                     "\"Wdy, DD-Mon-YYYY HH:MM:SS GMT\"." },
-  { "cookiebadnameval", "Error: A Set-Cookie header must start with "
-                        "name=value, each excluding semi-colon, comma and "
-                        "white space." },
-  { "cookiebadpath", "Error: The path does not start with \"/\"." },
-  { "cookiepastdate", "Warning: The expires date is in the past. The cookie "
-                      "will be deleted by browsers." },
-  { "cookieunknownfield", "Warning: This is not a standard Set-Cookie "
-                          "field." },
-  { "endofheaders", "End of headers." },
-  { "futurehttp", "Warning: I only understand HTTP/1.1. Check for a newer "
-                  "version of this tool." },
-  { "futurelastmod", "Error: The specified Last-Modified date-time is in "
-                     "the future." },
-  { "headertoolong", "Warning: Header too long: ignored." },
-  { "missingcolon", "Error: Headers must be of the form 'Name: value'." },
-  { "missingcontenttype", "Warning: No Content-Type header was present. The "
-                          "client will have to guess the media type or ask "
-                          "the user. Adding a Content-Type header is strongly "
-                          "recommended." },
-  { "missingcontlang", "Consider adding a Content-Language header if "
-                       "applicable for this document." },
-  { "missingdate", "Warning: No Date header was present. A Date header must "
-                   "be present, unless the server does not have a clock, or "
-                   "the response is 100, 101, or 500 - 599." },
-  { "missinglastmod", "No Last-Modified header was present. The "
-                      "HTTP/1.1 specification states that this header should "
-                      "be sent whenever feasible." },
-  { "nocharset", "Warning: No character set is specified in the Content-Type. "
-                 "Clients may assume the default of ISO-8859-1. Consider "
-                 "appending '; charset=...'." },
-  { "nonstandard", "Warning: I don't know anything about this header. Is it "
-                   "a standard HTTP response header?" },
-  { "notcrlf", "Error: This header line does not end in CR LF. HTTP requires "
-               "that all header lines end with CR LF." },
-  { "ok", "OK." },
-  { "oldhttp", "Warning: This version of HTTP is obsolete. Consider upgrading "
-               "to HTTP/1.1." },
-  { "rfc1036", "Warning: This date is in the obsolete RFC 1036 format. "
-               "Consider using the RFC 1123 format instead." },
-  { "ugly", "This URL appears to contain implementation-specific parts such "
-            "as an extension or a query string. This may make the URL liable "
-            "to change when the implementation is changed, resulting in "
-            "broken links. Consider using URL rewriting or equivalent to "
-            "implement a future-proof URL space. See "
-            "http://www.w3.org/Provider/Style/URI for more information." },
-  { "unknowncachecont", "Warning: This Cache-Control directive is "
-                        "non-standard and will have limited support." },
-  { "unknowncontenc", "Warning: This is not a standard Content-Encoding." },
-  { "unknownrange", "Warning: This range unit is not a standard HTTP/1.1 "
-                    "range." },
-  { "unknowntransenc", "Warning: This is not a standard Transfer-Encoding." },
-  { "via", "This header was added by a proxy, cache or gateway." },
-  { "wrongdate", "Warning: The server date-time differs from this system's "
-                 "date-time by more than 10 seconds. Check that both the "
-                 "system clocks are correct." },
-  { "xheader", "This is an extension header. I don't know how to check it." }
-};
+/**
+ * Sink for what the checker finds: print a message, or the detail line
+ * that goes with the next one.
+ */
+void report(void *arg, enum httplint_level level, const char *key,
+    const char *message)
+{
+  static const char *const class[] = {
+    [HTTPLINT_NOTE] = "", [HTTPLINT_OK] = " class='ok'",
+    [HTTPLINT_WARNING] = " class='warning'", [HTTPLINT_ERROR] = " class='error'"
+  };
+
+  UNUSED(arg);
+
+  if (level == HTTPLINT_ERROR)
+    errors++;
+  else if (level == HTTPLINT_WARNING)
+    warnings++;
+
+  if (key) {
+    print_message(message);
+    return;
+  }
+
+  if (html)
+    printf("<li%s>", class[level]);
+  printf("    ");
+  print(message, strlen(message));
+  printf("\n");
+  if (html)
+    printf("</li>\n");
+  /* a note stands on its own, like a message */
+  if (level == HTTPLINT_NOTE)
+    printf("\n");
+}
 
 
 /**
- * Look up and output the string referenced by a key.
+ * Output a message, wrapped to the terminal or marked up.
  */
-void lookup(const char *key)
+void print_message(const char *s)
 {
-  const char *s, *spc;
+  const char *spc;
   int x;
-  struct message_entry *message;
-
-  message = bsearch(key, message_table,
-      sizeof message_table / sizeof message_table[0],
-      sizeof message_table[0],
-      (int (*)(const void *, const void *)) strcasecmp);
-  if (message)
-    s = message->value;
-  else
-    s = key;
 
   if (html) {
     if (strncmp(s, "Warning:", 8) == 0)
@@ -0,0 +1,86 @@
+/*
+ * HTTP Header Lint library
+ * Licensed under the MIT License
+ *                http://www.opensource.org/licenses/mit-license
+ * Copyright 2004 James Bursa <bursa@users.sourceforge.net>
+ */
+
+/*
+ * The checks of httplint, without the fetching or the output, for use by
+ * anything that has an HTTP response to check.
+ *
+ * A checker is fed one response at a time: httplint_begin(), then the
+ * header lines, then optionally the body, then httplint_end(). Every
+ * finding is passed to the sink given to httplint_new(), with the key of
+ * the message (0 for the detail lines that go with the next message), its
+ * level and its text.
+ *
+ * Each checker keeps all its state to itself, so a program can run one
+ * per thread. The only shared state is the compiled rules, which
+ * httplint_init() must set up before the first checker is created and
+ * which are only read after that.
+ */
+
+#ifndef HTTPLINT_H
+#define HTTPLINT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+/* also read and check the body passed to httplint_body() */
+#define HTTPLINT_BODY 1
+/* keep the cookies each site sets and check what they cost its requests */
+#define HTTPLINT_COOKIES 2
+
+enum httplint_level {
+  HTTPLINT_NOTE,
+  HTTPLINT_OK,
+  HTTPLINT_WARNING,
+  HTTPLINT_ERROR
+};
+
+typedef void (*httplint_sink)(void *arg, enum httplint_level level,
+    const char *key, const char *message);
+
+/* what the caching headers of the response say [13, 14.9] */
+struct httplint_cache {
+  bool no_store, no_cache, private, public;
+  long max_age, s_maxage;       /* -1 if absent */
+  bool has_date, has_expires;
+  time_t date, expires;         /* an invalid Expires is 0, ie. expired */
+  char etag[200];
+  char last_modified[64];
+  bool vary_star;
+  int vary_count, vary_explosive;
+  bool set_cookie;
+};
+
+/* the cookies held for a site with HTTPLINT_COOKIES; bytes is the Cookie
+ * header that every request to the site carries, max_bytes the largest */
+struct httplint_site {
+  const char *name;
+  unsigned int cookies;
+  size_t bytes, max_bytes;
+};
+
+struct httplint;
+
+bool httplint_init(void);
+struct httplint *httplint_new(httplint_sink sink, void *arg);
+void httplint_free(struct httplint *h);
+void httplint_begin(struct httplint *h, unsigned int options);
+bool httplint_header_line(struct httplint *h, const char *line, size_t len);
+void httplint_status_line(struct httplint *h, const char *s);
+void httplint_header(struct httplint *h, const char *name, const char *value);
+void httplint_body(struct httplint *h, const void *p, size_t n);
+void httplint_end(struct httplint *h, const char *url, bool body_incomplete);
+int httplint_status(const struct httplint *h);
+const struct httplint_cache *httplint_cache_info(const struct httplint *h);
+long httplint_freshness_lifetime(const struct httplint *h);
+int httplint_cache_score(struct httplint *h, bool revalidated);
+bool httplint_cookie_site(const struct httplint *h, unsigned int i,
+    struct httplint_site *site);
+const char *httplint_skip_lws(const char *s);
+
+#endif
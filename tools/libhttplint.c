@@ -0,0 +1,2104 @@
+/*
+ * HTTP Header Lint library
+ * Licensed under the MIT License
+ *                http://www.opensource.org/licenses/mit-license
+ * Copyright 2004 James Bursa <bursa@users.sourceforge.net>
+ */
+
+/*
+ * Compile together with the program that uses it, and link with -lm -lz:
+ *   gcc -W -Wall -o httplint httplint.c libhttplint.c ... -lm -lz
+ *
+ * See httplint.h for the interface.
+ *
+ * References of the form [6.1.1] are to RFC 2616 (HTTP/1.1).
+ */
+
+#define _GNU_SOURCE
+#define __USE_XOPEN
+
+#include <ctype.h>
+#include <limits.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <regex.h>
+#include <zlib.h>
+#include "httplint.h"
+
+
+#define NUMBER "0123456789"
+#define COOKIE_MAX 32           /* Set-Cookies kept from one response */
+#define REQUEST_BASE 600        /* a browser request without its cookies */
+#define PACKET 1460             /* TCP payload of a 1500 byte MTU packet */
+#define UNUSED(x) x = x
+
+
+/* MD5 [RFC 1321], for Content-MD5 */
+struct md5 {
+  uint32_t h[4];
+  uint64_t len;
+  unsigned char buf[64];
+  size_t used;
+};
+
+/* the dates most recently parsed by a checker, by their text: the same
+ * Date, Expires and Last-Modified values come up again and again */
+#define DATE_CACHE_SIZE 64      /* a power of 2 */
+#define DATE_CACHE_TEXT 32      /* longer strings are not dates anyway */
+
+enum date_kind {
+  DATE_BAD, DATE_RFC1123, DATE_RFC1036, DATE_ASCTIME, DATE_COOKIE
+};
+
+struct date_entry {
+  char text[DATE_CACHE_TEXT];
+  bool cookie;                  /* parsed as a cookie expiry date */
+  enum date_kind kind;
+  time_t t;
+};
+
+/* a cookie from a Set-Cookie of the response; size is what it adds to a
+ * Cookie header, name=value */
+struct set_cookie {
+  char name[64];
+  char path[128];               /* empty for the default path */
+  char domain[128];
+  size_t size;
+  bool removed;                 /* expired, or Max-Age 0 */
+};
+
+/* a cookie held for a site, as a browser would, by --cookies */
+struct jar_cookie {
+  unsigned int site;            /* index into sites */
+  char name[64];
+  char path[128];
+  char domain[128];
+  size_t size;
+};
+
+/* what the body of the response is said to be, and what it is */
+struct body_info {
+  bool active;                  /* the body is being checked */
+  long long content_length;     /* -1 if absent */
+  char content_md5[32];
+  char encoding[20];
+  long long received;
+  struct md5 md5;
+  z_stream z;
+  enum { BODY_AS_IS, BODY_INFLATE, BODY_DEFLATE } z_kind;
+  bool z_ended, z_error;
+  long long coded;              /* the other side of the (de)compressor */
+  bool incomplete;
+};
+
+
+static void body_reset(struct httplint *h);
+static void body_code(struct httplint *h, int flush);
+static void check_body(struct httplint *h);
+static void md5_init(struct md5 *c);
+static void md5_update(struct md5 *c, const void *data, size_t n);
+static void md5_final(struct md5 *c, unsigned char *digest);
+static void md5_block(struct md5 *c, const unsigned char *p);
+static void base64(const unsigned char *p, size_t n, char *out);
+static bool parse_date(struct httplint *h, const char *s, time_t *t);
+static enum date_kind date_lookup(struct httplint *h, const char *s,
+    bool cookie, time_t *t);
+static enum date_kind scan_date(const char *s, time_t *t);
+static enum date_kind scan_cookie_date(const char *s, time_t *t);
+static bool scan_rfc1123(const char *s, struct tm *tm);
+static int scan_digits(const char *s, unsigned int n, char max);
+static int month(const char *s);
+static time_t mktime_from_utc(struct tm *t);
+static const char *skip_lws(const char *s);
+static bool parse_list(struct httplint *h, const char *s, regex_t *preg,
+    unsigned int n, unsigned int m,
+    void (*callback)(struct httplint *h, const char *s, regmatch_t pmatch[]));
+static void header_accept_ranges(struct httplint *h, const char *s);
+static void header_age(struct httplint *h, const char *s);
+static void header_allow(struct httplint *h, const char *s);
+static void header_cache_control(struct httplint *h, const char *s);
+static void header_cache_control_callback(struct httplint *h, const char *s,
+    regmatch_t pmatch[]);
+static void header_connection(struct httplint *h, const char *s);
+static void header_content_encoding(struct httplint *h, const char *s);
+static void header_content_encoding_callback(struct httplint *h,
+    const char *s, regmatch_t pmatch[]);
+static void header_content_language(struct httplint *h, const char *s);
+static void header_content_length(struct httplint *h, const char *s);
+static void header_content_location(struct httplint *h, const char *s);
+static void header_content_md5(struct httplint *h, const char *s);
+static void header_content_range(struct httplint *h, const char *s);
+static void header_content_type(struct httplint *h, const char *s);
+static void header_date(struct httplint *h, const char *s);
+static void header_etag(struct httplint *h, const char *s);
+static void header_expires(struct httplint *h, const char *s);
+static void header_last_modified(struct httplint *h, const char *s);
+static void header_location(struct httplint *h, const char *s);
+static void header_pragma(struct httplint *h, const char *s);
+static void header_retry_after(struct httplint *h, const char *s);
+static void header_server(struct httplint *h, const char *s);
+static void header_trailer(struct httplint *h, const char *s);
+static void header_transfer_encoding(struct httplint *h, const char *s);
+static void header_transfer_encoding_callback(struct httplint *h,
+    const char *s, regmatch_t pmatch[]);
+static void header_upgrade(struct httplint *h, const char *s);
+static void header_vary(struct httplint *h, const char *s);
+static void header_vary_callback(struct httplint *h, const char *s,
+    regmatch_t pmatch[]);
+static void header_via(struct httplint *h, const char *s);
+static void header_set_cookie(struct httplint *h, const char *s);
+static size_t cookie_field(char *field, size_t size, const char *s);
+static void keep_long_cookie(struct httplint *h, const char *line,
+    size_t len);
+static void check_cookies(struct httplint *h, const char *url);
+static int find_site(struct httplint *h, const char *url, const char **path);
+static const struct jar_cookie *jar_set(struct httplint *h,
+    unsigned int site, const struct set_cookie *c, const char *path);
+static bool path_match(const char *cookie_path, const char *path);
+static size_t cookie_bytes(const struct httplint *h, unsigned int site,
+    const char *path, unsigned int *n);
+static void report(struct httplint *h, const char *key);
+static void detail(struct httplint *h, enum httplint_level level,
+    const char *format, ...);
+
+
+static const struct header_entry {
+  char name[40];
+  void (*handler)(struct httplint *h, const char *s);
+  char *missing;
+} header_table[] = {
+  { "Accept-Ranges", header_accept_ranges, 0 },
+  { "Age", header_age, 0 },
+  { "Allow", header_allow, 0 },
+  { "Cache-Control", header_cache_control, 0 },
+  { "Connection", header_connection, 0 },
+  { "Content-Encoding", header_content_encoding, 0 },
+  { "Content-Language", header_content_language, "missingcontlang" },
+  { "Content-Length", header_content_length, 0 },
+  { "Content-Location", header_content_location, 0 },
+  { "Content-MD5", header_content_md5, 0 },
+  { "Content-Range", header_content_range, 0 },
+  { "Content-Type", header_content_type, "missingcontenttype" },
+  { "Date", header_date, "missingdate" },
+  { "ETag", header_etag, 0 },
+  { "Expires", header_expires, 0 },
+  { "Last-Modified", header_last_modified, "missinglastmod" },
+  { "Location", header_location, 0 },
+  { "Pragma", header_pragma, 0 },
+  { "Retry-After", header_retry_after, 0 },
+  { "Server", header_server, 0 },
+  { "Set-Cookie", header_set_cookie, 0 },
+  { "Trailer", header_trailer, 0 },
+  { "Transfer-Encoding", header_transfer_encoding, 0 },
+  { "Upgrade", header_upgrade, 0 },
+  { "Vary", header_vary, 0 },
+  { "Via", header_via, 0 }
+};
+
+#define HEADER_COUNT (sizeof header_table / sizeof header_table[0])
+
+/* a checker: everything about the response being checked */
+struct httplint {
+  httplint_sink sink;
+  void *arg;
+  bool start;                   /* the next line is the Status-Line */
+  int status_code;
+  unsigned int count[HEADER_COUNT];
+  struct httplint_cache cache;
+  struct body_info body;
+  struct date_entry dates[DATE_CACHE_SIZE];  /* kept from one response to
+                                                the next */
+  bool cookies;                 /* HTTPLINT_COOKIES */
+  struct set_cookie set[COOKIE_MAX];
+  unsigned int set_count;
+  char **sites;                 /* the jar, kept from one response to the
+                                   next */
+  unsigned int site_count;
+  struct jar_cookie *jar;
+  unsigned int jar_count;
+};
+
+/* compiled once by httplint_init(), then shared read-only */
+static bool ready = false;
+static regex_t re_status_line, re_token, re_token_value, re_content_type,
+    re_ugly, re_absolute_uri, re_etag, re_server, re_transfer_coding,
+    re_upgrade, re_rfc1036, re_asctime, re_cookie_nameval, re_cookie_expires;
+
+
+/**
+ * Compile the regular expressions. Call once before the first checker is
+ * created, and before starting any threads that use checkers.
+ */
+bool httplint_init(void)
+{
+  if (ready)
+    return true;
+
+  if (regcomp(&re_status_line,
+      "^HTTP/([0-9]+)[.]([0-9]+) ([0-9][0-9][0-9]) ([\t -~-]*)$",
+      REG_EXTENDED))
+    return false;
+  if (regcomp(&re_token,
+      "^([-0-9a-zA-Z_.!]+)",
+      REG_EXTENDED))
+    return false;
+  if (regcomp(&re_token_value,
+      "^([-0-9a-zA-Z_.!]+)(=([-0-9a-zA-Z_.!]+|\"([^\"]|[\\].)*\"))?",
+      REG_EXTENDED))
+    return false;
+  if (regcomp(&re_content_type,
+      "^([-0-9a-zA-Z_.]+)/([-0-9a-zA-Z_.]+)[ \t]*"
+      "(;[ \t]*([-0-9a-zA-Z_.]+)="
+       "([-0-9a-zA-Z_.]+|\"([^\"]|[\\].)*\")[ \t]*)*$",
+      REG_EXTENDED))
+    return false;
+  if (regcomp(&re_absolute_uri,
+      "^[a-zA-Z0-9]+://[^ ]+$",
+      REG_EXTENDED))
+    return false;
+  if (regcomp(&re_etag,
+      "^(W/[ \t]*)?\"([^\"]|[\\].)*\"$",
+      REG_EXTENDED))
+    return false;
+  if (regcomp(&re_server,
+      "^((([-0-9a-zA-Z_.!]+(/[-0-9a-zA-Z_.]+)?)|(\\(.*\\)))[ \t]*)+$",
+      REG_EXTENDED))
+    return false;
+  if (regcomp(&re_transfer_coding,
+      "^([-0-9a-zA-Z_.]+)[ \t]*"
+      "(;[ \t]*([-0-9a-zA-Z_.]+)="
+       "([-0-9a-zA-Z_.]+|\"([^\"]|[\\].)*\")[ \t]*)*$",
+      REG_EXTENDED))
+    return false;
+  if (regcomp(&re_upgrade,
+      "^([-0-9a-zA-Z_.](/[-0-9a-zA-Z_.])?)+$",
+      REG_EXTENDED))
+    return false;
+  if (regcomp(&re_ugly,
+      "^[a-zA-Z0-9]+://[^/]+[-/a-zA-Z0-9_]*$",
+      REG_EXTENDED))
+    return false;
+  if (regcomp(&re_rfc1036,
+      "^(Monday|Tuesday|Wednesday|Thursday|Friday|Saturday|Sunday), "
+      "([0123][0-9])-(Jan|Feb|Mar|Apr|May|Jun|Jul|Aug|Sep|Oct|Nov|Dec)-"
+      "([0-9][0-9]) ([012][0-9]):([0-5][0-9]):([0-5][0-9]) GMT$",
+      REG_EXTENDED))
+    return false;
+  if (regcomp(&re_asctime,
+      "^(Mon|Tue|Wed|Thu|Fri|Sat|Sun) "
+      "(Jan|Feb|Mar|Apr|May|Jun|Jul|Aug|Sep|Oct|Nov|Dec) ([ 12][0-9]) "
+      "([012][0-9]):([0-5][0-9]):([0-5][0-9]) ([0-9]{4})$",
+      REG_EXTENDED))
+    return false;
+  if (regcomp(&re_cookie_nameval,
+      "^[^;, ]+=[^;, ]*$",
+      REG_EXTENDED))
+    return false;
+  if (regcomp(&re_cookie_expires,
+      "^(Mon|Tue|Wed|Thu|Fri|Sat|Sun), ([0123][0-9])-"
+      "(Jan|Feb|Mar|Apr|May|Jun|Jul|Aug|Sep|Oct|Nov|Dec)-([0-9]{4}) "
+      "([012][0-9]):([0-5][0-9]):([0-5][0-9]) GMT$",
+      REG_EXTENDED))
+    return false;
+
+  ready = true;
+  return true;
+}
+
+
+/**
+ * Create a checker which passes its findings to SINK, or 0 if out of
+ * memory.
+ */
+struct httplint *httplint_new(httplint_sink sink, void *arg)
+{
+  struct httplint *h = calloc(1, sizeof *h);
+
+  if (!h)
+    return 0;
+  h->sink = sink;
+  h->arg = arg;
+  httplint_begin(h, 0);
+  return h;
+}
+
+
+void httplint_free(struct httplint *h)
+{
+  unsigned int i;
+
+  if (!h)
+    return;
+  body_reset(h);
+  for (i = 0; i != h->site_count; i++)
+    free(h->sites[i]);
+  free(h->sites);
+  free(h->jar);
+  free(h);
+}
+
+
+/**
+ * Forget the last response and get ready for the next. With HTTPLINT_BODY
+ * in OPTIONS, the body passed to httplint_body() is checked as well. With
+ * HTTPLINT_COOKIES, the cookies set are added to those of earlier
+ * responses from the same site, and what they cost each request checked.
+ */
+void httplint_begin(struct httplint *h, unsigned int options)
+{
+  h->start = true;
+  h->status_code = 0;
+  memset(h->count, 0, sizeof h->count);
+  memset(&h->cache, 0, sizeof h->cache);
+  h->cache.max_age = h->cache.s_maxage = -1;
+  body_reset(h);
+  h->body.active = options & HTTPLINT_BODY;
+  h->cookies = options & HTTPLINT_COOKIES;
+  h->set_count = 0;
+}
+
+
+/**
+ * Check one raw header line of LEN bytes, CR LF included. The first line
+ * of a response is its Status-Line. Returns false for the empty line that
+ * ends the headers.
+ */
+bool httplint_header_line(struct httplint *h, const char *line, size_t len)
+{
+  char s[400], *value;
+
+  if (len < 2 || line[len - 2] != 13 || line[len - 1] != 10) {
+    report(h, "notcrlf");
+    return true;
+  }
+  if (sizeof s <= len) {
+    report(h, "headertoolong");
+    keep_long_cookie(h, line, len - 2);
+    return true;
+  }
+  memcpy(s, line, len - 2);
+  s[len - 2] = 0;
+
+  value = strchr(s, ':');
+
+  if (s[0] == 0) {
+    /* empty header indicates end of headers */
+    report(h, "endofheaders");
+    return false;
+
+  } else if (h->start) {
+    httplint_status_line(h, s);
+
+  } else if (!value) {
+    report(h, "missingcolon");
+
+  } else {
+    *value = 0;
+    value++;
+
+    httplint_header(h, s, skip_lws(value));
+  }
+
+  return true;
+}
+
+
+/**
+ * Check the syntax and content of the response Status-Line [6.1].
+ */
+void httplint_status_line(struct httplint *h, const char *s)
+{
+  unsigned int major = 0, minor = 0;
+  int r;
+  regmatch_t pmatch[5];
+
+  h->start = false;
+
+  r = regexec(&re_status_line, s, 5, pmatch, 0);
+  if (r) {
+    report(h, "badstatusline");
+    return;
+  }
+
+  major = atoi(s + pmatch[1].rm_so);
+  minor = atoi(s + pmatch[2].rm_so);
+  h->status_code = atoi(s + pmatch[3].rm_so);
+
+  if (major < 1 || (major == 1 && minor == 0)) {
+    report(h, "oldhttp");
+  } else if ((major == 1 && 1 < minor) || 1 < major) {
+    report(h, "futurehttp");
+  } else {
+    if (h->status_code < 100 || 600 <= h->status_code) {
+      report(h, "badstatus");
+    } else {
+      char key[] = "xxx";
+      key[0] = '0' + h->status_code / 100;
+      report(h, key);
+    }
+  }
+}
+
+
+/**
+ * Check the syntax and content of a header, its VALUE without leading LWS.
+ */
+void httplint_header(struct httplint *h, const char *name, const char *value)
+{
+  const struct header_entry *header;
+
+  header = bsearch(name, header_table, HEADER_COUNT, sizeof header_table[0],
+      (int (*)(const void *, const void *)) strcasecmp);
+
+  if (header) {
+    h->count[header - header_table]++;
+    header->handler(h, value);
+  } else if ((name[0] == 'X' || name[0] == 'x') && name[1] == '-') {
+    report(h, "xheader");
+  } else {
+    report(h, "nonstandard");
+  }
+}
+
+
+/**
+ * Count, digest and (de)compress the next part of the body, if it is
+ * being checked.
+ */
+void httplint_body(struct httplint *h, const void *p, size_t n)
+{
+  struct body_info *body = &h->body;
+
+  if (!body->active)
+    return;
+
+  if (body->received == 0) {
+    md5_init(&body->md5);
+    if (strcasecmp(body->encoding, "gzip") == 0 ||
+        strcasecmp(body->encoding, "x-gzip") == 0 ||
+        strcasecmp(body->encoding, "deflate") == 0) {
+      /* deflate is the zlib format [3.5]; 32 also accepts gzip */
+      if (inflateInit2(&body->z, 32 + MAX_WBITS) == Z_OK)
+        body->z_kind = BODY_INFLATE;
+    } else if (!body->encoding[0] ||
+        strcasecmp(body->encoding, "identity") == 0) {
+      if (deflateInit(&body->z, Z_DEFAULT_COMPRESSION) == Z_OK)
+        body->z_kind = BODY_DEFLATE;
+    }
+  }
+
+  body->received += n;
+  md5_update(&body->md5, p, n);
+  if (body->z_kind != BODY_AS_IS && !body->z_ended && !body->z_error) {
+    body->z.next_in = (unsigned char *) p;
+    body->z.avail_in = n;
+    body_code(h, Z_NO_FLUSH);
+  }
+}
+
+
+/**
+ * Report on the response once all its headers (and body) have been
+ * checked: the headers that were missing, an ugly URL (unless 0), the
+ * body, and the cookies. BODY_INCOMPLETE says the body was cut short.
+ */
+void httplint_end(struct httplint *h, const char *url, bool body_incomplete)
+{
+  unsigned int i;
+
+  for (i = 0; i != HEADER_COUNT; i++) {
+    if (h->count[i] == 0 && header_table[i].missing)
+      report(h, header_table[i].missing);
+  }
+
+  if (url && regexec(&re_ugly, url, 0, 0, 0))
+    report(h, "ugly");
+
+  if (h->body.active) {
+    h->body.incomplete = body_incomplete;
+    check_body(h);
+  }
+
+  if (h->cookies && url)
+    check_cookies(h, url);
+}
+
+
+int httplint_status(const struct httplint *h)
+{
+  return h->status_code;
+}
+
+
+const struct httplint_cache *httplint_cache_info(const struct httplint *h)
+{
+  return &h->cache;
+}
+
+
+/**
+ * The freshness lifetime of the response for a shared cache [13.2.4], or
+ * -1 if it has none. no-cache makes it 0, since every use must be
+ * revalidated.
+ */
+long httplint_freshness_lifetime(const struct httplint *h)
+{
+  const struct httplint_cache *cache = &h->cache;
+
+  if (cache->no_cache)
+    return 0;
+  if (0 <= cache->s_maxage)
+    return cache->s_maxage;
+  if (0 <= cache->max_age)
+    return cache->max_age;
+  if (cache->has_expires && cache->has_date)
+    return cache->date < cache->expires ? cache->expires - cache->date : 0;
+  if (cache->has_expires)
+    return 0;
+  return -1;
+}
+
+
+/**
+ * Score how cacheable the response is out of 100, reporting what costs it
+ * points. REVALIDATED says whether its validators gave a 304 when tried.
+ */
+int httplint_cache_score(struct httplint *h, bool revalidated)
+{
+  const struct httplint_cache *cache = &h->cache;
+  long lifetime = httplint_freshness_lifetime(h);
+  int score = 0;
+
+  if (cache->no_store) {
+    report(h, "cachenostore");
+    return 0;
+  }
+
+  /* up to 50 for freshness: a hit needs no request to the origin */
+  if (86400 <= lifetime)
+    score += 50;
+  else if (3600 <= lifetime)
+    score += 35;
+  else if (60 <= lifetime)
+    score += 20;
+  else if (0 < lifetime)
+    score += 10;
+  else
+    report(h, "cachenofresh");
+
+  /* up to 30 for validators that work: a miss can be a cheap 304 */
+  if (cache->etag[0] || cache->last_modified[0]) {
+    if (!revalidated)
+      report(h, "cachenot304");
+    else if (cache->etag[0] && cache->etag[0] != 'W')
+      score += 30;
+    else
+      score += 20;
+  } else {
+    report(h, "cachenovalidator");
+  }
+
+  /* up to 20 for being storable by shared caches such as a CDN */
+  if (cache->private)
+    report(h, "cacheprivate");
+  else if (cache->set_cookie && !cache->public && cache->s_maxage < 0)
+    report(h, "cachecookie");
+  else
+    score += 20;
+
+  /* every variant is cached and missed separately */
+  if (cache->vary_star) {
+    report(h, "cachevary");
+    score = score < 10 ? score : 10;
+  } else if (cache->vary_explosive || 2 < cache->vary_count) {
+    report(h, "cachevary");
+    score -= 20;
+  }
+  return score < 0 ? 0 : score;
+}
+
+
+/**
+ * The cookies held for site number I, or false if there are not that many
+ * sites.
+ */
+bool httplint_cookie_site(const struct httplint *h, unsigned int i,
+    struct httplint_site *site)
+{
+  unsigned int j, n;
+  size_t bytes;
+
+  if (h->site_count <= i)
+    return false;
+
+  site->name = h->sites[i];
+  site->cookies = 0;
+  site->bytes = cookie_bytes(h, i, "/", &n);
+  site->max_bytes = site->bytes;
+  for (j = 0; j != h->jar_count; j++) {
+    if (h->jar[j].site != i)
+      continue;
+    site->cookies++;
+    bytes = cookie_bytes(h, i, h->jar[j].path, &n);
+    if (site->max_bytes < bytes)
+      site->max_bytes = bytes;
+  }
+  return true;
+}
+
+
+/**
+ * Skip optional LWS, for callers that pick headers apart themselves.
+ */
+const char *httplint_skip_lws(const char *s)
+{
+  return skip_lws(s);
+}
+
+
+/**
+ * Forget the body of the last response.
+ */
+static void body_reset(struct httplint *h)
+{
+  if (h->body.z_kind == BODY_INFLATE)
+    inflateEnd(&h->body.z);
+  else if (h->body.z_kind == BODY_DEFLATE)
+    deflateEnd(&h->body.z);
+  memset(&h->body, 0, sizeof h->body);
+  h->body.content_length = -1;
+}
+
+
+/**
+ * Run the (de)compressor over its input, counting and dropping the output.
+ */
+static void body_code(struct httplint *h, int flush)
+{
+  struct body_info *body = &h->body;
+  unsigned char out[16384];
+  int r;
+
+  do {
+    body->z.next_out = out;
+    body->z.avail_out = sizeof out;
+    if (body->z_kind == BODY_INFLATE)
+      r = inflate(&body->z, Z_NO_FLUSH);
+    else
+      r = deflate(&body->z, flush);
+    body->coded += sizeof out - body->z.avail_out;
+    if (r == Z_STREAM_END) {
+      body->z_ended = true;
+      return;
+    }
+    if (r != Z_OK && r != Z_BUF_ERROR) {
+      body->z_error = true;
+      return;
+    }
+  } while (body->z.avail_out == 0 || (flush == Z_FINISH && r == Z_OK));
+}
+
+
+/**
+ * Compare the body as received with what the headers said about it.
+ */
+static void check_body(struct httplint *h)
+{
+  struct body_info *body = &h->body;
+  unsigned char digest[16];
+  char md5[25], coded[80] = "";
+
+  body->active = false;
+  if (h->status_code < 200 || h->status_code == 204 ||
+      h->status_code == 304)
+    return;
+
+  if (body->received == 0)
+    md5_init(&body->md5);
+  md5_final(&body->md5, digest);
+  base64(digest, sizeof digest, md5);
+
+  if (body->incomplete)
+    report(h, "bodyshort");
+  else if (0 <= body->content_length &&
+      body->content_length != body->received)
+    report(h, "bodylength");
+  if (body->content_md5[0] && strcmp(body->content_md5, md5))
+    report(h, "bodymd5");
+
+  if (body->z_kind == BODY_INFLATE) {
+    if (body->z_error || (!body->z_ended && !body->incomplete))
+      report(h, "bodyencoding");
+    else if (1024 <= body->coded && body->coded * 9 < body->received * 10)
+      report(h, "bodypoorcomp");
+  } else if (body->z_kind == BODY_DEFLATE && 0 < body->received) {
+    body->z.next_in = 0;
+    body->z.avail_in = 0;
+    body_code(h, Z_FINISH);
+    if (1024 <= body->received && body->coded * 10 <= body->received * 8)
+      report(h, "bodyuncompressed");
+  }
+
+  if (body->z_kind != BODY_AS_IS && 0 < body->received && 0 < body->coded)
+    snprintf(coded, sizeof coded, ", %lli bytes %s (%.0f%% of the %s size)",
+        body->coded,
+        body->z_kind == BODY_INFLATE ? "decoded" : "if deflated",
+        100.0 * (body->z_kind == BODY_INFLATE ?
+        (double) body->received / body->coded :
+        (double) body->coded / body->received),
+        body->z_kind == BODY_INFLATE ? "decoded" : "current");
+  else if (body->z_kind != BODY_AS_IS && 0 < body->received)
+    snprintf(coded, sizeof coded, ", %lli bytes %s", body->coded,
+        body->z_kind == BODY_INFLATE ? "decoded" : "if deflated");
+  detail(h, HTTPLINT_NOTE, "Body: %lli bytes, MD5 %s%s.", body->received,
+      md5, coded);
+}
+
+
+/* MD5 [RFC 1321] */
+static const uint32_t md5_k[64] = {
+  0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a,
+  0xa8304613, 0xfd469501, 0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be,
+  0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821, 0xf61e2562, 0xc040b340,
+  0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+  0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8,
+  0x676f02d9, 0x8d2a4c8a, 0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c,
+  0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70, 0x289b7ec6, 0xeaa127fa,
+  0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+  0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92,
+  0xffeff47d, 0x85845dd1, 0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+  0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+
+static const unsigned char md5_r[64] = {
+  7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+  5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+  4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+  6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+};
+
+#define ROL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+static void md5_init(struct md5 *c)
+{
+  c->h[0] = 0x67452301;
+  c->h[1] = 0xefcdab89;
+  c->h[2] = 0x98badcfe;
+  c->h[3] = 0x10325476;
+  c->len = 0;
+  c->used = 0;
+}
+
+static void md5_block(struct md5 *c, const unsigned char *p)
+{
+  uint32_t w[16], a, b, d, f, cc, t;
+  unsigned int i, g;
+
+  for (i = 0; i != 16; i++)
+    w[i] = p[i * 4] | p[i * 4 + 1] << 8 | p[i * 4 + 2] << 16 |
+        (uint32_t) p[i * 4 + 3] << 24;
+
+  a = c->h[0]; b = c->h[1]; cc = c->h[2]; d = c->h[3];
+  for (i = 0; i != 64; i++) {
+    if (i < 16) {
+      f = (b & cc) | (~b & d);
+      g = i;
+    } else if (i < 32) {
+      f = (d & b) | (~d & cc);
+      g = (5 * i + 1) & 15;
+    } else if (i < 48) {
+      f = b ^ cc ^ d;
+      g = (3 * i + 5) & 15;
+    } else {
+      f = cc ^ (b | ~d);
+      g = (7 * i) & 15;
+    }
+    t = d;
+    d = cc;
+    cc = b;
+    b = b + ROL(a + f + md5_k[i] + w[g], md5_r[i]);
+    a = t;
+  }
+  c->h[0] += a; c->h[1] += b; c->h[2] += cc; c->h[3] += d;
+}
+
+static void md5_update(struct md5 *c, const void *data, size_t n)
+{
+  const unsigned char *p = data;
+  size_t take;
+
+  c->len += n;
+  while (n) {
+    take = 64 - c->used;
+    if (n < take)
+      take = n;
+    memcpy(c->buf + c->used, p, take);
+    c->used += take;
+    p += take;
+    n -= take;
+    if (c->used == 64) {
+      md5_block(c, c->buf);
+      c->used = 0;
+    }
+  }
+}
+
+static void md5_final(struct md5 *c, unsigned char *digest)
+{
+  uint64_t bits = c->len * 8;
+  unsigned int i;
+
+  c->buf[c->used++] = 0x80;
+  if (56 < c->used) {
+    memset(c->buf + c->used, 0, 64 - c->used);
+    md5_block(c, c->buf);
+    c->used = 0;
+  }
+  memset(c->buf + c->used, 0, 56 - c->used);
+  for (i = 0; i != 8; i++)
+    c->buf[56 + i] = bits >> (i * 8);
+  md5_block(c, c->buf);
+
+  for (i = 0; i != 16; i++)
+    digest[i] = c->h[i / 4] >> (i % 4 * 8);
+}
+
+
+/**
+ * Base64 encode N bytes into OUT, which must have room for the result and
+ * a terminating 0.
+ */
+static void base64(const unsigned char *p, size_t n, char *out)
+{
+  static const char digits[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  uint32_t v;
+
+  for (; 3 <= n; p += 3, n -= 3) {
+    v = p[0] << 16 | p[1] << 8 | p[2];
+    *out++ = digits[v >> 18];
+    *out++ = digits[(v >> 12) & 63];
+    *out++ = digits[(v >> 6) & 63];
+    *out++ = digits[v & 63];
+  }
+  if (n) {
+    v = p[0] << 16 | (n == 2 ? p[1] << 8 : 0);
+    *out++ = digits[v >> 18];
+    *out++ = digits[(v >> 12) & 63];
+    *out++ = n == 2 ? digits[(v >> 6) & 63] : '=';
+    *out++ = '=';
+  }
+  *out = 0;
+}
+
+
+/**
+ * Attempt to parse an HTTP Full Date (3.3.1), returning true on success.
+ */
+static bool parse_date(struct httplint *h, const char *s, time_t *t)
+{
+  switch (date_lookup(h, s, false, t)) {
+    case DATE_BAD:
+      report(h, "baddate");
+      return false;
+    case DATE_ASCTIME:
+      report(h, "asctime");
+      break;
+    case DATE_RFC1036:
+      report(h, "rfc1036");
+      break;
+    default:
+      break;
+  }
+  return true;
+}
+
+
+/**
+ * Parse a date, as an HTTP date or as a COOKIE expiry date, or find it
+ * among the dates parsed before.
+ */
+static enum date_kind date_lookup(struct httplint *h, const char *s,
+    bool cookie, time_t *t)
+{
+  struct date_entry *entry = 0;
+  enum date_kind kind;
+  size_t len = strlen(s);
+  uint32_t hash = 2166136261u;
+  unsigned int i;
+
+  if (len < DATE_CACHE_TEXT) {
+    /* FNV-1a */
+    for (i = 0; i != len; i++)
+      hash = (hash ^ (unsigned char) s[i]) * 16777619u;
+    entry = &h->dates[(hash + cookie) & (DATE_CACHE_SIZE - 1)];
+    if (entry->text[0] && entry->cookie == cookie &&
+        strcmp(entry->text, s) == 0) {
+      *t = entry->t;
+      return entry->kind;
+    }
+  }
+
+  *t = 0;
+  kind = cookie ? scan_cookie_date(s, t) : scan_date(s, t);
+
+  if (entry && len) {
+    memcpy(entry->text, s, len + 1);
+    entry->cookie = cookie;
+    entry->kind = kind;
+    entry->t = *t;
+  }
+  return kind;
+}
+
+
+/**
+ * Parse an HTTP date in any of its three formats (3.3.1).
+ */
+static enum date_kind scan_date(const char *s, time_t *t)
+{
+  size_t len = strlen(s);
+  regmatch_t pmatch[20];
+  struct tm tm;
+
+  memset(&tm, 0, sizeof tm);
+
+  if (len == 29) {
+    /* RFC 1123 */
+    if (!scan_rfc1123(s, &tm))
+      return DATE_BAD;
+    *t = mktime_from_utc(&tm);
+    return DATE_RFC1123;
+
+  } else if (len == 24) {
+    /* asctime() format */
+    if (regexec(&re_asctime, s, 20, pmatch, 0))
+      return DATE_BAD;
+    if (s[pmatch[3].rm_so] == ' ')
+      tm.tm_mday = atoi(s + pmatch[3].rm_so + 1);
+    else
+      tm.tm_mday = atoi(s + pmatch[3].rm_so);
+    tm.tm_mon = month(s + pmatch[2].rm_so);
+    tm.tm_year = atoi(s + pmatch[7].rm_so) - 1900;
+    tm.tm_hour = atoi(s + pmatch[4].rm_so);
+    tm.tm_min = atoi(s + pmatch[5].rm_so);
+    tm.tm_sec = atoi(s + pmatch[6].rm_so);
+    *t = mktime_from_utc(&tm);
+    return DATE_ASCTIME;
+
+  } else {
+    /* RFC 1036 */
+    if (regexec(&re_rfc1036, s, 20, pmatch, 0))
+      return DATE_BAD;
+    tm.tm_mday = atoi(s + pmatch[2].rm_so);
+    tm.tm_mon = month(s + pmatch[3].rm_so);
+    tm.tm_year = 100 + atoi(s + pmatch[4].rm_so);
+    tm.tm_hour = atoi(s + pmatch[5].rm_so);
+    tm.tm_min = atoi(s + pmatch[6].rm_so);
+    tm.tm_sec = atoi(s + pmatch[7].rm_so);
+    *t = mktime_from_utc(&tm);
+    return DATE_RFC1036;
+  }
+}
+
+
+/**
+ * Parse the expires date of a Set-Cookie, Wdy, DD-Mon-YYYY HH:MM:SS GMT.
+ */
+static enum date_kind scan_cookie_date(const char *s, time_t *t)
+{
+  regmatch_t pmatch[20];
+  struct tm tm;
+
+  if (regexec(&re_cookie_expires, s, 20, pmatch, 0))
+    return DATE_BAD;
+
+  memset(&tm, 0, sizeof tm);
+  tm.tm_mday = atoi(s + pmatch[2].rm_so);
+  tm.tm_mon = month(s + pmatch[3].rm_so);
+  tm.tm_year = atoi(s + pmatch[4].rm_so) - 1900;
+  tm.tm_hour = atoi(s + pmatch[5].rm_so);
+  tm.tm_min = atoi(s + pmatch[6].rm_so);
+  tm.tm_sec = atoi(s + pmatch[7].rm_so);
+  *t = mktime_from_utc(&tm);
+  return DATE_COOKIE;
+}
+
+
+/**
+ * Parse an RFC 1123 date, which is always 29 characters with every field
+ * at a fixed offset, without a regular expression:
+ *   Sun, 06 Nov 1994 08:49:37 GMT
+ */
+static bool scan_rfc1123(const char *s, struct tm *tm)
+{
+  static const char days[] = "Mon Tue Wed Thu Fri Sat Sun ";
+  static const char months[] = "Jan Feb Mar Apr May Jun Jul Aug Sep Oct "
+      "Nov Dec ";
+  const char *m;
+  unsigned int i;
+
+  for (i = 0; i != 7 && strncmp(days + i * 4, s, 3); i++)
+    ;
+  for (m = months; *m && strncmp(m, s + 8, 3); m += 4)
+    ;
+  if (i == 7 || !*m || s[3] != ',' || s[4] != ' ' || s[7] != ' ' ||
+      s[11] != ' ' || s[16] != ' ' || s[19] != ':' || s[22] != ':' ||
+      strcmp(s + 25, " GMT"))
+    return false;
+
+  tm->tm_mday = scan_digits(s + 5, 2, '3');
+  tm->tm_mon = (m - months) / 4;
+  tm->tm_year = scan_digits(s + 12, 4, '9') - 1900;
+  tm->tm_hour = scan_digits(s + 17, 2, '2');
+  tm->tm_min = scan_digits(s + 20, 2, '5');
+  tm->tm_sec = scan_digits(s + 23, 2, '5');
+  return 0 <= tm->tm_mday && -1900 <= tm->tm_year && 0 <= tm->tm_hour &&
+      0 <= tm->tm_min && 0 <= tm->tm_sec;
+}
+
+
+/**
+ * The value of N decimal digits, the first of them no more than MAX, or -1
+ * if they are not.
+ */
+static int scan_digits(const char *s, unsigned int n, char max)
+{
+  int v = 0;
+  unsigned int i;
+
+  if (*s < '0' || max < *s)
+    return -1;
+  for (i = 0; i != n; i++) {
+    if (s[i] < '0' || '9' < s[i])
+      return -1;
+    v = v * 10 + s[i] - '0';
+  }
+  return v;
+}
+
+
+/**
+ * Convert a month name to the month number.
+ */
+static int month(const char *s)
+{
+  switch (s[0]) {
+    case 'J':
+      switch (s[1]) {
+        case 'a':
+          return 0;
+        case 'u':
+          return s[2] == 'n' ? 5 : 6;
+      }
+    case 'F':
+      return 1;
+    case 'M':
+      return s[2] == 'r' ? 2 : 4;
+    case 'A':
+      return s[1] == 'p' ? 3 : 7;
+    case 'S':
+      return 8;
+    case 'O':
+      return 9;
+    case 'N':
+      return 10;
+    case 'D':
+      return 11;
+  }
+  return 0;
+}
+
+
+/**
+ * UTC version of mktime: the seconds since the epoch of a broken-down UTC
+ * time, counting the days of the proleptic Gregorian calendar directly
+ * rather than going through mktime() and the local time zone.
+ */
+static time_t mktime_from_utc(struct tm *t)
+{
+  /* years that start in March, so the leap day comes last */
+  long year = t->tm_year + 1900L - (t->tm_mon < 2);
+  long mon = t->tm_mon < 2 ? t->tm_mon + 10 : t->tm_mon - 2;
+  long era = (year < 0 ? year - 399 : year) / 400;
+  long year_of_era = year - era * 400;
+  long day_of_year = (153 * mon + 2) / 5 + t->tm_mday - 1;
+  long days = era * 146097 + year_of_era * 365 + year_of_era / 4 -
+      year_of_era / 100 + day_of_year - 719468;
+
+  return (time_t) days * 86400 + t->tm_hour * 3600 + t->tm_min * 60 +
+      t->tm_sec;
+}
+
+
+/**
+ * Skip optional LWS (linear white space) [2.2]
+ */
+static const char *skip_lws(const char *s)
+{
+  if (s[0] == 13 && s[1] == 10 && (s[2] == ' ' || s[2] == '\t'))
+    s += 2;
+  while (*s == ' ' || *s == '\t')
+    s++;
+  return s;
+}
+
+
+/**
+ * Parse a list of elements (#rule in [2.1]).
+ */
+static bool parse_list(struct httplint *h, const char *s, regex_t *preg,
+    unsigned int n, unsigned int m,
+    void (*callback)(struct httplint *h, const char *s, regmatch_t pmatch[]))
+{
+  int r;
+  unsigned int items = 0;
+  regmatch_t pmatch[20];
+
+  do {
+    r = regexec(preg, s, 20, pmatch, 0);
+    if (r) {
+      detail(h, HTTPLINT_ERROR, "Failed to match list item %i", items + 1);
+      return false;
+    }
+
+    if (callback)
+      callback(h, s, pmatch);
+    items++;
+
+    s += pmatch[0].rm_eo;
+    s = skip_lws(s);
+    if (*s == 0)
+      break;
+    if (*s != ',') {
+      detail(h, HTTPLINT_ERROR, "Expecting , after list item %i", items);
+      return false;
+    }
+    while (*s == ',')
+      s = skip_lws(s + 1);
+  } while (*s != 0);
+
+  if (items < n || m < items) {
+    if (m == UINT_MAX)
+      detail(h, HTTPLINT_ERROR, "%i items in list, but there should be "
+          "at least %i", items, n);
+    else
+      detail(h, HTTPLINT_ERROR, "%i items in list, but there should be "
+          "between %i and %i", items, n, m);
+    return false;
+  }
+
+  return true;
+}
+
+
+/* Header-specific validation. */
+static void header_accept_ranges(struct httplint *h, const char *s)
+{
+  if (strcmp(s, "bytes") == 0)
+    report(h, "ok");
+  else if (strcmp(s, "none") == 0)
+    report(h, "ok");
+  else
+    report(h, "unknownrange");
+}
+
+static void header_age(struct httplint *h, const char *s)
+{
+  if (s[0] == 0 || strspn(s, NUMBER) != strlen(s))
+    report(h, "badage");
+  else
+    report(h, "ok");
+}
+
+static void header_allow(struct httplint *h, const char *s)
+{
+  if (parse_list(h, s, &re_token, 0, UINT_MAX, 0))
+    report(h, "ok");
+  else
+    report(h, "badallow");
+}
+
+static void header_cache_control(struct httplint *h, const char *s)
+{
+  if (parse_list(h, s, &re_token_value, 1, UINT_MAX,
+      header_cache_control_callback))
+    report(h, "ok");
+  else
+    report(h, "badcachecont");
+}
+
+char cache_control_list[][20] = {
+  "max-age", "max-stale", "min-fresh", "must-revalidate",
+  "no-cache", "no-store", "no-transform", "only-if-cached",
+  "private", "proxy-revalidate", "public", "s-maxage"
+};
+
+static void header_cache_control_callback(struct httplint *h, const char *s,
+    regmatch_t pmatch[])
+{
+  size_t len = pmatch[1].rm_eo - pmatch[1].rm_so;
+  char name[20];
+  char *dir;
+
+  if (19 < len) {
+    report(h, "unknowncachecont");
+    return;
+  }
+
+  strncpy(name, s + pmatch[1].rm_so, len);
+  name[len] = 0;
+
+  if (strcasecmp(name, "no-store") == 0)
+    h->cache.no_store = true;
+  else if (strcasecmp(name, "no-cache") == 0)
+    h->cache.no_cache = true;
+  else if (strcasecmp(name, "private") == 0)
+    h->cache.private = true;
+  else if (strcasecmp(name, "public") == 0)
+    h->cache.public = true;
+  else if (strcasecmp(name, "max-age") == 0 && pmatch[3].rm_so != -1)
+    h->cache.max_age = atol(s + pmatch[3].rm_so +
+        (s[pmatch[3].rm_so] == '"'));
+  else if (strcasecmp(name, "s-maxage") == 0 && pmatch[3].rm_so != -1)
+    h->cache.s_maxage = atol(s + pmatch[3].rm_so +
+        (s[pmatch[3].rm_so] == '"'));
+
+  dir = bsearch(name, cache_control_list,
+      sizeof cache_control_list / sizeof cache_control_list[0],
+      sizeof cache_control_list[0],
+      (int (*)(const void *, const void *)) strcasecmp);
+
+  if (!dir) {
+    detail(h, HTTPLINT_WARNING, "Cache-Control directive '%s':", name);
+    report(h, "unknowncachecont");
+  }
+}
+
+static void header_connection(struct httplint *h, const char *s)
+{
+  if (strcmp(s, "close") == 0)
+    report(h, "ok");
+  else
+    report(h, "badconnection");
+}
+
+static void header_content_encoding(struct httplint *h, const char *s)
+{
+  if (strlen(s) < sizeof h->body.encoding)
+    strcpy(h->body.encoding, s);
+  else
+    strcpy(h->body.encoding, "unknown");
+  if (parse_list(h, s, &re_token, 1, UINT_MAX,
+      header_content_encoding_callback))
+    report(h, "ok");
+  else
+    report(h, "badcontenc");
+}
+
+char content_coding_list[][20] = {
+  "compress", "deflate", "gzip", "identity"
+};
+
+static void header_content_encoding_callback(struct httplint *h, const char *s,
+    regmatch_t pmatch[])
+{
+  size_t len = pmatch[1].rm_eo - pmatch[1].rm_so;
+  char name[20];
+  char *dir;
+
+  if (19 < len) {
+    report(h, "unknowncontenc");
+    return;
+  }
+
+  strncpy(name, s + pmatch[1].rm_so, len);
+  name[len] = 0;
+
+  dir = bsearch(name, content_coding_list,
+      sizeof content_coding_list / sizeof content_coding_list[0],
+      sizeof content_coding_list[0],
+      (int (*)(const void *, const void *)) strcasecmp);
+  if (!dir) {
+    detail(h, HTTPLINT_WARNING, "Content-Encoding '%s':", name);
+    report(h, "unknowncontenc");
+  }
+}
+
+static void header_content_language(struct httplint *h, const char *s)
+{
+  if (parse_list(h, s, &re_token, 1, UINT_MAX, 0))
+    report(h, "ok");
+  else
+    report(h, "badcontlang");
+}
+
+static void header_content_length(struct httplint *h, const char *s)
+{
+  if (s[0] == 0 || strspn(s, NUMBER) != strlen(s)) {
+    report(h, "badcontlen");
+  } else {
+    report(h, "ok");
+    h->body.content_length = atoll(s);
+  }
+}
+
+static void header_content_location(struct httplint *h, const char *s)
+{
+  if (strchr(s, ' '))
+    report(h, "badcontloc");
+  else
+    report(h, "ok");
+}
+
+static void header_content_md5(struct httplint *h, const char *s)
+{
+  if (strlen(s) != 24) {
+    report(h, "badcontmd5");
+  } else {
+    report(h, "ok");
+    strcpy(h->body.content_md5, s);
+  }
+}
+
+static void header_content_range(struct httplint *h, const char *s)
+{
+  UNUSED(s);
+  report(h, "contentrange");
+}
+
+static void header_content_type(struct httplint *h, const char *s)
+{
+  bool charset = false;
+  const char *p;
+  int r;
+  regmatch_t pmatch[30];
+
+  r = regexec(&re_content_type, s, 30, pmatch, 0);
+  if (r) {
+    report(h, "badcontenttype");
+    return;
+  }
+
+  /* parameters; the repeated group only keeps the last one, so look
+   * through them all */
+  for (p = strchr(s + pmatch[2].rm_eo, ';'); p; p = strchr(p + 1, ';'))
+    if (strncasecmp(skip_lws(p + 1), "charset=", 8) == 0)
+      charset = true;
+
+  if (pmatch[1].rm_eo - pmatch[1].rm_so == 4 &&
+      strncasecmp(s + pmatch[1].rm_so, "text", 4) == 0 && !charset)
+    report(h, "nocharset");
+  else
+    report(h, "ok");
+}
+
+static void header_date(struct httplint *h, const char *s)
+{
+  double diff;
+  time_t time0, time1;
+
+  time0 = time(0);
+  if (!parse_date(h, s, &time1))
+    return;
+  h->cache.has_date = true;
+  h->cache.date = time1;
+
+  diff = difftime(time0, time1);
+  if (10 < fabs(diff))
+    report(h, "wrongdate");
+  else
+    report(h, "ok");
+}
+
+static void header_etag(struct httplint *h, const char *s)
+{
+  int r;
+  r = regexec(&re_etag, s, 0, 0, 0);
+  if (r) {
+    report(h, "badetag");
+  } else {
+    report(h, "ok");
+    if (strlen(s) < sizeof h->cache.etag)
+      strcpy(h->cache.etag, s);
+  }
+}
+
+static void header_expires(struct httplint *h, const char *s)
+{
+  h->cache.has_expires = true;
+  if (parse_date(h, s, &h->cache.expires))
+    report(h, "ok");
+}
+
+static void header_last_modified(struct httplint *h, const char *s)
+{
+  double diff;
+  time_t time0, time1;
+
+  time0 = time(0);
+  if (!parse_date(h, s, &time1))
+    return;
+  if (strlen(s) < sizeof h->cache.last_modified)
+    strcpy(h->cache.last_modified, s);
+
+  diff = difftime(time1, time0);
+  if (10 < diff)
+    report(h, "futurelastmod");
+  else
+    report(h, "ok");
+}
+
+static void header_location(struct httplint *h, const char *s)
+{
+  int r;
+  r = regexec(&re_absolute_uri, s, 0, 0, 0);
+  if (r)
+    report(h, "badlocation");
+  else
+    report(h, "ok");
+}
+
+static void header_pragma(struct httplint *h, const char *s)
+{
+  if (parse_list(h, s, &re_token_value, 1, UINT_MAX, 0))
+    report(h, "ok");
+  else
+    report(h, "badpragma");
+}
+
+static void header_retry_after(struct httplint *h, const char *s)
+{
+  time_t t;
+
+  if (s[0] != 0 && strspn(s, NUMBER) == strlen(s)) {
+    report(h, "ok");
+    return;
+  }
+
+  if (!parse_date(h, s, &t))
+    return;
+
+  report(h, "ok");
+}
+
+static void header_server(struct httplint *h, const char *s)
+{
+  int r;
+  r = regexec(&re_server, s, 0, 0, 0);
+  if (r)
+    report(h, "badserver");
+  else
+    report(h, "ok");
+}
+
+static void header_trailer(struct httplint *h, const char *s)
+{
+  if (parse_list(h, s, &re_token, 1, UINT_MAX, 0))
+    report(h, "ok");
+  else
+    report(h, "badtrailer");
+}
+
+static void header_transfer_encoding(struct httplint *h, const char *s)
+{
+  if (parse_list(h, s, &re_transfer_coding, 1, UINT_MAX,
+      header_transfer_encoding_callback))
+    report(h, "ok");
+  else
+    report(h, "badtransenc");
+}
+
+char transfer_coding_list[][20] = {
+  "chunked", "compress", "deflate", "gzip", "identity"
+};
+
+static void header_transfer_encoding_callback(struct httplint *h, const char *s,
+    regmatch_t pmatch[])
+{
+  size_t len = pmatch[1].rm_eo - pmatch[1].rm_so;
+  char name[20];
+  char *dir;
+
+  if (19 < len) {
+    report(h, "unknowntransenc");
+    return;
+  }
+
+  strncpy(name, s + pmatch[1].rm_so, len);
+  name[len] = 0;
+
+  dir = bsearch(name, transfer_coding_list,
+      sizeof transfer_coding_list / sizeof transfer_coding_list[0],
+      sizeof transfer_coding_list[0],
+      (int (*)(const void *, const void *)) strcasecmp);
+  if (!dir) {
+    detail(h, HTTPLINT_WARNING, "Transfer-Encoding '%s':", name);
+    report(h, "unknowntransenc");
+  }
+}
+
+static void header_upgrade(struct httplint *h, const char *s)
+{
+  int r;
+  r = regexec(&re_upgrade, s, 0, 0, 0);
+  if (r)
+    report(h, "badupgrade");
+  else
+    report(h, "ok");
+}
+
+static void header_vary(struct httplint *h, const char *s)
+{
+  if (strcmp(s, "*") == 0)
+    h->cache.vary_star = true;
+  if (h->cache.vary_star ||
+      parse_list(h, s, &re_token, 1, UINT_MAX, header_vary_callback))
+    report(h, "ok");
+  else
+    report(h, "badvary");
+}
+
+/* headers with so many values that varying on them defeats caching */
+static void header_vary_callback(struct httplint *h, const char *s,
+    regmatch_t pmatch[])
+{
+  size_t len = pmatch[1].rm_eo - pmatch[1].rm_so;
+
+  h->cache.vary_count++;
+  if ((len == 10 && strncasecmp(s, "User-Agent", len) == 0) ||
+      (len == 6 && strncasecmp(s, "Cookie", len) == 0))
+    h->cache.vary_explosive++;
+}
+
+static void header_via(struct httplint *h, const char *s)
+{
+  UNUSED(s);
+  report(h, "via");
+}
+
+/* http://wp.netscape.com/newsref/std/cookie_spec.html */
+static void header_set_cookie(struct httplint *h, const char *s)
+{
+  bool ok = true;
+  int r;
+  char field[400];
+  size_t len;
+  double diff;
+  time_t time0, time1;
+  struct set_cookie *cookie = 0;
+
+  h->cache.set_cookie = true;
+
+  len = cookie_field(field, sizeof field, s);
+  r = regexec(&re_cookie_nameval, field, 0, 0, 0);
+  if (r) {
+    report(h, "cookiebadnameval");
+    ok = false;
+  } else if (h->set_count != COOKIE_MAX) {
+    cookie = &h->set[h->set_count++];
+    memset(cookie, 0, sizeof *cookie);
+    snprintf(cookie->name, sizeof cookie->name, "%.*s",
+        (int) strcspn(field, "="), field);
+    cookie->size = len;
+  }
+
+  for (s += len; *s == ';' && *(s = skip_lws(s + 1)); s += len) {
+    len = cookie_field(field, sizeof field, s);
+
+    if (strncasecmp(field, "expires=", 8) == 0) {
+      if (date_lookup(h, field + 8, true, &time1) == DATE_COOKIE) {
+        time0 = time(0);
+        diff = difftime(time0, time1);
+        if (10 < diff) {
+          report(h, "cookiepastdate");
+          ok = false;
+          if (cookie)
+            cookie->removed = true;
+        }
+      } else {
+        report(h, "cookiebaddate");
+        ok = false;
+      }
+    } else if (strncasecmp(field, "domain=", 7) == 0) {
+      if (cookie)
+        snprintf(cookie->domain, sizeof cookie->domain, "%s",
+            field + 7 + (field[7] == '.'));
+    } else if (strncasecmp(field, "path=", 5) == 0) {
+      if (field[5] != '/') {
+        report(h, "cookiebadpath");
+        ok = false;
+      } else if (cookie) {
+        snprintf(cookie->path, sizeof cookie->path, "%.*s",
+            (int) sizeof cookie->path - 1, field + 5);
+      }
+    } else if (strncasecmp(field, "max-age=", 8) == 0) {
+      /* RFC 6265 */
+      if (cookie && atol(field + 8) <= 0)
+        cookie->removed = true;
+    } else if (strcasecmp(field, "secure") == 0 ||
+        strcasecmp(field, "httponly") == 0 ||
+        strncasecmp(field, "samesite=", 9) == 0) {
+    } else {
+      detail(h, HTTPLINT_WARNING, "Set-Cookie field '%s':", field);
+      report(h, "cookieunknownfield");
+      ok = false;
+    }
+  }
+
+  if (ok)
+    report(h, "ok");
+}
+
+
+/**
+ * Copy the Set-Cookie field at S, up to the next ;, into FIELD, cutting it
+ * short if it does not fit. Returns the length of the whole field.
+ */
+static size_t cookie_field(char *field, size_t size, const char *s)
+{
+  size_t len = strcspn(s, ";");
+
+  snprintf(field, size, "%.*s", (int) len, s);
+  return len;
+}
+
+
+/**
+ * Keep a Set-Cookie too long to be checked for HTTPLINT_COOKIES all the
+ * same, as large cookies are the ones that matter there.
+ */
+static void keep_long_cookie(struct httplint *h, const char *line,
+    size_t len)
+{
+  char field[400], *copy;
+  const char *s;
+  struct set_cookie *cookie;
+  size_t n;
+
+  if (!h->cookies || h->set_count == COOKIE_MAX || len < 11 ||
+      strncasecmp(line, "Set-Cookie:", 11))
+    return;
+  copy = strndup(line + 11, len - 11);
+  if (!copy)
+    return;
+  s = skip_lws(copy);
+  n = strcspn(s, ";");
+  if (memchr(s, '=', n)) {
+    cookie = &h->set[h->set_count++];
+    memset(cookie, 0, sizeof *cookie);
+    snprintf(cookie->name, sizeof cookie->name, "%.*s",
+        (int) strcspn(s, "="), s);
+    cookie->size = n;
+    for (s += n; *s == ';'; s += n) {
+      s = skip_lws(s + 1);
+      n = cookie_field(field, sizeof field, s);
+      if (strncasecmp(field, "domain=", 7) == 0)
+        snprintf(cookie->domain, sizeof cookie->domain, "%s",
+            field + 7 + (field[7] == '.'));
+      else if (strncasecmp(field, "path=", 5) == 0 && field[5] == '/')
+        snprintf(cookie->path, sizeof cookie->path, "%.*s",
+            (int) sizeof cookie->path - 1, field + 5);
+      else if (strncasecmp(field, "max-age=", 8) == 0 &&
+          atol(field + 8) <= 0)
+        cookie->removed = true;
+    }
+  }
+  free(copy);
+}
+
+
+/**
+ * Add the cookies the response set to those of its site, then report what
+ * the site's cookies cost a request for the url, and any cookie of the same
+ * name set for two paths or domains.
+ */
+static void check_cookies(struct httplint *h, const char *url)
+{
+  const char *path;
+  const struct jar_cookie *cookie, *other;
+  unsigned int i, j, n, all;
+  size_t bytes;
+  int site;
+
+  if (h->set_count == 0 || (site = find_site(h, url, &path)) < 0)
+    return;
+
+  for (i = 0; i != h->set_count; i++) {
+    cookie = jar_set(h, site, &h->set[i], path);
+    for (j = 0; cookie && j != h->jar_count; j++) {
+      other = &h->jar[j];
+      if (other == cookie || other->site != cookie->site ||
+          strcmp(other->name, cookie->name))
+        continue;
+      detail(h, HTTPLINT_WARNING, "Cookie '%s' is also set for path '%s'%s%s:",
+          cookie->name, other->path, other->domain[0] ? " and domain " : "",
+          other->domain);
+      report(h, "cookieduplicate");
+    }
+  }
+
+  bytes = cookie_bytes(h, site, path, &n);
+  for (i = all = 0; i != h->jar_count; i++)
+    all += h->jar[i].site == (unsigned int) site;
+  detail(h, HTTPLINT_NOTE, "Cookies: %u of the %u held for %s are sent with "
+      "requests for this url, a Cookie header of %zu bytes.", n, all,
+      h->sites[site], bytes);
+  if (PACKET < REQUEST_BASE + bytes)
+    report(h, "cookiepacket");
+}
+
+
+/**
+ * The index of the site (host) of an http url, adding it if it is new, and
+ * in PATH its path. Returns -1 for anything else, or if out of memory.
+ */
+static int find_site(struct httplint *h, const char *url, const char **path)
+{
+  const char *host = strstr(url, "://"), *end, *at;
+  char **sites, *name;
+  size_t len;
+  unsigned int i;
+
+  if (!host)
+    return -1;
+  host += 3;
+  end = host + strcspn(host, "/?#");
+  *path = *end == '/' ? end : "/";
+  at = memchr(host, '@', end - host);
+  if (at)
+    host = at + 1;
+  len = strcspn(host, ":/?#");
+
+  for (i = 0; i != h->site_count; i++)
+    if (strncasecmp(h->sites[i], host, len) == 0 && !h->sites[i][len])
+      return i;
+
+  name = malloc(len + 1);
+  sites = realloc(h->sites, (h->site_count + 1) * sizeof *sites);
+  if (!name || !sites) {
+    free(name);
+    if (sites)
+      h->sites = sites;
+    return -1;
+  }
+  for (i = 0; i != len; i++)
+    name[i] = tolower((unsigned char) host[i]);
+  name[len] = 0;
+  h->sites = sites;
+  h->sites[h->site_count] = name;
+  return h->site_count++;
+}
+
+
+/**
+ * Store a cookie for a site as a browser would, replacing one of the same
+ * name, domain and path, or remove it. A cookie without a path gets the
+ * directory of the url that set it [RFC 6265 5.1.4]. Returns the stored
+ * cookie, or 0 if it was removed or memory ran out.
+ */
+static const struct jar_cookie *jar_set(struct httplint *h,
+    unsigned int site, const struct set_cookie *c, const char *path)
+{
+  struct jar_cookie *jar, cookie;
+  unsigned int i;
+  size_t len;
+
+  memset(&cookie, 0, sizeof cookie);
+  cookie.site = site;
+  strcpy(cookie.name, c->name);
+  strcpy(cookie.domain, c->domain);
+  cookie.size = c->size;
+  if (c->path[0]) {
+    strcpy(cookie.path, c->path);
+  } else {
+    len = strcspn(path, "?#");
+    while (len && path[len - 1] != '/')
+      len--;
+    if (1 < len)
+      len--;
+    snprintf(cookie.path, sizeof cookie.path, "%.*s", (int) (len ? len : 1),
+        len ? path : "/");
+  }
+
+  for (i = 0; i != h->jar_count; i++) {
+    if (h->jar[i].site == site && strcmp(h->jar[i].name, cookie.name) == 0 &&
+        strcmp(h->jar[i].domain, cookie.domain) == 0 &&
+        strcmp(h->jar[i].path, cookie.path) == 0)
+      break;
+  }
+
+  if (c->removed) {
+    if (i != h->jar_count)
+      h->jar[i] = h->jar[--h->jar_count];
+    return 0;
+  }
+
+  if (i == h->jar_count) {
+    jar = realloc(h->jar, (h->jar_count + 1) * sizeof *jar);
+    if (!jar)
+      return 0;
+    h->jar = jar;
+    h->jar_count++;
+  }
+  h->jar[i] = cookie;
+  return &h->jar[i];
+}
+
+
+/**
+ * Whether a cookie for COOKIE_PATH is sent with a request for PATH
+ * [RFC 6265 5.1.4].
+ */
+static bool path_match(const char *cookie_path, const char *path)
+{
+  size_t len = strlen(cookie_path);
+
+  return strncmp(cookie_path, path, len) == 0 &&
+      (cookie_path[len - 1] == '/' || path[len] == 0 || path[len] == '/' ||
+      path[len] == '?' || path[len] == '#');
+}
+
+
+/**
+ * The size of the Cookie header, CR LF and all, that a request for PATH on
+ * a site carries, and in N how many cookies are in it.
+ */
+static size_t cookie_bytes(const struct httplint *h, unsigned int site,
+    const char *path, unsigned int *n)
+{
+  size_t bytes = 0;
+  unsigned int i;
+
+  *n = 0;
+  for (i = 0; i != h->jar_count; i++) {
+    if (h->jar[i].site != site || !path_match(h->jar[i].path, path))
+      continue;
+    bytes += h->jar[i].size + (*n ? 2 : 0);
+    (*n)++;
+  }
+  return *n ? strlen("Cookie: ") + bytes + 2 : 0;
+}
+
+
+static const struct message_entry {
+  const char key[20];
+  const char *value;
+} message_table[] = {
+  { "1xx", "A response status code in the range 100 - 199 indicates a "
+           "'provisional response'." },
+  { "2xx", "A response status code in the range 200 - 299 indicates that "
+           "the request was successful." },
+  { "3xx", "A response status code in the range 300 - 399 indicates that "
+           "the client should redirect to a new URL." },
+  { "4xx", "A response status code in the range 400 - 499 indicates that "
+           "the request could not be fulfilled due to client error." },
+  { "5xx", "A response status code in the range 500 - 599 indicates that "
+           "an error occurred on the server." },
+  { "asctime", "Warning: This date is in the obsolete asctime() format. "
+               "Consider using the RFC 1123 format instead." },
+  { "badage", "Error: The Age header must be one number." },
+  { "badallow", "Error: The Allow header must be a comma-separated list of "
+                "HTTP methods." },
+  { "badcachecont", "Error: The Cache-Control header must be a "
+                    "comma-separated list of directives." },
+  { "badconnection", "Warning: The only value of the Connection header "
+                     "defined by HTTP/1.1 is \"close\"." },
+  { "badcontenc", "Error: The Content-Encoding header must be a "
+                  "comma-separated list of encodings." },
+  { "badcontenttype", "Error: The Content-Type header must be of the form "
+                      "'type/subtype (; optional parameters)'." },
+  { "badcontlang", "Error: The Content-Language header must be a "
+                   "comma-separated list of language tags." },
+  { "badcontlen", "Error: The Content-Length header must be a number." },
+  { "badcontloc", "Error: The Content-Location header must be an absolute "
+                  "or relative URI." },
+  { "badcontmd5", "Error: The Content-MD5 header must be a base64 encoded "
+                  "MD5 sum." },
+  { "baddate", "Error: Failed to parse this date. Dates should be in the RFC "
+               "1123 format." },
+  { "badetag", "Error: The ETag header must be a quoted string (optionally "
+               "preceded by \"W/\" for a weak tag)." },
+  { "badlocation", "Error: The Location header must be an absolute URI. "
+                   "Relative URIs are not permitted." },
+  { "badpragma", "Error: The Pragma header must be a comma-separated list of "
+                 "directives." },
+  { "badserver", "Error: The Server header must be a space-separated list of "
+                 "products of the form Name/optional-version and comments "
+                 "in ()." },
+  { "badstatus", "Warning: The response status code is outside the standard "
+                 "range 100 - 599." },
+  { "badstatusline", "Error: Failed to parse the response Status-Line. The "
+                     "status line must be of the form 'HTTP/n.n <3-digit "
+                     "status> <reason phrase>'." },
+  { "badtrailer", "Error: The Trailer header must be a comma-separated list "
+                  "of header names." },
+  { "badtransenc", "Error: The Transfer-Encoding header must be a "
+                   "comma-separated of encodings." },
+  { "badupgrade", "Error: The Upgrade header must be a comma-separated list "
+                  "of product identifiers." },
+  { "badvary", "Error: The Vary header must be a comma-separated list "
+                  "of header names, or \"*\"." },
+  { "bodyencoding", "Error: The body could not be decoded with the "
+                    "Content-Encoding given for it." },
+  { "bodylength", "Error: The length of the body differs from the "
+                  "Content-Length header. A client keeping the connection "
+                  "alive will wait for data that never comes, or read the "
+                  "rest as the next response." },
+  { "bodymd5", "Error: The MD5 digest of the body differs from the "
+               "Content-MD5 header." },
+  { "bodypoorcomp", "Warning: The Content-Encoding saves less than 10% of "
+                    "the size of this body, which costs both sides time "
+                    "for little gain. Consider not encoding this type." },
+  { "bodyshort", "Error: The connection closed or stalled before the whole "
+                 "body arrived." },
+  { "bodyuncompressed", "Warning: This body is sent without a "
+                        "Content-Encoding, although the client accepts gzip "
+                        "and deflate and the body would shrink by at least "
+                        "20%." },
+  { "cachecookie", "Warning: This response sets a cookie without "
+                   "Cache-Control: public or s-maxage, so many shared caches "
+                   "and CDNs will not store it." },
+  { "cachenofresh", "Warning: No freshness lifetime was given (max-age, "
+                    "s-maxage or Expires), or it is zero. Caches must "
+                    "revalidate every request or guess a lifetime "
+                    "heuristically." },
+  { "cachenostore", "Warning: Cache-Control: no-store forbids every cache "
+                    "from keeping this response, so every request reaches "
+                    "the server." },
+  { "cachenot304", "Error: The response has a validator, but a conditional "
+                   "request using it did not return 304 Not Modified, so "
+                   "stale copies are always fetched in full." },
+  { "cachenovalidator", "Warning: No ETag or Last-Modified header was "
+                        "present, so a stale copy cannot be revalidated "
+                        "cheaply and is fetched in full." },
+  { "cacheprivate", "Warning: Cache-Control: private keeps shared caches "
+                    "and CDNs from storing this response." },
+  { "cachevary", "Warning: This Vary header splits the cache into many "
+                 "variants (Vary: *, User-Agent, Cookie or more than two "
+                 "headers), so most requests miss." },
+  { "contentrange", "Warning: The Content-Range header should not be returned "
+                    "by the server for this request." },
+  { "cookiebaddate", "Error: The expires date must be in the form "
+                     "\"Wdy, DD-Mon-YYYY HH:MM:SS GMT\"." },
+  { "cookiebadnameval", "Error: A Set-Cookie header must start with "
+                        "name=value, each excluding semi-colon, comma and "
+                        "white space." },
+  { "cookiebadpath", "Error: The path does not start with \"/\"." },
+  { "cookieduplicate", "Warning: This site already has a cookie of this "
+                       "name for another path or domain. Requests that "
+                       "match both carry both copies, and the server cannot "
+                       "tell which is which." },
+  { "cookiepacket", "Warning: With the cookies set so far, a typical request "
+                    "for this URL no longer fits in one packet (1460 bytes "
+                    "of TCP payload at a 1500 byte MTU). Every request to "
+                    "the site carries them, so consider fewer or smaller "
+                    "cookies, or serving static files from a cookieless "
+                    "domain." },
+  { "cookiepastdate", "Warning: The expires date is in the past. The cookie "
+                      "will be deleted by browsers." },
+  { "cookieunknownfield", "Warning: This is not a standard Set-Cookie "
+                          "field." },
+  { "endofheaders", "End of headers." },
+  { "futurehttp", "Warning: I only understand HTTP/1.1. Check for a newer "
+                  "version of this tool." },
+  { "futurelastmod", "Error: The specified Last-Modified date-time is in "
+                     "the future." },
+  { "headertoolong", "Warning: Header too long: ignored." },
+  { "missingcolon", "Error: Headers must be of the form 'Name: value'." },
+  { "missingcontenttype", "Warning: No Content-Type header was present. The "
+                          "client will have to guess the media type or ask "
+                          "the user. Adding a Content-Type header is strongly "
+                          "recommended." },
+  { "missingcontlang", "Consider adding a Content-Language header if "
+                       "applicable for this document." },
+  { "missingdate", "Warning: No Date header was present. A Date header must "
+                   "be present, unless the server does not have a clock, or "
+                   "the response is 100, 101, or 500 - 599." },
+  { "missinglastmod", "No Last-Modified header was present. The "
+                      "HTTP/1.1 specification states that this header should "
+                      "be sent whenever feasible." },
+  { "nocharset", "Warning: No character set is specified in the Content-Type. "
+                 "Clients may assume the default of ISO-8859-1. Consider "
+                 "appending '; charset=...'." },
+  { "nonstandard", "Warning: I don't know anything about this header. Is it "
+                   "a standard HTTP response header?" },
+  { "notcrlf", "Error: This header line does not end in CR LF. HTTP requires "
+               "that all header lines end with CR LF." },
+  { "ok", "OK." },
+  { "oldhttp", "Warning: This version of HTTP is obsolete. Consider upgrading "
+               "to HTTP/1.1." },
+  { "rfc1036", "Warning: This date is in the obsolete RFC 1036 format. "
+               "Consider using the RFC 1123 format instead." },
+  { "ugly", "This URL appears to contain implementation-specific parts such "
+            "as an extension or a query string. This may make the URL liable "
+            "to change when the implementation is changed, resulting in "
+            "broken links. Consider using URL rewriting or equivalent to "
+            "implement a future-proof URL space. See "
+            "http://www.w3.org/Provider/Style/URI for more information." },
+  { "unknowncachecont", "Warning: This Cache-Control directive is "
+                        "non-standard and will have limited support." },
+  { "unknowncontenc", "Warning: This is not a standard Content-Encoding." },
+  { "unknownrange", "Warning: This range unit is not a standard HTTP/1.1 "
+                    "range." },
+  { "unknowntransenc", "Warning: This is not a standard Transfer-Encoding." },
+  { "via", "This header was added by a proxy, cache or gateway." },
+  { "wrongdate", "Warning: The server date-time differs from this system's "
+                 "date-time by more than 10 seconds. Check that both the "
+                 "system clocks are correct." },
+  { "xheader", "This is an extension header. I don't know how to check it." }
+};
+
+
+/**
+ * Pass the message referenced by a key to the sink.
+ */
+static void report(struct httplint *h, const char *key)
+{
+  const struct message_entry *message;
+  const char *s;
+  enum httplint_level level = HTTPLINT_NOTE;
+
+  message = bsearch(key, message_table,
+      sizeof message_table / sizeof message_table[0],
+      sizeof message_table[0],
+      (int (*)(const void *, const void *)) strcasecmp);
+  if (message)
+    s = message->value;
+  else
+    s = key;
+
+  if (strncmp(s, "Warning:", 8) == 0)
+    level = HTTPLINT_WARNING;
+  else if (strncmp(s, "Error:", 6) == 0)
+    level = HTTPLINT_ERROR;
+  else if (strncmp(s, "OK", 2) == 0)
+    level = HTTPLINT_OK;
+
+  h->sink(h->arg, level, key, s);
+}
+
+
+/**
+ * Pass a detail line, such as the name a following message is about, to
+ * the sink.
+ */
+static void detail(struct httplint *h, enum httplint_level level,
+    const char *format, ...)
+{
+  char s[400];
+  va_list ap;
+
+  va_start(ap, format);
+  vsnprintf(s, sizeof s, format, ap);
+  va_end(ap);
+
+  h->sink(h->arg, level, 0, s);
+}
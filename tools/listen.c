@@ -0,0 +1,600 @@
+/*
+ * Listening socket helper for wwwoosh
+ * Licensed under the MIT License
+ *                http://www.opensource.org/licenses/mit-license
+ */
+
+/*
+ * Compile using
+ *   gcc -W -Wall -O2 -o listen listen.c
+ *
+ * Usage:
+ *   listen ADDRESS [ADDRESS ...] COMMAND [ARG ...]
+ *       bind a listening socket on each ADDRESS, which is a TCP port or
+ *       unix:PATH for a Unix domain socket, leave them open on fds 3, 4, ...
+ *       with WWWOOSH_LISTEN_FD=3 and WWWOOSH_LISTEN_FDS=<count> in the
+ *       environment, and exec COMMAND
+ *   listen accept [-g FILE] [-a FILE [-r RATE] [-b BURST] [-m MAX]]
+ *       take one connection from the listening sockets on WWWOOSH_LISTEN_FD
+ *       onwards and relay it like netcat: what the client sends goes to
+ *       stdout, and stdin goes back to the client until it reaches end of
+ *       file. With -g, give up without taking a connection (exit 3) once
+ *       FILE is gone.
+ *
+ *       With -a, connections are first admitted against the shared state in
+ *       FILE: each client address gets a token bucket refilled at RATE
+ *       requests per second up to BURST, and at most MAX connections are
+ *       relayed at once across all workers. A connection over either limit
+ *       is answered straight away with 429 or 503 and a Retry-After header,
+ *       and the helper goes back to accepting, so the app never runs for it.
+ *       A RATE or MAX of 0 turns that limit off.
+ *
+ * The sockets are bound once and then inherited by every worker and by
+ * every later generation of the server, so they are never closed while the
+ * server reloads. Sockets passed in by a supervisor such as systemd
+ * (LISTEN_FDS) are used the same way. They are made non-blocking, so
+ * workers that lose the race for a connection go back to waiting instead of
+ * blocking in accept().
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+
+
+#define LISTEN_FD 3
+#define MAX_LISTEN_FDS 16
+#define BACKLOG 128
+#define BUFFER_SIZE 65536
+#define GENERATION_CHECK_MS 1000
+#define LINGER_MS 2000
+#define EXIT_STOPPED 3
+
+#define ADMISSION_MAGIC 0x61646d74
+#define SETS 1024
+#define WAYS 8
+#define SLOTS 1024
+#define TOKEN 1000000
+#define REJECT_LINGER_MS 100
+
+/* a client's token bucket; tokens are in millionths of a request */
+struct client {
+  unsigned char address[16];
+  int64_t tokens;
+  int64_t updated;
+};
+
+/* clients hash to a set and take any of its ways, evicting the stalest */
+struct set {
+  uint32_t lock;
+  struct client way[WAYS];
+};
+
+struct admission {
+  uint32_t magic;
+  uint32_t sets;
+  uint32_t in_flight[SLOTS];
+  struct set set[SETS];
+};
+
+struct admission *admission;
+int64_t rate, burst;
+unsigned int max_in_flight;
+int slot = -1;
+
+int is_address(const char *arg);
+int bind_port(const char *port);
+int bind_unix(const char *path);
+void move_fd(int s, int fd);
+int accept_one(int fd, int count, const char *generation);
+void open_admission(const char *path);
+int admit(int s, int *retry_after);
+bool take_token(const unsigned char *address, int *retry_after);
+bool claim_slot(void);
+void release_slot(void);
+void reject(int s, int status, int retry_after);
+int64_t now_us(void);
+void relay(int s);
+void die(const char *error);
+
+
+/**
+ * Main entry point.
+ */
+int main(int argc, char *argv[])
+{
+  const char *generation = 0, *state = 0, *fd, *count;
+  char value[16];
+  int s, n, c, status, retry_after;
+
+  if (argc >= 2 && strcmp(argv[1], "accept") == 0) {
+    burst = -1;
+    while ((c = getopt(argc - 1, argv + 1, "g:a:r:b:m:")) != -1) {
+      switch (c) {
+        case 'g': generation = optarg; break;
+        case 'a': state = optarg; break;
+        case 'r': rate = strtod(optarg, 0) * TOKEN; break;
+        case 'b': burst = strtod(optarg, 0) * TOKEN; break;
+        case 'm': max_in_flight = atoi(optarg); break;
+        default:
+          die("Usage: listen accept [-g FILE] [-a FILE [-r RATE] [-b BURST] "
+              "[-m MAX]]");
+      }
+    }
+    if (burst < 0)
+      burst = rate < TOKEN ? TOKEN : rate;
+    if (SLOTS < max_in_flight)
+      max_in_flight = SLOTS;
+    if (state)
+      open_admission(state);
+
+    fd = getenv("WWWOOSH_LISTEN_FD");
+    count = getenv("WWWOOSH_LISTEN_FDS");
+    while (1) {
+      s = accept_one(fd ? atoi(fd) : LISTEN_FD, count ? atoi(count) : 1,
+          generation);
+      if (s == -1)
+        return EXIT_STOPPED;
+      if (!admission)
+        break;
+      status = admit(s, &retry_after);
+      if (status == 0)
+        break;
+      reject(s, status, retry_after);
+    }
+    relay(s);
+    release_slot();
+    return 0;
+  }
+
+  for (n = 0; n + 1 < argc && is_address(argv[n + 1]); n++) {
+    if (n == MAX_LISTEN_FDS)
+      die("Too many addresses");
+    if (strncmp(argv[n + 1], "unix:", 5) == 0)
+      s = bind_unix(argv[n + 1] + 5);
+    else
+      s = bind_port(argv[n + 1]);
+    move_fd(s, LISTEN_FD + n);
+  }
+  if (n == 0 || n + 1 == argc)
+    die("Usage: listen ADDRESS... COMMAND [ARG ...] | "
+        "listen accept [-g FILE]");
+
+  snprintf(value, sizeof value, "%i", LISTEN_FD);
+  setenv("WWWOOSH_LISTEN_FD", value, 1);
+  snprintf(value, sizeof value, "%i", n);
+  setenv("WWWOOSH_LISTEN_FDS", value, 1);
+  execvp(argv[n + 1], argv + n + 1);
+  die(strerror(errno));
+  return 1;
+}
+
+
+/**
+ * Whether a command line argument is a port number or unix:PATH.
+ */
+int is_address(const char *arg)
+{
+  if (strncmp(arg, "unix:", 5) == 0)
+    return arg[5] != 0;
+  return *arg && strspn(arg, "0123456789") == strlen(arg);
+}
+
+
+/**
+ * Listen on PORT on all addresses, IPv6 and IPv4 where possible.
+ */
+int bind_port(const char *port)
+{
+  struct sockaddr_in6 addr6;
+  struct sockaddr_in addr;
+  int s, on = 1, off = 0;
+
+  memset(&addr6, 0, sizeof addr6);
+  addr6.sin6_family = AF_INET6;
+  addr6.sin6_addr = in6addr_any;
+  addr6.sin6_port = htons(atoi(port));
+
+  s = socket(AF_INET6, SOCK_STREAM, 0);
+  if (s != -1) {
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+    setsockopt(s, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof off);
+    if (bind(s, (struct sockaddr *) &addr6, sizeof addr6)) {
+      close(s);
+      s = -1;
+    }
+  }
+
+  if (s == -1) {
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(atoi(port));
+
+    s = socket(AF_INET, SOCK_STREAM, 0);
+    if (s == -1)
+      die(strerror(errno));
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+    if (bind(s, (struct sockaddr *) &addr, sizeof addr))
+      die(strerror(errno));
+  }
+
+  if (listen(s, BACKLOG))
+    die(strerror(errno));
+  return s;
+}
+
+
+/**
+ * Listen on a Unix domain socket at PATH, replacing a stale socket left
+ * there by an earlier run.
+ */
+int bind_unix(const char *path)
+{
+  struct sockaddr_un addr;
+  struct stat st;
+  int s;
+
+  if (sizeof addr.sun_path <= strlen(path))
+    die("Socket path too long");
+  memset(&addr, 0, sizeof addr);
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+    unlink(path);
+
+  s = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (s == -1)
+    die(strerror(errno));
+  if (bind(s, (struct sockaddr *) &addr, sizeof addr))
+    die(strerror(errno));
+  if (listen(s, BACKLOG))
+    die(strerror(errno));
+  return s;
+}
+
+
+/**
+ * Move a socket to the given descriptor.
+ */
+void move_fd(int s, int fd)
+{
+  if (s != fd) {
+    if (dup2(s, fd) == -1)
+      die(strerror(errno));
+    close(s);
+  }
+}
+
+
+/**
+ * Wait for and accept one connection on any of COUNT sockets from FD on.
+ * Returns -1 without accepting if the generation file is removed while
+ * waiting.
+ */
+int accept_one(int fd, int count, const char *generation)
+{
+  struct pollfd p[MAX_LISTEN_FDS];
+  int i, s;
+
+  if (count < 1 || MAX_LISTEN_FDS < count)
+    die("Bad WWWOOSH_LISTEN_FDS");
+  for (i = 0; i != count; i++) {
+    p[i].fd = fd + i;
+    p[i].events = POLLIN;
+    /* sockets from a supervisor may still be blocking */
+    fcntl(fd + i, F_SETFL, fcntl(fd + i, F_GETFL) | O_NONBLOCK);
+  }
+
+  while (1) {
+    if (generation && access(generation, F_OK))
+      return -1;
+    if (poll(p, count, generation ? GENERATION_CHECK_MS : -1) <= 0)
+      continue;
+
+    for (i = 0; i != count; i++) {
+      if (!p[i].revents)
+        continue;
+      s = accept(p[i].fd, 0, 0);
+      if (s != -1)
+        return s;
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR &&
+          errno != ECONNABORTED)
+        die(strerror(errno));
+    }
+  }
+}
+
+
+/**
+ * Map the shared admission state, creating it if necessary.
+ */
+void open_admission(const char *path)
+{
+  struct stat st;
+  uint32_t expected = 0;
+  int fd;
+
+  fd = open(path, O_RDWR | O_CREAT, 0600);
+  if (fd == -1)
+    die(strerror(errno));
+  if (fstat(fd, &st))
+    die(strerror(errno));
+  if ((size_t) st.st_size < sizeof *admission &&
+      ftruncate(fd, sizeof *admission))
+    die(strerror(errno));
+
+  admission = mmap(0, sizeof *admission, PROT_READ | PROT_WRITE, MAP_SHARED,
+      fd, 0);
+  if (admission == MAP_FAILED)
+    die(strerror(errno));
+  close(fd);
+
+  if (__atomic_compare_exchange_n(&admission->magic, &expected,
+      ADMISSION_MAGIC, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    admission->sets = SETS;
+  else if (expected != ADMISSION_MAGIC)
+    die("Not an admission state file");
+}
+
+
+/**
+ * Decide whether to serve a new connection: 0 to admit it, or the status
+ * to reject it with.
+ */
+int admit(int s, int *retry_after)
+{
+  struct sockaddr_storage peer;
+  socklen_t len = sizeof peer;
+  unsigned char address[16];
+
+  memset(address, 0, sizeof address);
+  if (getpeername(s, (struct sockaddr *) &peer, &len) == 0) {
+    if (peer.ss_family == AF_INET6) {
+      memcpy(address, &((struct sockaddr_in6 *) &peer)->sin6_addr, 16);
+      /* treat an IPv4-mapped address like the IPv4 one */
+      if (IN6_IS_ADDR_V4MAPPED((struct in6_addr *) address)) {
+        memmove(address, address + 12, 4);
+        memset(address + 4, 0, 12);
+      }
+    } else if (peer.ss_family == AF_INET) {
+      memcpy(address, &((struct sockaddr_in *) &peer)->sin_addr, 4);
+    }
+    /* Unix socket clients all share the all-zero address */
+  }
+
+  if (rate && !take_token(address, retry_after))
+    return 429;
+  if (max_in_flight && !claim_slot()) {
+    *retry_after = 1;
+    return 503;
+  }
+  return 0;
+}
+
+
+/**
+ * Take a token from the client's bucket, refilling it for the time since
+ * it was last used. On failure, sets how many seconds until a token is due.
+ */
+bool take_token(const unsigned char *address, int *retry_after)
+{
+  uint64_t h = 14695981039346656037ULL;
+  int64_t t = now_us(), tokens;
+  struct client *c = 0, *w;
+  uint32_t unlocked;
+  struct set *set;
+  bool ok;
+  int i;
+
+  for (i = 0; i != 16; i++)
+    h = (h ^ address[i]) * 1099511628211ULL;
+  set = &admission->set[h % SETS];
+
+  do {
+    unlocked = 0;
+  } while (!__atomic_compare_exchange_n(&set->lock, &unlocked, 1, true,
+      __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+
+  for (i = 0; i != WAYS; i++) {
+    w = &set->way[i];
+    if (w->updated && memcmp(w->address, address, 16) == 0) {
+      c = w;
+      break;
+    }
+    if (!c || w->updated < c->updated)
+      c = w;
+  }
+  if (i == WAYS) {
+    /* a new client, in place of the one seen least recently */
+    memcpy(c->address, address, 16);
+    c->tokens = burst;
+    c->updated = t;
+  }
+
+  if (burst - c->tokens < (double) (t - c->updated) * rate / 1000000)
+    tokens = burst;
+  else
+    tokens = c->tokens + (t - c->updated) * rate / 1000000;
+  ok = TOKEN <= tokens;
+  if (ok)
+    tokens -= TOKEN;
+  else
+    *retry_after = 1 + (TOKEN - tokens) / rate;
+  c->tokens = tokens;
+  c->updated = t;
+
+  __atomic_store_n(&set->lock, 0, __ATOMIC_RELEASE);
+  return ok;
+}
+
+
+/**
+ * Count this connection in flight by claiming one of the first
+ * max_in_flight slots with our pid. Slots left by processes that died are
+ * taken over.
+ */
+bool claim_slot(void)
+{
+  uint32_t pid = getpid(), owner;
+  unsigned int i;
+
+  for (i = 0; i != max_in_flight; i++) {
+    owner = __atomic_load_n(&admission->in_flight[i], __ATOMIC_ACQUIRE);
+    if (owner && (kill(owner, 0) == 0 || errno != ESRCH))
+      continue;
+    if (__atomic_compare_exchange_n(&admission->in_flight[i], &owner, pid,
+        false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      slot = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+
+void release_slot(void)
+{
+  if (slot != -1)
+    __atomic_store_n(&admission->in_flight[slot], 0, __ATOMIC_RELEASE);
+  slot = -1;
+}
+
+
+/**
+ * Answer a connection that was not admitted, without reading the request.
+ */
+void reject(int s, int status, int retry_after)
+{
+  static const char body429[] = "Too many requests, slow down.\n";
+  static const char body503[] = "Server busy, try again shortly.\n";
+  char response[512], buffer[4096];
+  struct pollfd p;
+  int n;
+
+  n = snprintf(response, sizeof response,
+      "HTTP/1.1 %s\r\n"
+      "Retry-After: %i\r\n"
+      "Content-Type: text/plain\r\n"
+      "Content-Length: %zu\r\n"
+      "Connection: close\r\n"
+      "\r\n%s",
+      status == 429 ? "429 Too Many Requests" : "503 Service Unavailable",
+      retry_after, status == 429 ? sizeof body429 - 1 : sizeof body503 - 1,
+      status == 429 ? body429 : body503);
+  signal(SIGPIPE, SIG_IGN);
+  if (write(s, response, n) == n) {
+    /* let the request arrive so closing does not reset the connection */
+    shutdown(s, SHUT_WR);
+    p.fd = s;
+    p.events = POLLIN;
+    while (poll(&p, 1, REJECT_LINGER_MS) > 0 &&
+        read(s, buffer, sizeof buffer) > 0)
+      ;
+  }
+  close(s);
+}
+
+
+int64_t now_us(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+
+/**
+ * Copy the connection to stdout and stdin to the connection. Once stdin is
+ * done, the write side is shut down and whatever the client still sends is
+ * read and dropped for a moment, so closing does not reset the connection
+ * before the response has been read.
+ */
+void relay(int s)
+{
+  char buffer[BUFFER_SIZE];
+  struct pollfd p[2];
+  ssize_t n, w, off;
+  int out = 1;
+
+  signal(SIGPIPE, SIG_IGN);
+
+  p[0].fd = s;
+  p[0].events = POLLIN;
+  p[1].fd = 0;
+  p[1].events = POLLIN;
+
+  while (p[1].fd != -1) {
+    if (poll(p, 2, -1) == -1) {
+      if (errno == EINTR)
+        continue;
+      die(strerror(errno));
+    }
+
+    if (p[0].revents) {
+      n = read(s, buffer, sizeof buffer);
+      if (n <= 0) {
+        /* the client is done sending */
+        p[0].fd = -1;
+        if (out != -1)
+          close(out);
+        out = -1;
+      } else {
+        for (off = 0; out != -1 && off < n; off += w) {
+          w = write(out, buffer + off, n - off);
+          if (w <= 0) {
+            close(out);
+            out = -1;
+          }
+        }
+      }
+    }
+
+    if (p[1].revents) {
+      n = read(0, buffer, sizeof buffer);
+      if (n <= 0) {
+        p[1].fd = -1;
+        break;
+      }
+      for (off = 0; off < n; off += w) {
+        w = write(s, buffer + off, n - off);
+        if (w <= 0)
+          return;
+      }
+    }
+  }
+
+  shutdown(s, SHUT_WR);
+  if (p[0].fd != -1) {
+    while (poll(p, 1, LINGER_MS) > 0 && read(s, buffer, sizeof buffer) > 0)
+      ;
+  }
+  close(s);
+}
+
+
+/**
+ * Print an error message and exit.
+ */
+void die(const char *error)
+{
+  fprintf(stderr, "listen: %s\n", error);
+  exit(EXIT_FAILURE);
+}
@@ -0,0 +1,430 @@
+/*
+ * Shared-memory request metrics for martin
+ * Licensed under the MIT License
+ *                http://www.opensource.org/licenses/mit-license
+ */
+
+/*
+ * Compile using
+ *   gcc -W -Wall -O2 -o metrics metrics.c
+ *
+ * Usage:
+ *   metrics FILE begin
+ *       count a request as in flight and print a start stamp
+ *   metrics FILE end METHOD ROUTE STATUS START BYTES_IN BYTES_OUT
+ *       record a finished request against its route
+ *   metrics FILE dump [WORKERS]
+ *       print every counter in the Prometheus text format
+ *
+ * FILE is created on first use and mapped shared by every process, so all
+ * counters are updated with atomic adds and never take a lock. Routes are
+ * kept in a fixed open-addressing table; a slot is claimed once with a
+ * compare-and-swap and its name never changes after that.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+#define METRICS_MAGIC 0x6d747263
+#define ROUTES 256
+#define NAME_SIZE 112
+
+/* log-linear latency buckets: 4 linear steps per power of two, from
+ * 2^FIRST_OCTAVE ns (about 131us) to 2^LAST_OCTAVE ns (about 34s) */
+#define FIRST_OCTAVE 17
+#define LAST_OCTAVE 35
+#define STEPS 4
+#define BUCKETS ((LAST_OCTAVE - FIRST_OCTAVE) * STEPS + 2)
+
+#define SLOT_EMPTY 0
+#define SLOT_CLAIMED 1
+#define SLOT_READY 2
+
+struct route {
+  uint32_t state;
+  uint32_t hash;
+  char method[8];
+  char name[NAME_SIZE];
+  uint64_t requests;
+  uint64_t status[6];
+  uint64_t bytes_in;
+  uint64_t bytes_out;
+  uint64_t latency_sum;
+  uint64_t buckets[BUCKETS];
+};
+
+struct metrics {
+  uint32_t magic;
+  uint32_t routes_used;
+  uint64_t start;
+  int64_t in_flight;
+  uint64_t busy;
+  uint64_t requests;
+  uint64_t overflow;
+  struct route route[ROUTES];
+};
+
+struct metrics *m;
+
+
+void open_metrics(const char *path);
+uint64_t now(void);
+uint32_t hash_name(const char *method, const char *name);
+struct route *find_route(const char *method, const char *name);
+unsigned int bucket(uint64_t latency);
+uint64_t bucket_bound(unsigned int i);
+void record(int argc, char *argv[]);
+void dump(unsigned int workers);
+void print_label(const char *s);
+void die(const char *error);
+
+
+/**
+ * Main entry point.
+ */
+int main(int argc, char *argv[])
+{
+  if (argc < 3)
+    die("Usage: metrics FILE begin | end ... | dump [workers]");
+
+  open_metrics(argv[1]);
+
+  if (strcmp(argv[2], "begin") == 0) {
+    __atomic_add_fetch(&m->in_flight, 1, __ATOMIC_RELAXED);
+    printf("%llu\n", (unsigned long long) now());
+  } else if (strcmp(argv[2], "end") == 0) {
+    record(argc - 3, argv + 3);
+  } else if (strcmp(argv[2], "dump") == 0) {
+    dump(argc > 3 ? atoi(argv[3]) : 1);
+  } else {
+    die("Unknown command");
+  }
+
+  return 0;
+}
+
+
+/**
+ * Map the metrics file, creating and initialising it if necessary.
+ */
+void open_metrics(const char *path)
+{
+  struct stat st;
+  uint32_t expected = 0;
+  int fd;
+
+  fd = open(path, O_RDWR | O_CREAT, 0600);
+  if (fd == -1)
+    die(strerror(errno));
+  if (fstat(fd, &st))
+    die(strerror(errno));
+  if ((size_t) st.st_size < sizeof *m && ftruncate(fd, sizeof *m))
+    die(strerror(errno));
+
+  m = mmap(0, sizeof *m, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (m == MAP_FAILED)
+    die(strerror(errno));
+  close(fd);
+
+  /* the first process to see a fresh file stamps it */
+  if (__atomic_load_n(&m->magic, __ATOMIC_ACQUIRE) != METRICS_MAGIC) {
+    if (__atomic_compare_exchange_n(&m->magic, &expected, METRICS_MAGIC - 1,
+        false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      m->start = now();
+      __atomic_store_n(&m->magic, METRICS_MAGIC, __ATOMIC_RELEASE);
+    } else {
+      while (__atomic_load_n(&m->magic, __ATOMIC_ACQUIRE) != METRICS_MAGIC)
+        ;
+    }
+  }
+}
+
+
+/**
+ * Monotonic clock in nanoseconds, comparable between processes.
+ */
+uint64_t now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+/**
+ * FNV-1a hash of method and route name.
+ */
+uint32_t hash_name(const char *method, const char *name)
+{
+  uint32_t h = 2166136261u;
+  for (; *method; method++)
+    h = (h ^ (unsigned char) *method) * 16777619u;
+  h = (h ^ ' ') * 16777619u;
+  for (; *name; name++)
+    h = (h ^ (unsigned char) *name) * 16777619u;
+  return h;
+}
+
+
+/**
+ * Find the slot for a route, claiming an empty one if it is new.
+ *
+ * Returns 0 if the table is full.
+ */
+struct route *find_route(const char *method, const char *name)
+{
+  uint32_t h = hash_name(method, name), state;
+  unsigned int i, n;
+  struct route *r;
+
+  for (n = 0, i = h % ROUTES; n != ROUTES; n++, i = (i + 1) % ROUTES) {
+    r = &m->route[i];
+    state = __atomic_load_n(&r->state, __ATOMIC_ACQUIRE);
+
+    if (state == SLOT_EMPTY) {
+      if (__atomic_compare_exchange_n(&r->state, &state, SLOT_CLAIMED, false,
+          __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        r->hash = h;
+        snprintf(r->method, sizeof r->method, "%s", method);
+        snprintf(r->name, sizeof r->name, "%s", name);
+        __atomic_store_n(&r->state, SLOT_READY, __ATOMIC_RELEASE);
+        __atomic_add_fetch(&m->routes_used, 1, __ATOMIC_RELAXED);
+        return r;
+      }
+    }
+
+    /* another process is filling in this slot */
+    while (state == SLOT_CLAIMED)
+      state = __atomic_load_n(&r->state, __ATOMIC_ACQUIRE);
+
+    if (r->hash == h && strncmp(r->method, method, sizeof r->method - 1) == 0
+        && strncmp(r->name, name, sizeof r->name - 1) == 0)
+      return r;
+  }
+
+  return 0;
+}
+
+
+/**
+ * Histogram bucket index for a latency in nanoseconds.
+ */
+unsigned int bucket(uint64_t latency)
+{
+  unsigned int octave, step;
+
+  if (latency < (1ULL << FIRST_OCTAVE))
+    return 0;
+  octave = 63 - __builtin_clzll(latency);
+  if (LAST_OCTAVE <= octave)
+    return BUCKETS - 1;
+  step = (latency >> (octave - 2)) & (STEPS - 1);
+  return (octave - FIRST_OCTAVE) * STEPS + step + 1;
+}
+
+
+/**
+ * Inclusive upper bound of a bucket in nanoseconds.
+ */
+uint64_t bucket_bound(unsigned int i)
+{
+  unsigned int octave, step;
+
+  if (i == 0)
+    return 1ULL << FIRST_OCTAVE;
+  octave = (i - 1) / STEPS + FIRST_OCTAVE;
+  step = (i - 1) % STEPS;
+  return (uint64_t) (STEPS + step + 1) << (octave - 2);
+}
+
+
+/**
+ * Record a finished request: METHOD ROUTE STATUS START BYTES_IN BYTES_OUT.
+ */
+void record(int argc, char *argv[])
+{
+  struct route *r;
+  uint64_t start, latency, t = now();
+  int status;
+
+  if (argc != 6)
+    die("Usage: metrics FILE end METHOD ROUTE STATUS START BYTES_IN "
+        "BYTES_OUT");
+
+  status = atoi(argv[2]);
+  start = strtoull(argv[3], 0, 10);
+  latency = start && start < t ? t - start : 0;
+
+  __atomic_sub_fetch(&m->in_flight, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&m->busy, latency, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&m->requests, 1, __ATOMIC_RELAXED);
+
+  r = find_route(argv[0], argv[1]);
+  if (!r) {
+    __atomic_add_fetch(&m->overflow, 1, __ATOMIC_RELAXED);
+    return;
+  }
+
+  __atomic_add_fetch(&r->requests, 1, __ATOMIC_RELAXED);
+  if (100 <= status && status < 600)
+    __atomic_add_fetch(&r->status[status / 100], 1, __ATOMIC_RELAXED);
+  else
+    __atomic_add_fetch(&r->status[0], 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&r->bytes_in, strtoull(argv[4], 0, 10),
+      __ATOMIC_RELAXED);
+  __atomic_add_fetch(&r->bytes_out, strtoull(argv[5], 0, 10),
+      __ATOMIC_RELAXED);
+  __atomic_add_fetch(&r->latency_sum, latency, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&r->buckets[bucket(latency)], 1, __ATOMIC_RELAXED);
+}
+
+
+/**
+ * Print all counters in the Prometheus text exposition format.
+ */
+void dump(unsigned int workers)
+{
+  static const char *classes[] = { "other", "1xx", "2xx", "3xx", "4xx",
+      "5xx" };
+  uint64_t elapsed = now() - m->start, busy, cumulative;
+  struct route *r;
+  unsigned int i, j;
+
+  if (workers == 0)
+    workers = 1;
+  busy = __atomic_load_n(&m->busy, __ATOMIC_RELAXED);
+
+  printf("# HELP martin_requests_in_flight Requests currently being "
+      "handled.\n");
+  printf("# TYPE martin_requests_in_flight gauge\n");
+  printf("martin_requests_in_flight %lld\n",
+      (long long) __atomic_load_n(&m->in_flight, __ATOMIC_RELAXED));
+
+  printf("# HELP martin_worker_busy_seconds_total Time spent handling "
+      "requests, summed over workers.\n");
+  printf("# TYPE martin_worker_busy_seconds_total counter\n");
+  printf("martin_worker_busy_seconds_total %.6f\n", busy / 1e9);
+
+  printf("# HELP martin_worker_utilization Fraction of worker time spent "
+      "handling requests since startup.\n");
+  printf("# TYPE martin_worker_utilization gauge\n");
+  printf("martin_worker_utilization %.6f\n",
+      elapsed ? (double) busy / elapsed / workers : 0);
+
+  printf("# HELP martin_route_overflow_total Requests not counted per "
+      "route because the route table was full.\n");
+  printf("# TYPE martin_route_overflow_total counter\n");
+  printf("martin_route_overflow_total %llu\n",
+      (unsigned long long) __atomic_load_n(&m->overflow, __ATOMIC_RELAXED));
+
+  printf("# HELP martin_requests_total Requests handled, by route and "
+      "status class.\n");
+  printf("# TYPE martin_requests_total counter\n");
+  for (i = 0; i != ROUTES; i++) {
+    r = &m->route[i];
+    if (__atomic_load_n(&r->state, __ATOMIC_ACQUIRE) != SLOT_READY)
+      continue;
+    for (j = 0; j != 6; j++) {
+      uint64_t n = __atomic_load_n(&r->status[j], __ATOMIC_RELAXED);
+      if (n == 0)
+        continue;
+      printf("martin_requests_total{method=\"%s\",route=\"", r->method);
+      print_label(r->name);
+      printf("\",status=\"%s\"} %llu\n", classes[j], (unsigned long long) n);
+    }
+  }
+
+  printf("# HELP martin_request_bytes_total Request body bytes received, "
+      "by route.\n");
+  printf("# TYPE martin_request_bytes_total counter\n");
+  for (i = 0; i != ROUTES; i++) {
+    r = &m->route[i];
+    if (__atomic_load_n(&r->state, __ATOMIC_ACQUIRE) != SLOT_READY)
+      continue;
+    printf("martin_request_bytes_total{method=\"%s\",route=\"", r->method);
+    print_label(r->name);
+    printf("\"} %llu\n",
+        (unsigned long long) __atomic_load_n(&r->bytes_in, __ATOMIC_RELAXED));
+  }
+
+  printf("# HELP martin_response_bytes_total Response body bytes sent, by "
+      "route.\n");
+  printf("# TYPE martin_response_bytes_total counter\n");
+  for (i = 0; i != ROUTES; i++) {
+    r = &m->route[i];
+    if (__atomic_load_n(&r->state, __ATOMIC_ACQUIRE) != SLOT_READY)
+      continue;
+    printf("martin_response_bytes_total{method=\"%s\",route=\"", r->method);
+    print_label(r->name);
+    printf("\"} %llu\n", (unsigned long long)
+        __atomic_load_n(&r->bytes_out, __ATOMIC_RELAXED));
+  }
+
+  printf("# HELP martin_request_duration_seconds Request handling time, by "
+      "route.\n");
+  printf("# TYPE martin_request_duration_seconds histogram\n");
+  for (i = 0; i != ROUTES; i++) {
+    r = &m->route[i];
+    if (__atomic_load_n(&r->state, __ATOMIC_ACQUIRE) != SLOT_READY)
+      continue;
+    cumulative = 0;
+    for (j = 0; j != BUCKETS; j++) {
+      cumulative += __atomic_load_n(&r->buckets[j], __ATOMIC_RELAXED);
+      printf("martin_request_duration_seconds_bucket{method=\"%s\",route=\"",
+          r->method);
+      print_label(r->name);
+      if (j == BUCKETS - 1)
+        printf("\",le=\"+Inf\"} %llu\n", (unsigned long long) cumulative);
+      else
+        printf("\",le=\"%g\"} %llu\n", bucket_bound(j) / 1e9,
+            (unsigned long long) cumulative);
+    }
+    printf("martin_request_duration_seconds_sum{method=\"%s\",route=\"",
+        r->method);
+    print_label(r->name);
+    printf("\"} %.6f\n",
+        __atomic_load_n(&r->latency_sum, __ATOMIC_RELAXED) / 1e9);
+    printf("martin_request_duration_seconds_count{method=\"%s\",route=\"",
+        r->method);
+    print_label(r->name);
+    printf("\"} %llu\n", (unsigned long long) cumulative);
+  }
+}
+
+
+/**
+ * Print a label value, escaping as required by the text format.
+ */
+void print_label(const char *s)
+{
+  for (; *s; s++) {
+    if (*s == '\\' || *s == '"')
+      printf("\\%c", *s);
+    else if (*s == '\n')
+      printf("\\n");
+    else
+      putchar(*s);
+  }
+}
+
+
+/**
+ * Print an error message and exit.
+ */
+void die(const char *error)
+{
+  fprintf(stderr, "metrics: %s\n", error);
+  exit(EXIT_FAILURE);
+}
@@ -1,58 +1,358 @@
-
-
-
 #include <stdio.h>
 #ifndef NO_STDLIB_H
 #include <stdlib.h>
 #else
 char *getenv();
 #endif
+#include <string.h>
+#include <unistd.h>
+#include "util.h"
+
+#define MAX_ENTRIES 10000
+#define MAX_FIELD (1L << 20)
+#define MAX_FILE (1L << 30)
 
 typedef struct {
-    char name[128];
-    char val[128];
+    char *name;
+    char *val;
 } entry;
 
-void getword(char *word, char *line, char stop);
-char x2c(char *what);
+/* the entries filled in by read_form's callbacks */
+typedef struct {
+    entry *entries;
+    int m;
+} form;
+
 void unescape_url(char *url);
 void plustospace(char *str);
 
+static int split_pairs(char *cl, entry *entries);
+static char *read_body(void);
+static int read_form(const char *boundary, entry *entries);
+static int read_text(entry *entries);
+static void add_field(void *arg, const char *name, const char *value,
+                      long len);
+static void add_upload(void *arg, const char *name, const char *filename,
+                       const char *type, const char *path, long size);
+static void fail(const char *message);
+static int wants_json(void);
+static void print_html(entry *entries, int m);
+static void print_json(entry *entries, int m);
 
 
 main(int argc, char *argv[]) {
-    entry entries[10000];
-    register int x,m=0;
-    char *cl;
-
-    printf("Content-type: text/html%c%c",10,10);
+    static entry entries[MAX_ENTRIES];
+    register int m;
+    char *cl, *type, *method = getenv("REQUEST_METHOD");
+    char boundary[MP_BOUNDARY_MAX + 1];
 
-    if(strcmp(getenv("REQUEST_METHOD"),"GET")) {
-        printf("This script should be referenced with a METHOD of GET.\n");
+    type = getenv("CONTENT_TYPE");
+    if(method && !strcmp(method,"POST") && type &&
+       !multipart_boundary(type, boundary)) {
+        m = read_form(boundary, entries);
+        cl = NULL;
+    } else if(method && !strcmp(method,"POST") && type &&
+              !strncmp(type, "text/plain", 10)) {
+        m = read_text(entries);
+        cl = NULL;
+    } else if(method && !strcmp(method,"POST")) {
+        cl = read_body();
+    } else if(method && !strcmp(method,"GET")) {
+        cl = getenv("QUERY_STRING");
+        if(cl == NULL) {
+            printf("Content-type: text/html%c%c",10,10);
+            printf("No query information to decode.\n");
+            exit(1);
+        }
+    } else {
+        printf("Content-type: text/html%c%c",10,10);
+        printf("This script should be referenced with a METHOD of GET or POST.\n");
         printf("If you don't understand this, see this ");
         printf("<A HREF=\"http://www.ncsa.uiuc.edu/SDG/Software/Mosaic/Docs/fill-out-forms/overview.html\">forms overview</A>.%c",10);
         exit(1);
     }
 
-    cl = getenv("QUERY_STRING");
-    if(cl == NULL) {
-        printf("No query information to decode.\n");
+    if(cl)
+        m = split_pairs(cl, entries);
+
+    if(wants_json())
+        print_json(entries, m);
+    else
+        print_html(entries, m);
+    exit(0);
+}
+
+/* decode name=value pairs in place, returning how many there are */
+static int split_pairs(char *cl, entry *entries) {
+    register int m = 0;
+    char *amp, *eq;
+
+    while(*cl && (m < MAX_ENTRIES)) {
+        amp = strchr(cl, '&');
+        if(amp)
+            *amp = '\0';
+
+        entries[m].name = cl;
+        eq = strchr(cl, '=');
+        if(eq) {
+            *eq = '\0';
+            entries[m].val = eq + 1;
+        } else {
+            entries[m].val = cl + strlen(cl);
+        }
+        plustospace(entries[m].name);
+        unescape_url(entries[m].name);
+        plustospace(entries[m].val);
+        unescape_url(entries[m].val);
+        m++;
+
+        if(!amp)
+            break;
+        cl = amp + 1;
+    }
+    return m;
+}
+
+/* read an application/x-www-form-urlencoded request body in one go, of at
+   most MAX_FIELD bytes */
+static char *read_body(void) {
+    char *type = getenv("CONTENT_TYPE");
+    char *len = getenv("CONTENT_LENGTH");
+    char *body;
+    long cl, got = 0, n;
+
+    if(!type || strncmp(type, "application/x-www-form-urlencoded", 33)) {
+        printf("Content-type: text/html%c%c",10,10);
+        printf("This script can only be used to decode form results.\n");
         exit(1);
     }
-    for(x=0;cl[0] != '\0';x++) {
-        m=x;
-        getword(entries[x].val,cl,'&');
-        plustospace(entries[x].val);
-        unescape_url(entries[x].val);
-        getword(entries[x].name,entries[x].val,'=');
+    cl = len ? atol(len) : 0;
+    if(cl < 0)
+        cl = 0;
+    if(cl > MAX_FIELD)
+        fail("Request body too large.");
+
+    body = (char *) malloc(cl + 1);
+    if(!body)
+        fail("Request body too large.");
+    while((got < cl) && ((n = fread(body + got, 1, cl - got, stdin)) > 0))
+        got += n;
+    body[got] = '\0';
+    return body;
+}
+
+/*
+ * Read a multipart/form-data body with read_multipart. Fields become
+ * entries; a file is spooled to TMPDIR, entered as its name, size and type,
+ * and removed, so an upload is never held in memory.
+ */
+static int read_form(const char *boundary, entry *entries) {
+    char *len = getenv("CONTENT_LENGTH");
+    char *tmp = getenv("TMPDIR");
+    form f;
+    multipart mp;
+    int r;
+
+    f.entries = entries;
+    f.m = 0;
+    mp.spool_dir = (tmp && *tmp) ? tmp : NULL;
+    mp.max_field = MAX_FIELD;
+    mp.max_file = MAX_FILE;
+    mp.field = add_field;
+    mp.file = add_upload;
+    mp.arg = &f;
+
+    r = read_multipart(stdin, len ? atol(len) : -1, boundary, &mp);
+    if(r == MP_ERR_TOOLARGE)
+        fail("Request body too large.");
+    else if(r == MP_ERR_MALFORMED)
+        fail("Malformed form data.");
+    else if(r != MP_OK)
+        fail("Failed to read the form data.");
+    return f.m;
+}
+
+/*
+ * Read a text/plain form body with the line reader: a name=value line per
+ * field, CRLF ended, with nothing escaped. A line over MAX_FIELD is refused.
+ */
+static int read_text(entry *entries) {
+    char *len = getenv("CONTENT_LENGTH");
+    line_reader lr;
+    lr_slice line;
+    char *copy, *eq;
+    int m = 0, r;
+
+    if(lr_init(&lr, 0, MAX_FIELD) != LR_OK)
+        fail("Request body too large.");
+    if(len && (atol(len) >= 0))
+        lr.left = atol(len);
+
+    while((r = lr_next(&lr, &line)) == LR_OK) {
+        if(!line.len || (m == MAX_ENTRIES))
+            continue;
+        copy = (char *) malloc(line.len + 1);
+        if(!copy)
+            fail("Request body too large.");
+        memcpy(copy, line.data, line.len);
+        copy[line.len] = '\0';
+
+        entries[m].name = copy;
+        eq = strchr(copy, '=');
+        if(eq) {
+            *eq = '\0';
+            entries[m].val = eq + 1;
+        } else {
+            entries[m].val = copy + line.len;
+        }
+        m++;
     }
+    lr_free(&lr);
+    if(r == LR_TOOLONG)
+        fail("Request body too large.");
+    else if(r != LR_EOF)
+        fail("Failed to read the form data.");
+    return m;
+}
+
+static void add_field(void *arg, const char *name, const char *value,
+                      long len) {
+    form *f = (form *) arg;
 
+    (void) len;
+    if(f->m == MAX_ENTRIES)
+        return;
+    f->entries[f->m].name = strdup(name);
+    f->entries[f->m].val = strdup(value);
+    if(!f->entries[f->m].name || !f->entries[f->m].val)
+        fail("Request body too large.");
+    f->m++;
+}
+
+static void add_upload(void *arg, const char *name, const char *filename,
+                       const char *type, const char *path, long size) {
+    form *f = (form *) arg;
+    char *val;
+
+    unlink(path);
+    if(f->m == MAX_ENTRIES)
+        return;
+    val = (char *) malloc(strlen(filename) + strlen(type) + 40);
+    f->entries[f->m].name = strdup(name);
+    if(!val || !f->entries[f->m].name)
+        fail("Request body too large.");
+    sprintf(val, "%s (%ld bytes, %s)", filename, size, type);
+    f->entries[f->m].val = val;
+    f->m++;
+}
+
+static void fail(const char *message) {
+    printf("Content-type: text/html%c%c",10,10);
+    printf("%s\n", message);
+    exit(1);
+}
+
+static int wants_json(void) {
+    char *accept = getenv("HTTP_ACCEPT");
+
+    return accept && strstr(accept, "application/json");
+}
+
+static void print_html(entry *entries, int m) {
+    register int x;
+
+    printf("Content-type: text/html%c%c",10,10);
     printf("<H1>Query Results</H1>");
     printf("You submitted the following name/value pairs:<p>%c",10);
     printf("<ul>%c",10);
 
-    for(x=0; x <= m; x++)
+    for(x=0; x < m; x++)
         printf("<li> <code>%s = %s</code>%c",entries[x].name,
                entries[x].val,10);
     printf("</ul>%c",10);
 }
+
+/* length of s as the body of a JSON string */
+static size_t json_len(const char *s) {
+    register size_t l = 0;
+
+    for(;*s;s++) {
+        if((*s == '"') || (*s == '\\') || (*s == '\n') || (*s == '\r') ||
+           (*s == '\t'))
+            l += 2;
+        else if((unsigned char) *s < 32)
+            l += 6;
+        else
+            l++;
+    }
+    return l;
+}
+
+static char *json_copy(char *p, const char *s) {
+    static const char hex[] = "0123456789abcdef";
+
+    *p++ = '"';
+    for(;*s;s++) {
+        switch(*s) {
+            case '"': *p++ = '\\'; *p++ = '"'; break;
+            case '\\': *p++ = '\\'; *p++ = '\\'; break;
+            case '\n': *p++ = '\\'; *p++ = 'n'; break;
+            case '\r': *p++ = '\\'; *p++ = 'r'; break;
+            case '\t': *p++ = '\\'; *p++ = 't'; break;
+            default:
+                if((unsigned char) *s < 32) {
+                    memcpy(p, "\\u00", 4);
+                    p[4] = hex[(*s >> 4) & 15];
+                    p[5] = hex[*s & 15];
+                    p += 6;
+                } else {
+                    *p++ = *s;
+                }
+        }
+    }
+    *p++ = '"';
+    return p;
+}
+
+/*
+ * Output the pairs as [["name","value"],...]. The exact size is worked out
+ * first so the header and body go out from one buffer in a single write.
+ */
+static void print_json(entry *entries, int m) {
+    static const char header[] = "Content-type: application/json\n\n";
+    register int x;
+    size_t size, off;
+    ssize_t n;
+    char *buf, *p;
+
+    size = sizeof(header) - 1 + 3;
+    for(x=0; x < m; x++)
+        size += json_len(entries[x].name) + json_len(entries[x].val) + 8;
+
+    buf = (char *) malloc(size);
+    if(!buf)
+        exit(1);
+
+    p = buf;
+    memcpy(p, header, sizeof(header) - 1);
+    p += sizeof(header) - 1;
+    *p++ = '[';
+    for(x=0; x < m; x++) {
+        if(x)
+            *p++ = ',';
+        *p++ = '[';
+        p = json_copy(p, entries[x].name);
+        *p++ = ',';
+        p = json_copy(p, entries[x].val);
+        *p++ = ']';
+    }
+    *p++ = ']';
+    *p++ = '\n';
+
+    fflush(stdout);
+    for(off = 0; off < (size_t) (p - buf); off += n) {
+        n = write(1, buf + off, (p - buf) - off);
+        if(n <= 0)
+            exit(1);
+    }
+}
@@ -0,0 +1,493 @@
+/*
+ * Precompiled HTML templates for martin
+ * Licensed under the MIT License
+ *                http://www.opensource.org/licenses/mit-license
+ */
+
+/*
+ * Compile using
+ *   gcc -W -Wall -O2 -o render render.c
+ *
+ * Usage:
+ *   render [-c CACHE_DIR] TEMPLATE [NAME=VALUE...]
+ *
+ * Renders TEMPLATE to stdout. Tags are a small subset of Mustache:
+ *   {{name}}               the value of name, HTML-escaped
+ *   {{{name}}}             the value of name as it is
+ *   {{#name}}...{{/name}}  the enclosed part, if name is not empty
+ *   {{^name}}...{{/name}}  the enclosed part, if name is empty
+ *   {{! comment}}          nothing
+ * A name is looked up in the NAME=VALUE arguments first and then in the
+ * environment, so CGI variables such as PATH_INFO can be used directly.
+ *
+ * A template is compiled once into a list of instructions (copy text,
+ * insert a value, skip a section) which is saved in CACHE_DIR under the
+ * template's device and inode numbers. Later renders map the compiled file
+ * and only check it against the template's size and modification time. The
+ * output is built in one buffer and written with a single write.
+ *
+ * CACHE_DIR may be under a shared TMPDIR, so it is only used if it is a
+ * directory of the caller's with mode 0700, and a cached file only if the
+ * caller owns it and every instruction stays inside it. Anything else is
+ * compiled afresh.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+#define RENDER_MAGIC 0x746d706c
+#define MAX_DEPTH 32
+
+enum { OP_TEXT, OP_ESCAPE, OP_RAW, OP_SECTION, OP_INVERTED };
+
+/* the names and text an instruction refers to live in the blob after the
+ * instructions; names are NUL-terminated so they can go to getenv */
+struct op {
+  uint32_t type;
+  uint32_t offset;
+  uint32_t length;
+  uint32_t end;       /* sections: index of the first op after the section */
+};
+
+struct compiled {
+  uint32_t magic;
+  uint32_t op_count;
+  uint32_t blob_size;
+  uint32_t pad;
+  uint64_t dev;
+  uint64_t ino;
+  int64_t size;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+};
+
+struct buffer {
+  char *data;
+  size_t length;
+  size_t size;
+};
+
+const char *template_path;
+char **values;
+int value_count;
+
+
+const char *own_cache_dir(const char *cache_dir);
+struct compiled *load(const char *cache_dir, struct stat *st, char *cache_path,
+    size_t n);
+bool valid(const struct compiled *c);
+struct compiled *compile(int fd, struct stat *st);
+void save(struct compiled *c, const char *cache_path);
+void render(struct compiled *c, struct buffer *out);
+const char *lookup(const char *name, uint32_t length);
+void append(struct buffer *b, const char *p, size_t n);
+void append_escaped(struct buffer *b, const char *p);
+void die(const char *error);
+void die_at(const char *text, const char *p, const char *error);
+
+
+/**
+ * Main entry point.
+ */
+int main(int argc, char *argv[])
+{
+  const char *cache_dir = 0;
+  char cache_path[4096];
+  struct buffer out = { 0, 0, 0 };
+  struct compiled *c;
+  struct stat st;
+  size_t off;
+  ssize_t w;
+  int fd, i;
+
+  i = 1;
+  if (argc > 2 && strcmp(argv[1], "-c") == 0) {
+    cache_dir = argv[2];
+    i = 3;
+  }
+  if (i >= argc)
+    die("Usage: render [-c CACHE_DIR] TEMPLATE [NAME=VALUE...]");
+  template_path = argv[i];
+  values = argv + i + 1;
+  value_count = argc - i - 1;
+
+  fd = open(template_path, O_RDONLY);
+  if (fd == -1 || fstat(fd, &st))
+    die(strerror(errno));
+
+  if (cache_dir && *cache_dir)
+    cache_dir = own_cache_dir(cache_dir);
+  c = cache_dir ?
+      load(cache_dir, &st, cache_path, sizeof cache_path) : 0;
+  if (!c) {
+    c = compile(fd, &st);
+    if (cache_dir)
+      save(c, cache_path);
+  }
+  close(fd);
+
+  render(c, &out);
+  for (off = 0; off < out.length; off += w) {
+    w = write(1, out.data + off, out.length - off);
+    if (w <= 0)
+      die(strerror(errno));
+  }
+  return 0;
+}
+
+
+/**
+ * Make CACHE_DIR if it is not there, and return it if it is a directory
+ * (not a link) owned by this user and closed to everyone else, or else 0.
+ */
+const char *own_cache_dir(const char *cache_dir)
+{
+  struct stat st;
+
+  if (mkdir(cache_dir, 0700) && errno != EEXIST)
+    return 0;
+  if (lstat(cache_dir, &st) || !S_ISDIR(st.st_mode) ||
+      st.st_uid != geteuid() || (st.st_mode & 0777) != 0700)
+    return 0;
+  return cache_dir;
+}
+
+
+/**
+ * Map the compiled template from the cache, if it is there and was compiled
+ * from the template as it is now. CACHE_PATH is set either way.
+ */
+struct compiled *load(const char *cache_dir, struct stat *st, char *cache_path,
+    size_t n)
+{
+  struct compiled *c;
+  struct stat cst;
+  int fd;
+
+  snprintf(cache_path, n, "%s/%llx-%llx", cache_dir,
+      (unsigned long long) st->st_dev, (unsigned long long) st->st_ino);
+
+  fd = open(cache_path, O_RDONLY | O_NOFOLLOW);
+  if (fd == -1)
+    return 0;
+  if (fstat(fd, &cst) || !S_ISREG(cst.st_mode) ||
+      cst.st_uid != geteuid() || cst.st_size < (off_t) sizeof *c) {
+    close(fd);
+    return 0;
+  }
+  c = mmap(0, cst.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (c == MAP_FAILED)
+    return 0;
+
+  if (c->magic != RENDER_MAGIC || c->size != st->st_size ||
+      c->mtime_sec != st->st_mtim.tv_sec ||
+      c->mtime_nsec != st->st_mtim.tv_nsec ||
+      cst.st_size != (off_t) (sizeof *c + c->op_count * sizeof (struct op) +
+      c->blob_size) || !valid(c)) {
+    munmap(c, cst.st_size);
+    return 0;
+  }
+  return c;
+}
+
+
+/**
+ * Check that every instruction of a cached template refers to text inside
+ * the blob, that names are NUL-terminated there, and that sections end
+ * after they start and within the instructions.
+ */
+bool valid(const struct compiled *c)
+{
+  const struct op *ops = (const struct op *) (c + 1);
+  const char *blob = (const char *) (ops + c->op_count);
+  uint32_t i;
+
+  for (i = 0; i < c->op_count; i++) {
+    if (ops[i].type > OP_INVERTED ||
+        (uint64_t) ops[i].offset + ops[i].length > c->blob_size)
+      return false;
+    if (ops[i].type == OP_TEXT)
+      continue;
+    if ((uint64_t) ops[i].offset + ops[i].length == c->blob_size ||
+        blob[ops[i].offset + ops[i].length] != 0)
+      return false;
+    if ((ops[i].type == OP_SECTION || ops[i].type == OP_INVERTED) &&
+        (ops[i].end <= i || ops[i].end > c->op_count))
+      return false;
+  }
+  return true;
+}
+
+
+/**
+ * Parse the template into instructions. The result is one allocation laid
+ * out the same way as the cache file.
+ */
+struct compiled *compile(int fd, struct stat *st)
+{
+  struct op *ops;
+  struct compiled *c;
+  char *text, *blob, *p, *end, *tag, *close_tag, *name, *name_end;
+  uint32_t op_count = 0, blob_size = 0, open[MAX_DEPTH];
+  size_t max_ops;
+  ssize_t r;
+  off_t got;
+  int depth = 0, type;
+
+  text = malloc(st->st_size + 1);
+  if (!text)
+    die("Out of memory");
+  for (got = 0; got < st->st_size; got += r) {
+    r = read(fd, text + got, st->st_size - got);
+    if (r <= 0)
+      die("Template changed while being read");
+  }
+  text[got] = 0;
+
+  /* every tag is at least five bytes and gives at most two ops, and the
+   * blob never needs more than the template plus a NUL per tag */
+  max_ops = st->st_size / 2 + 2;
+  c = malloc(sizeof *c + max_ops * sizeof *ops + st->st_size + max_ops);
+  if (!c)
+    die("Out of memory");
+  ops = (struct op *) (c + 1);
+  blob = (char *) (ops + max_ops);
+
+  p = text;
+  end = text + st->st_size;
+  while (p < end) {
+    tag = strstr(p, "{{");
+    if (!tag)
+      tag = end;
+    if (tag != p) {
+      ops[op_count++] = (struct op) { OP_TEXT, blob_size, tag - p, 0 };
+      memcpy(blob + blob_size, p, tag - p);
+      blob_size += tag - p;
+    }
+    if (tag == end)
+      break;
+
+    p = tag + 2;
+    if (*p == '{') {
+      type = OP_RAW;
+      p++;
+      close_tag = strstr(p, "}}}");
+    } else {
+      type = *p == '#' ? OP_SECTION : *p == '^' ? OP_INVERTED :
+          *p == '/' ? -1 : *p == '!' ? -2 : OP_ESCAPE;
+      if (type != OP_ESCAPE)
+        p++;
+      close_tag = strstr(p, "}}");
+    }
+    if (!close_tag)
+      die_at(text, tag, "unclosed tag");
+
+    if (type == -2) {
+      p = close_tag + 2;
+      continue;
+    }
+
+    name = p + strspn(p, " \t");
+    for (name_end = name; name_end < close_tag && (*name_end == '_' ||
+        ('a' <= *name_end && *name_end <= 'z') ||
+        ('A' <= *name_end && *name_end <= 'Z') ||
+        ('0' <= *name_end && *name_end <= '9')); name_end++)
+      ;
+    if (name_end == name || name_end + strspn(name_end, " \t") != close_tag)
+      die_at(text, tag, "bad name in tag");
+    p = close_tag + (type == OP_RAW ? 3 : 2);
+
+    if (type == -1) {
+      if (depth == 0)
+        die_at(text, tag, "close tag without a section");
+      depth--;
+      if (ops[open[depth]].length != (uint32_t) (name_end - name) ||
+          memcmp(blob + ops[open[depth]].offset, name, name_end - name))
+        die_at(text, tag, "close tag does not match the section");
+      ops[open[depth]].end = op_count;
+      continue;
+    }
+
+    if (type == OP_SECTION || type == OP_INVERTED) {
+      if (depth == MAX_DEPTH)
+        die_at(text, tag, "sections nested too deeply");
+      open[depth++] = op_count;
+    }
+    ops[op_count++] = (struct op) { type, blob_size, name_end - name, 0 };
+    memcpy(blob + blob_size, name, name_end - name);
+    blob_size += name_end - name;
+    blob[blob_size++] = 0;
+  }
+  if (depth)
+    die_at(text, text + st->st_size, "unclosed section");
+
+  /* close up the gap between the ops and the blob */
+  memmove(ops + op_count, blob, blob_size);
+  c->magic = RENDER_MAGIC;
+  c->op_count = op_count;
+  c->blob_size = blob_size;
+  c->pad = 0;
+  c->dev = st->st_dev;
+  c->ino = st->st_ino;
+  c->size = st->st_size;
+  c->mtime_sec = st->st_mtim.tv_sec;
+  c->mtime_nsec = st->st_mtim.tv_nsec;
+  free(text);
+  return c;
+}
+
+
+/**
+ * Write the compiled template to the cache. It goes to a temporary file
+ * first so concurrent renders never map a half-written one. Failing to
+ * save only costs compiling again next time.
+ */
+void save(struct compiled *c, const char *cache_path)
+{
+  char tmp[4200];
+  size_t n, off;
+  ssize_t w;
+  int fd;
+
+  snprintf(tmp, sizeof tmp, "%s.%ld", cache_path, (long) getpid());
+  fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW, 0600);
+  if (fd == -1)
+    return;
+
+  n = sizeof *c + c->op_count * sizeof (struct op) + c->blob_size;
+  for (off = 0; off < n; off += w) {
+    w = write(fd, (char *) c + off, n - off);
+    if (w <= 0)
+      break;
+  }
+  if (close(fd) || off < n || rename(tmp, cache_path))
+    unlink(tmp);
+}
+
+
+/**
+ * Run the instructions into OUT.
+ */
+void render(struct compiled *c, struct buffer *out)
+{
+  struct op *ops = (struct op *) (c + 1);
+  const char *blob = (const char *) (ops + c->op_count);
+  const char *value;
+  uint32_t i = 0;
+
+  while (i < c->op_count) {
+    struct op *op = &ops[i++];
+
+    switch (op->type) {
+    case OP_TEXT:
+      append(out, blob + op->offset, op->length);
+      break;
+    case OP_ESCAPE:
+      value = lookup(blob + op->offset, op->length);
+      if (value)
+        append_escaped(out, value);
+      break;
+    case OP_RAW:
+      value = lookup(blob + op->offset, op->length);
+      if (value)
+        append(out, value, strlen(value));
+      break;
+    case OP_SECTION:
+    case OP_INVERTED:
+      value = lookup(blob + op->offset, op->length);
+      if ((value && *value) != (op->type == OP_SECTION))
+        i = op->end;
+      break;
+    }
+  }
+}
+
+
+/**
+ * The value of NAME from the arguments, or else the environment.
+ */
+const char *lookup(const char *name, uint32_t length)
+{
+  int i;
+
+  for (i = value_count - 1; i >= 0; i--)
+    if (strncmp(values[i], name, length) == 0 && values[i][length] == '=')
+      return values[i] + length + 1;
+  return getenv(name);
+}
+
+
+void append(struct buffer *b, const char *p, size_t n)
+{
+  if (b->length + n > b->size) {
+    b->size = b->size * 2 > b->length + n ? b->size * 2 :
+        b->length + n + 4096;
+    b->data = realloc(b->data, b->size);
+    if (!b->data)
+      die("Out of memory");
+  }
+  memcpy(b->data + b->length, p, n);
+  b->length += n;
+}
+
+
+/**
+ * Append P with the characters that are special in HTML text and attribute
+ * values replaced by entities.
+ */
+void append_escaped(struct buffer *b, const char *p)
+{
+  const char *run;
+
+  while (*p) {
+    run = p;
+    p += strcspn(p, "&<>\"'");
+    append(b, run, p - run);
+    switch (*p) {
+    case '&': append(b, "&amp;", 5); break;
+    case '<': append(b, "&lt;", 4); break;
+    case '>': append(b, "&gt;", 4); break;
+    case '"': append(b, "&quot;", 6); break;
+    case '\'': append(b, "&#39;", 5); break;
+    default: return;
+    }
+    p++;
+  }
+}
+
+
+/**
+ * Print an error message and exit.
+ */
+void die(const char *error)
+{
+  fprintf(stderr, "render: %s\n", error);
+  exit(EXIT_FAILURE);
+}
+
+
+/**
+ * Print a template error with the line it is on and exit.
+ */
+void die_at(const char *text, const char *p, const char *error)
+{
+  int line = 1;
+
+  for (; text < p; text++)
+    if (*text == '\n')
+      line++;
+  fprintf(stderr, "render: %s:%d: %s\n", template_path, line, error);
+  exit(EXIT_FAILURE);
+}
@@ -0,0 +1,700 @@
+/*
+ * Request parser fuzzer for wwwoosh
+ * Licensed under the MIT License
+ *                http://www.opensource.org/licenses/mit-license
+ */
+
+/*
+ * Compile using
+ *   gcc -W -Wall -O2 -o reqfuzz reqfuzz.c
+ *
+ * Run from the repository root:
+ *   tools/reqfuzz [-n iterations] [-s seed] [-t timeout_ms] [-o crash_dir]
+ *       [-w wwwoosh.sh] tools/corpus
+ *
+ * Every corpus file is run as is, then mutated inputs are generated from
+ * them AFL-style (byte flips, inserts of interesting characters, splices,
+ * long runs and truncations). Each input is fed to wwwoosh_handle_request in
+ * a fresh shell and the CGI variables it exports are compared with a
+ * reference parser below, which spells out the intended behaviour. Inputs
+ * that hang, crash the shell or disagree with the reference are saved to
+ * the crash directory.
+ *
+ * Throughput is reported both per execution (including shell start-up) and
+ * for the parse alone, timed inside the shell with bash's EPOCHREALTIME.
+ */
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+
+#define INPUT_MAX 65536
+#define OUTPUT_MAX 262144
+#define MAX_VARS 256
+#define MAX_HEADERS 100
+#define MAX_HEADER_NAME 256
+#define MAX_SEEDS 256
+
+struct buffer {
+  char *data;
+  size_t len;
+};
+
+struct var {
+  char *name;
+  char *value;
+};
+
+struct vars {
+  struct var var[MAX_VARS];
+  unsigned int n;
+};
+
+struct buffer seeds[MAX_SEEDS];
+unsigned int seed_count;
+const char *wwwoosh = "./wwwoosh.sh";
+const char *crash_dir = "reqfuzz-crashes";
+const char *shell = "bash";
+unsigned int timeout_ms = 2000;
+char input_path[] = "/tmp/reqfuzz.XXXXXX";
+
+unsigned long executions, failures, hangs, crashes, saved;
+double parse_us_total;
+unsigned long parse_count;
+
+static const char driver[] =
+  ". \"$1\"\n"
+  "wwwoosh_fuzz_dump () {\n"
+  "    local t1=\"$EPOCHREALTIME\"\n"
+  "    [ \"$t0\" ] && echo \"@parse_us=$((${t1/[.,]/} - ${t0/[.,]/}))\"\n"
+  "    env\n"
+  "}\n"
+  "t0=\"$EPOCHREALTIME\"\n"
+  "wwwoosh_handle_request wwwoosh_fuzz_dump\n";
+
+static const char interesting[] = " \t\r\n:?&=%/-_.;,\"\\$`'()!#~\x7f\x80\xff";
+
+
+void load_corpus(const char *dir);
+void mutate(const struct buffer *in, struct buffer *out);
+int run(const struct buffer *in, struct buffer *out);
+void parse_reference(const struct buffer *in, struct vars *v);
+void export_header(struct vars *v, const char *header);
+void parse_output(struct buffer *out, struct vars *v);
+bool compare(struct vars *a, struct vars *b, char *why, size_t size);
+void set_var(struct vars *v, const char *name, const char *value,
+    size_t len);
+bool header_var(const char *name, size_t len, char *var);
+void save(const struct buffer *in, const char *kind, const char *why);
+void free_vars(struct vars *v);
+double now(void);
+void die(const char *error);
+
+
+/**
+ * Main entry point.
+ */
+int main(int argc, char *argv[])
+{
+  unsigned long iterations = 1000, i;
+  unsigned int seed = time(0);
+  struct buffer in, out;
+  struct vars expected, actual;
+  char why[512];
+  double t0, elapsed;
+  int c, r;
+
+  while ((c = getopt(argc, argv, "n:s:t:o:w:S:")) != -1) {
+    switch (c) {
+      case 'n': iterations = strtoul(optarg, 0, 10); break;
+      case 's': seed = strtoul(optarg, 0, 10); break;
+      case 't': timeout_ms = atoi(optarg); break;
+      case 'o': crash_dir = optarg; break;
+      case 'w': wwwoosh = optarg; break;
+      case 'S': shell = optarg; break;
+      default:
+        die("Usage: reqfuzz [-n iterations] [-s seed] [-t timeout_ms] "
+            "[-o crash_dir] [-w wwwoosh.sh] [-S shell] corpus_dir");
+    }
+  }
+  if (optind + 1 != argc)
+    die("Usage: reqfuzz [options] corpus_dir");
+
+  srandom(seed);
+  load_corpus(argv[optind]);
+  if (seed_count == 0)
+    die("Empty corpus");
+
+  in.data = malloc(INPUT_MAX);
+  out.data = malloc(OUTPUT_MAX);
+  if (!in.data || !out.data)
+    die("Out of memory");
+
+  printf("Fuzzing %s with %u seeds, %lu iterations, seed %u\n",
+      wwwoosh, seed_count, iterations, seed);
+
+  t0 = now();
+  for (i = 0; i != seed_count + iterations; i++) {
+    if (i < seed_count) {
+      memcpy(in.data, seeds[i].data, seeds[i].len);
+      in.len = seeds[i].len;
+    } else {
+      mutate(&seeds[random() % seed_count], &in);
+    }
+
+    r = run(&in, &out);
+    executions++;
+    if (r == -1) {
+      hangs++;
+      save(&in, "hang", "timed out");
+      continue;
+    }
+    if (r != 0) {
+      crashes++;
+      snprintf(why, sizeof why, "shell exited with status %i", r);
+      save(&in, "crash", why);
+      continue;
+    }
+
+    parse_reference(&in, &expected);
+    parse_output(&out, &actual);
+    if (!compare(&expected, &actual, why, sizeof why)) {
+      failures++;
+      save(&in, "mismatch", why);
+    }
+    free_vars(&expected);
+    free_vars(&actual);
+
+    if ((i + 1) % 500 == 0)
+      printf("  %lu executions, %lu mismatches, %lu hangs, %lu crashes\n",
+          i + 1, failures, hangs, crashes);
+  }
+  elapsed = now() - t0;
+
+  printf("%lu executions in %.2fs: %.1f exec/s\n", executions, elapsed,
+      executions / elapsed);
+  if (parse_count)
+    printf("parse only: mean %.1fus, %.0f requests parsed/s\n",
+        parse_us_total / parse_count, parse_count / parse_us_total * 1e6);
+  printf("%lu mismatches, %lu hangs, %lu crashes", failures, hangs, crashes);
+  if (saved)
+    printf(", inputs saved in %s", crash_dir);
+  printf("\n");
+
+  unlink(input_path);
+  return failures || hangs || crashes ? 1 : 0;
+}
+
+
+/**
+ * Read every regular file in the corpus directory as a seed.
+ */
+void load_corpus(const char *dir)
+{
+  char path[4096];
+  struct dirent *e;
+  struct stat st;
+  FILE *f;
+  DIR *d;
+
+  d = opendir(dir);
+  if (!d)
+    die(strerror(errno));
+  while ((e = readdir(d)) && seed_count != MAX_SEEDS) {
+    snprintf(path, sizeof path, "%s/%s", dir, e->d_name);
+    if (stat(path, &st) || !S_ISREG(st.st_mode) || INPUT_MAX < st.st_size)
+      continue;
+    f = fopen(path, "rb");
+    if (!f)
+      continue;
+    seeds[seed_count].data = malloc(st.st_size + 1);
+    seeds[seed_count].len = fread(seeds[seed_count].data, 1, st.st_size, f);
+    fclose(f);
+    seed_count++;
+  }
+  closedir(d);
+}
+
+
+/**
+ * Produce a mutated copy of a seed. NUL bytes are never generated, since
+ * shells cannot hold them in variables.
+ */
+void mutate(const struct buffer *in, struct buffer *out)
+{
+  unsigned int rounds = 1 + random() % 8, k;
+  size_t pos, n, i;
+  const struct buffer *other;
+  char c;
+
+  memcpy(out->data, in->data, in->len);
+  out->len = in->len;
+
+  for (k = 0; k != rounds; k++) {
+    pos = out->len ? random() % (out->len + 1) : 0;
+    switch (random() % 9) {
+      case 0: /* replace a byte with an interesting one */
+        if (pos < out->len)
+          out->data[pos] = interesting[random() % (sizeof interesting - 1)];
+        break;
+      case 1: /* insert an interesting byte */
+        if (out->len + 1 < INPUT_MAX) {
+          memmove(out->data + pos + 1, out->data + pos, out->len - pos);
+          out->data[pos] = interesting[random() % (sizeof interesting - 1)];
+          out->len++;
+        }
+        break;
+      case 2: /* flip a bit */
+        if (pos < out->len) {
+          c = out->data[pos] ^ (1 << (random() % 8));
+          out->data[pos] = c ? c : 1;
+        }
+        break;
+      case 3: /* delete a range */
+        n = random() % 16;
+        if (out->len < pos + n)
+          n = out->len - pos;
+        memmove(out->data + pos, out->data + pos + n, out->len - pos - n);
+        out->len -= n;
+        break;
+      case 4: /* duplicate a range */
+        n = random() % 64;
+        if (out->len < pos + n)
+          n = out->len - pos;
+        if (out->len + n < INPUT_MAX) {
+          memmove(out->data + pos + n, out->data + pos, out->len - pos);
+          out->len += n;
+        }
+        break;
+      case 5: /* splice in part of another seed */
+        other = &seeds[random() % seed_count];
+        n = other->len ? random() % other->len : 0;
+        if (out->len + n < INPUT_MAX) {
+          memmove(out->data + pos + n, out->data + pos, out->len - pos);
+          memcpy(out->data + pos, other->data, n);
+          out->len += n;
+        }
+        break;
+      case 6: /* a long run of one byte */
+        n = 256 + random() % 8192;
+        c = random() % 2 ? 'A' : interesting[random() %
+            (sizeof interesting - 1)];
+        if (out->len + n < INPUT_MAX) {
+          memmove(out->data + pos + n, out->data + pos, out->len - pos);
+          memset(out->data + pos, c, n);
+          out->len += n;
+        }
+        break;
+      case 7: /* many header lines */
+        n = 90 + random() % 30;
+        for (i = 0; i != n && out->len + 8 < INPUT_MAX; i++) {
+          pos = out->len ? random() % out->len : 0;
+          pos = (char *) memchr(out->data + pos, '\n', out->len - pos) ?
+              (size_t) ((char *) memchr(out->data + pos, '\n',
+              out->len - pos) - out->data) + 1 : out->len;
+          memmove(out->data + pos + 7, out->data + pos, out->len - pos);
+          memcpy(out->data + pos, "X-A: 1\n", 7);
+          out->len += 7;
+        }
+        break;
+      case 8: /* truncate */
+        out->len = pos;
+        break;
+    }
+  }
+}
+
+
+/**
+ * Run the parser on an input. Returns 0 on success, -1 on a timeout, or the
+ * shell's exit status or 128 + signal.
+ */
+int run(const struct buffer *in, struct buffer *out)
+{
+  static char *env[] = { "PATH=/usr/local/bin:/usr/bin:/bin", "LC_ALL=C", 0 };
+  int fd, pipefd[2], status, r;
+  struct pollfd p;
+  double deadline;
+  ssize_t n;
+  pid_t pid;
+
+  if (input_path[sizeof input_path - 7] == 'X') {
+    fd = mkstemp(input_path);
+  } else {
+    fd = open(input_path, O_RDWR | O_TRUNC);
+  }
+  if (fd == -1 || write(fd, in->data, in->len) != (ssize_t) in->len)
+    die("Failed to write input file");
+  lseek(fd, 0, SEEK_SET);
+
+  if (pipe(pipefd))
+    die(strerror(errno));
+
+  pid = fork();
+  if (pid == -1)
+    die(strerror(errno));
+  if (pid == 0) {
+    dup2(fd, 0);
+    dup2(pipefd[1], 1);
+    close(pipefd[0]);
+    close(pipefd[1]);
+    close(fd);
+    execle("/bin/sh", "sh", "-c", "exec \"$0\" -c \"$1\" sh \"$2\"", shell,
+        driver, wwwoosh, (char *) 0, env);
+    _exit(127);
+  }
+  close(fd);
+  close(pipefd[1]);
+
+  out->len = 0;
+  deadline = now() + timeout_ms / 1000.0;
+  p.fd = pipefd[0];
+  p.events = POLLIN;
+  while (1) {
+    r = poll(&p, 1, (int) ((deadline - now()) * 1000));
+    if (r <= 0) {
+      kill(pid, SIGKILL);
+      waitpid(pid, &status, 0);
+      close(pipefd[0]);
+      return -1;
+    }
+    n = read(pipefd[0], out->data + out->len, OUTPUT_MAX - 1 - out->len);
+    if (n <= 0)
+      break;
+    out->len += n;
+  }
+  close(pipefd[0]);
+  out->data[out->len] = 0;
+
+  waitpid(pid, &status, 0);
+  if (WIFSIGNALED(status))
+    return 128 + WTERMSIG(status);
+  return WEXITSTATUS(status);
+}
+
+
+/**
+ * The intended parse of a request head:
+ *  - lines end in LF, and one CR before the LF is dropped
+ *  - the request line is "METHOD SP TARGET [SP VERSION]", split on the first
+ *    two spaces; the version defaults to HTTP/1.0
+ *  - PATH_INFO is the target up to the first '?', QUERY_STRING the rest
+ *  - header lines run to the first empty line; a line without a final LF
+ *    is incomplete and ignored
+ *  - a line starting with SP or HTAB continues the previous header, joined
+ *    with one space after dropping its leading whitespace
+ *  - a header needs a colon and a token name of at most MAX_HEADER_NAME
+ *    characters; its value has surrounding SP/HTAB removed and is exported
+ *    as HTTP_<NAME>, upper case with non-alphanumerics as '_'; repeats are
+ *    joined with ", "
+ *  - a request with more than MAX_HEADERS headers is refused, with nothing
+ *    exported
+ */
+void parse_reference(const struct buffer *in, struct vars *v)
+{
+  char *copy, *line, *next, *end, *target, *header = 0, *sp, *q;
+  unsigned int count = 0, i;
+  bool last;
+
+  /* no request at all, as when the listener gives up */
+  v->n = 0;
+  if (in->len == 0)
+    return;
+  copy = malloc(in->len + 1);
+  memcpy(copy, in->data, in->len);
+  copy[in->len] = 0;
+  end = copy + in->len;
+
+  /* request line, used even without a final LF */
+  line = copy;
+  next = memchr(line, '\n', end - line);
+  if (next)
+    *next++ = 0;
+  else
+    next = end;
+  if (*line && line[strlen(line) - 1] == '\r')
+    line[strlen(line) - 1] = 0;
+
+  sp = strchr(line, ' ');
+  target = sp ? sp + 1 : line + strlen(line);
+  if (sp)
+    *sp = 0;
+  set_var(v, "REQUEST_METHOD", line, strlen(line));
+  sp = strchr(target, ' ');
+  set_var(v, "wwwoosh_http_version", sp ? sp + 1 : "HTTP/1.0",
+      sp ? strlen(sp + 1) : 8);
+  if (sp)
+    *sp = 0;
+  q = strchr(target, '?');
+  set_var(v, "PATH_INFO", target, q ? (size_t) (q - target) : strlen(target));
+  set_var(v, "QUERY_STRING", q ? q + 1 : "", q ? strlen(q + 1) : 0);
+
+  /* header lines; each header is finished when the next one starts */
+  for (line = next; line < end; line = next) {
+    next = memchr(line, '\n', end - line);
+    if (!next)
+      break;
+    *next++ = 0;
+    if (*line && line[strlen(line) - 1] == '\r')
+      line[strlen(line) - 1] = 0;
+    last = *line == 0;
+
+    if (!last && (*line == ' ' || *line == '\t')) {
+      if (header) {
+        line += strspn(line, " \t");
+        header = realloc(header, strlen(header) + strlen(line) + 2);
+        strcat(header, " ");
+        strcat(header, line);
+      }
+      continue;
+    }
+
+    export_header(v, header);
+    free(header);
+    header = 0;
+    if (last)
+      break;
+    if (++count > MAX_HEADERS) {
+      free_vars(v);
+      free(copy);
+      return;
+    }
+    header = strdup(line);
+  }
+  export_header(v, header);
+  free(header);
+
+  /* CGI copies of the two entity headers */
+  for (i = 0; i != v->n; i++) {
+    if (strcmp(v->var[i].name, "HTTP_CONTENT_TYPE") == 0)
+      set_var(v, "CONTENT_TYPE", v->var[i].value, strlen(v->var[i].value));
+    if (strcmp(v->var[i].name, "HTTP_CONTENT_LENGTH") == 0)
+      set_var(v, "CONTENT_LENGTH", v->var[i].value,
+          strlen(v->var[i].value));
+  }
+  set_var(v, "CONTENT_TYPE", "", 0);
+  set_var(v, "CONTENT_LENGTH", "", 0);
+  free(copy);
+}
+
+
+/**
+ * Add a complete "Name: value" header line, if it is valid.
+ */
+void export_header(struct vars *v, const char *header)
+{
+  const char *colon, *value, *end;
+  char var[1024];
+
+  if (!header)
+    return;
+  colon = strchr(header, ':');
+  if (!colon || !header_var(header, colon - header, var))
+    return;
+  value = colon + 1 + strspn(colon + 1, " \t");
+  end = value + strlen(value);
+  while (value < end && (end[-1] == ' ' || end[-1] == '\t'))
+    end--;
+  set_var(v, var, value, end - value);
+}
+
+
+/**
+ * Map a header field name to its variable, returning false if the name is
+ * not a token [RFC 7230 3.2.6].
+ */
+bool header_var(const char *name, size_t len, char *var)
+{
+  static const char tchar[] = "!#$%&'*+-.^_`|~";
+  size_t i;
+
+  if (len == 0 || MAX_HEADER_NAME < len)
+    return false;
+  strcpy(var, "HTTP_");
+  for (i = 0; i != len; i++) {
+    unsigned char c = name[i];
+    if (!(('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') ||
+        ('0' <= c && c <= '9') || (c && strchr(tchar, c))))
+      return false;
+    if ('a' <= c && c <= 'z')
+      c -= 32;
+    else if (!(('A' <= c && c <= 'Z') || ('0' <= c && c <= '9')))
+      c = '_';
+    var[5 + i] = c;
+  }
+  var[5 + len] = 0;
+  return true;
+}
+
+
+/**
+ * Add a variable, joining with ", " if it is already set. CONTENT_TYPE and
+ * CONTENT_LENGTH are only ever set once.
+ */
+void set_var(struct vars *v, const char *name, const char *value,
+    size_t len)
+{
+  unsigned int i;
+  char *joined;
+
+  for (i = 0; i != v->n; i++) {
+    if (strcmp(v->var[i].name, name))
+      continue;
+    if (strncmp(name, "HTTP_", 5))
+      return;
+    joined = malloc(strlen(v->var[i].value) + len + 3);
+    sprintf(joined, "%s, %.*s", v->var[i].value, (int) len, value);
+    free(v->var[i].value);
+    v->var[i].value = joined;
+    return;
+  }
+  if (v->n == MAX_VARS)
+    return;
+  v->var[v->n].name = strdup(name);
+  v->var[v->n].value = strndup(value, len);
+  v->n++;
+}
+
+
+/**
+ * Pick the request variables out of the shell's env output.
+ */
+void parse_output(struct buffer *out, struct vars *v)
+{
+  static const char *names[] = { "REQUEST_METHOD=", "PATH_INFO=",
+      "QUERY_STRING=", "wwwoosh_http_version=", "CONTENT_TYPE=",
+      "CONTENT_LENGTH=", "HTTP_" };
+  char *line, *next, *eq;
+  unsigned int i;
+
+  v->n = 0;
+  for (line = out->data; *line; line = next) {
+    next = strchr(line, '\n');
+    if (next)
+      *next++ = 0;
+    else
+      next = line + strlen(line);
+
+    if (strncmp(line, "@parse_us=", 10) == 0) {
+      parse_us_total += atof(line + 10);
+      parse_count++;
+      continue;
+    }
+    for (i = 0; i != sizeof names / sizeof names[0]; i++) {
+      if (strncmp(line, names[i], strlen(names[i])) == 0)
+        break;
+    }
+    eq = strchr(line, '=');
+    if (i == sizeof names / sizeof names[0] || !eq || v->n == MAX_VARS)
+      continue;
+    *eq = 0;
+    v->var[v->n].name = strdup(line);
+    v->var[v->n].value = strdup(eq + 1);
+    v->n++;
+  }
+}
+
+
+/**
+ * Compare the expected and actual variables, describing the first
+ * difference.
+ */
+bool compare(struct vars *a, struct vars *b, char *why, size_t size)
+{
+  unsigned int i, j;
+
+  for (i = 0; i != a->n; i++) {
+    for (j = 0; j != b->n; j++) {
+      if (strcmp(a->var[i].name, b->var[j].name) == 0)
+        break;
+    }
+    if (j == b->n) {
+      snprintf(why, size, "%s missing, expected '%.200s'", a->var[i].name,
+          a->var[i].value);
+      return false;
+    }
+    if (strcmp(a->var[i].value, b->var[j].value)) {
+      snprintf(why, size, "%s is '%.200s', expected '%.200s'",
+          a->var[i].name, b->var[j].value, a->var[i].value);
+      return false;
+    }
+  }
+  if (a->n != b->n) {
+    for (j = 0; j != b->n; j++) {
+      for (i = 0; i != a->n; i++) {
+        if (strcmp(a->var[i].name, b->var[j].name) == 0)
+          break;
+      }
+      if (i == a->n) {
+        snprintf(why, size, "unexpected %s='%.200s'", b->var[j].name,
+            b->var[j].value);
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+
+/**
+ * Keep a failing input, and report why it failed.
+ */
+void save(const struct buffer *in, const char *kind, const char *why)
+{
+  char path[4096];
+  FILE *f;
+
+  printf("  %s: %s\n", kind, why);
+  mkdir(crash_dir, 0755);
+  snprintf(path, sizeof path, "%s/%s-%lu.http", crash_dir, kind, executions);
+  f = fopen(path, "wb");
+  if (!f)
+    return;
+  fwrite(in->data, 1, in->len, f);
+  fclose(f);
+  saved++;
+}
+
+
+void free_vars(struct vars *v)
+{
+  unsigned int i;
+  for (i = 0; i != v->n; i++) {
+    free(v->var[i].name);
+    free(v->var[i].value);
+  }
+  v->n = 0;
+}
+
+
+double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/**
+ * Print an error message and exit.
+ */
+void die(const char *error)
+{
+  fprintf(stderr, "reqfuzz: %s\n", error);
+  exit(EXIT_FAILURE);
+}
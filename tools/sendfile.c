@@ -0,0 +1,343 @@
+/*
+ * Static file responses with byte ranges for martin
+ * Licensed under the MIT License
+ *                http://www.opensource.org/licenses/mit-license
+ */
+
+/*
+ * Compile using
+ *   gcc -W -Wall -O2 -o sendfile sendfile.c
+ *
+ * Usage:
+ *   sendfile FILE [CONTENT_TYPE]
+ *
+ * Writes a CGI response for FILE to stdout: the Status, Content-Type,
+ * Content-Length, Accept-Ranges, ETag and Last-Modified headers, a blank
+ * line and the body. HTTP_RANGE and HTTP_IF_RANGE are honoured [RFC 9110
+ * 14]:
+ *   - one satisfiable range gives 206 with Content-Range
+ *   - several give 206 with a multipart/byteranges body
+ *   - none satisfiable gives 416, with a Content-Range giving the size
+ *   - a malformed Range, too many ranges, or an If-Range that does not
+ *     match the current ETag or Last-Modified date gives the whole file
+ * The body is copied from the file with sendfile(2) at each range's offset,
+ * so nothing is read into memory. A HEAD request gets the headers only.
+ *
+ * When MARTIN_STATUS_FILE is set, the status code and the number of body
+ * bytes actually written are saved there as "STATUS BYTES" on exit, for
+ * martin's metrics.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+
+
+#define MAX_RANGES 16
+#define MAX_TYPE 200
+
+struct range {
+  off_t first;
+  off_t last;
+};
+
+struct range ranges[MAX_RANGES];
+int range_count;
+off_t size;
+char etag[64];
+char last_modified[64];
+char boundary[40];
+int status;
+off_t sent;
+
+
+int parse_ranges(const char *header);
+bool if_range_matches(const char *header);
+off_t part_header(char *buf, size_t n, const char *type, struct range *r);
+void copy_range(int fd, off_t offset, off_t length);
+void write_all(const char *p, size_t n);
+void report_status(void);
+void die(const char *error);
+
+
+/**
+ * Main entry point.
+ */
+int main(int argc, char *argv[])
+{
+  const char *type, *range, *if_range, *method;
+  char part[MAX_TYPE + 160];
+  off_t length;
+  struct stat st;
+  struct tm tm;
+  bool head;
+  int fd, i;
+
+  if (argc < 2 || 3 < argc)
+    die("Usage: sendfile FILE [CONTENT_TYPE]");
+  type = argc == 3 ? argv[2] : "application/octet-stream";
+  if (MAX_TYPE < strlen(type))
+    die("Content type too long");
+  method = getenv("REQUEST_METHOD");
+  head = method && strcmp(method, "HEAD") == 0;
+  atexit(report_status);
+
+  fd = open(argv[1], O_RDONLY);
+  if (fd == -1 || fstat(fd, &st) || !S_ISREG(st.st_mode)) {
+    status = 404;
+    sent = 10;
+    printf("Status: 404 Not Found\nContent-Type: text/plain\n"
+        "Content-Length: 10\n\nNot Found\n");
+    return 0;
+  }
+  size = st.st_size;
+
+  snprintf(etag, sizeof etag, "\"%llx-%llx\"", (unsigned long long) size,
+      (unsigned long long) st.st_mtime);
+  gmtime_r(&st.st_mtime, &tm);
+  strftime(last_modified, sizeof last_modified, "%a, %d %b %Y %H:%M:%S GMT",
+      &tm);
+
+  range = getenv("HTTP_RANGE");
+  if_range = getenv("HTTP_IF_RANGE");
+  range_count = 0;
+  if (range && *range && (!if_range || !*if_range ||
+      if_range_matches(if_range)))
+    range_count = parse_ranges(range);
+
+  printf("Accept-Ranges: bytes\nETag: %s\nLast-Modified: %s\n", etag,
+      last_modified);
+
+  if (range_count == -1) {
+    status = 416;
+    printf("Status: 416 Range Not Satisfiable\n"
+        "Content-Range: bytes */%lld\nContent-Length: 0\n\n",
+        (long long) size);
+    return 0;
+  }
+
+  if (range_count == 0) {
+    status = 200;
+    printf("Status: 200 OK\nContent-Type: %s\nContent-Length: %lld\n\n",
+        type, (long long) size);
+    fflush(stdout);
+    if (!head)
+      copy_range(fd, 0, size);
+    return 0;
+  }
+
+  status = 206;
+  if (range_count == 1) {
+    printf("Status: 206 Partial Content\nContent-Type: %s\n"
+        "Content-Range: bytes %lld-%lld/%lld\nContent-Length: %lld\n\n",
+        type, (long long) ranges[0].first, (long long) ranges[0].last,
+        (long long) size, (long long) (ranges[0].last - ranges[0].first + 1));
+    fflush(stdout);
+    if (!head)
+      copy_range(fd, ranges[0].first, ranges[0].last - ranges[0].first + 1);
+    return 0;
+  }
+
+  /* multipart/byteranges: work out the exact length before writing */
+  snprintf(boundary, sizeof boundary, "martin%08lx%08lx",
+      (unsigned long) time(0), (unsigned long) getpid());
+  length = 0;
+  for (i = 0; i != range_count; i++)
+    length += part_header(part, sizeof part, type, &ranges[i]) +
+        ranges[i].last - ranges[i].first + 1;
+  length += strlen(boundary) + 8;
+
+  printf("Status: 206 Partial Content\n"
+      "Content-Type: multipart/byteranges; boundary=%s\n"
+      "Content-Length: %lld\n\n", boundary, (long long) length);
+  fflush(stdout);
+  if (head)
+    return 0;
+
+  for (i = 0; i != range_count; i++) {
+    write_all(part, part_header(part, sizeof part, type, &ranges[i]));
+    copy_range(fd, ranges[i].first, ranges[i].last - ranges[i].first + 1);
+  }
+  snprintf(part, sizeof part, "\r\n--%s--\r\n", boundary);
+  write_all(part, strlen(part));
+  return 0;
+}
+
+
+/**
+ * Parse "bytes=first-last, first-, -suffix, ..." into ranges. Returns the
+ * number of satisfiable ranges, 0 to ignore the header (malformed or too
+ * many ranges), or -1 if no range can be satisfied.
+ */
+int parse_ranges(const char *header)
+{
+  long long first, last;
+  const char *p = header;
+  char *end;
+  int n = 0, specs = 0;
+
+  if (strncmp(p, "bytes=", 6))
+    return 0;
+  p += 6;
+
+  while (1) {
+    p += strspn(p, " \t");
+    if (*p == ',') {
+      p++;
+      continue;
+    }
+    if (*p == 0)
+      break;
+    if (++specs > MAX_RANGES)
+      return 0;
+
+    if (*p == '-') {
+      /* the last N bytes */
+      last = strtoll(p + 1, &end, 10);
+      if (end == p + 1 || last < 0)
+        return 0;
+      p = end;
+      if (last == 0)
+        continue;
+      first = size < last ? 0 : size - last;
+      last = size - 1;
+    } else {
+      first = strtoll(p, &end, 10);
+      if (end == p || first < 0 || *end != '-')
+        return 0;
+      p = end + 1;
+      if ('0' <= *p && *p <= '9') {
+        last = strtoll(p, &end, 10);
+        if (last < first)
+          return 0;
+        p = end;
+      } else {
+        last = size - 1;
+      }
+      if (size <= first)
+        continue;
+      if (size <= last)
+        last = size - 1;
+    }
+
+    p += strspn(p, " \t");
+    if (*p != ',' && *p != 0)
+      return 0;
+    if (size == 0)
+      continue;
+    ranges[n].first = first;
+    ranges[n].last = last;
+    n++;
+  }
+  if (specs == 0)
+    return 0;
+  return n ? n : -1;
+}
+
+
+/**
+ * An If-Range holding an entity tag must match the ETag exactly (a weak tag
+ * never matches); one holding a date must equal Last-Modified.
+ */
+bool if_range_matches(const char *header)
+{
+  if (header[0] == '"')
+    return strcmp(header, etag) == 0;
+  if (header[0] == 'W' && header[1] == '/')
+    return false;
+  return strcmp(header, last_modified) == 0;
+}
+
+
+/**
+ * Format the delimiter and headers that come before a part, returning
+ * their length.
+ */
+off_t part_header(char *buf, size_t n, const char *type, struct range *r)
+{
+  return snprintf(buf, n, "\r\n--%s\r\nContent-Type: %s\r\n"
+      "Content-Range: bytes %lld-%lld/%lld\r\n\r\n", boundary, type,
+      (long long) r->first, (long long) r->last, (long long) size);
+}
+
+
+/**
+ * Copy LENGTH bytes of the file from OFFSET to stdout with sendfile,
+ * falling back to pread and write where stdout does not support it.
+ */
+void copy_range(int fd, off_t offset, off_t length)
+{
+  char buffer[65536];
+  ssize_t n;
+
+  while (length > 0) {
+    n = sendfile(1, fd, &offset, length < 0x7ffff000 ? length : 0x7ffff000);
+    if (n > 0) {
+      length -= n;
+      sent += n;
+      continue;
+    }
+    if (n == 0)
+      die("File shrank while being sent");
+    if (errno != EINVAL && errno != ENOSYS)
+      die(strerror(errno));
+
+    n = pread(fd, buffer, length < (off_t) sizeof buffer ? length :
+        (off_t) sizeof buffer, offset);
+    if (n <= 0)
+      die("File shrank while being sent");
+    write_all(buffer, n);
+    offset += n;
+    length -= n;
+  }
+}
+
+
+void write_all(const char *p, size_t n)
+{
+  ssize_t w;
+
+  while (n) {
+    w = write(1, p, n);
+    if (w <= 0)
+      die(strerror(errno));
+    p += w;
+    n -= w;
+    sent += w;
+  }
+}
+
+
+/**
+ * Save the status and the body bytes written in MARTIN_STATUS_FILE, if set.
+ */
+void report_status(void)
+{
+  const char *path = getenv("MARTIN_STATUS_FILE");
+  FILE *f;
+
+  if (!status || !path || !*path || !(f = fopen(path, "w")))
+    return;
+  fprintf(f, "%d %lld\n", status, (long long) sent);
+  fclose(f);
+}
+
+
+/**
+ * Print an error message and exit.
+ */
+void die(const char *error)
+{
+  fprintf(stderr, "sendfile: %s\n", error);
+  exit(EXIT_FAILURE);
+}
@@ -0,0 +1,529 @@
+/*
+ * Shared-memory session store for martin
+ * Licensed under the MIT License
+ *                http://www.opensource.org/licenses/mit-license
+ */
+
+/*
+ * Compile using
+ *   gcc -W -Wall -O2 -o session session.c
+ *
+ * Usage:
+ *   session FILE new
+ *       print a new signed session cookie value
+ *   session FILE get COOKIE KEY
+ *       print the value of KEY in the session, exit 1 if it is unset, has
+ *       expired or the cookie signature is wrong
+ *   session FILE set COOKIE KEY VALUE [TTL]
+ *       store VALUE for TTL seconds (default 3600), exit 2 if the cookie
+ *       signature is wrong
+ *
+ * The store is an open-addressing hash table in FILE, mapped shared by all
+ * workers. Each bucket carries a sequence counter: readers copy the bucket
+ * without locking and retry if the counter was odd or changed meanwhile,
+ * writers take the bucket's own spin lock and bump the counter around the
+ * update. Buckets are never emptied again once used, so probe chains stay
+ * intact; an expired bucket is simply reused by the next write that lands
+ * on it.
+ *
+ * Cookies are "<session id>.<HMAC-SHA256 of the id>", keyed with
+ * SESSION_SECRET from the environment or else a random secret generated
+ * when FILE is created.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+#define SESSION_MAGIC 0x73657373
+#define BUCKETS 16384
+#define KEY_SIZE 96
+#define VALUE_SIZE 416
+#define ID_SIZE 32
+#define MAC_SIZE 32
+#define COOKIE_SIZE (ID_SIZE + 1 + MAC_SIZE)
+#define DEFAULT_TTL 3600
+
+struct bucket {
+  uint32_t sequence;
+  uint32_t lock;
+  uint64_t hash;
+  int64_t expires;
+  uint16_t key_len;
+  uint16_t value_len;
+  char key[KEY_SIZE];
+  char value[VALUE_SIZE];
+};
+
+struct store {
+  uint32_t magic;
+  uint32_t buckets;
+  unsigned char secret[32];
+  struct bucket bucket[BUCKETS];
+};
+
+struct sha256 {
+  uint32_t h[8];
+  uint64_t len;
+  unsigned char buf[64];
+  size_t used;
+};
+
+struct store *store;
+unsigned char secret[32];
+size_t secret_len;
+
+
+void open_store(const char *path);
+void random_bytes(unsigned char *p, size_t n);
+uint64_t hash_key(const char *key, size_t len);
+bool session_id(const char *cookie, char *id);
+void make_key(const char *id, const char *name, char *key, size_t *len);
+void read_bucket(struct bucket *b, struct bucket *copy);
+bool store_get(const char *key, size_t key_len, char *value, size_t *len);
+bool store_set(const char *key, size_t key_len, const char *value,
+    size_t len, int64_t ttl);
+void sign(const char *id, char *mac);
+void hex(const unsigned char *p, size_t n, char *out);
+void sha256_init(struct sha256 *c);
+void sha256_update(struct sha256 *c, const void *data, size_t n);
+void sha256_final(struct sha256 *c, unsigned char *digest);
+void sha256_block(struct sha256 *c, const unsigned char *p);
+void hmac_sha256(const unsigned char *key, size_t key_len, const void *data,
+    size_t n, unsigned char *mac);
+void die(const char *error);
+
+
+/**
+ * Main entry point.
+ */
+int main(int argc, char *argv[])
+{
+  char id[ID_SIZE + 1], mac[MAC_SIZE + 1], key[KEY_SIZE], value[VALUE_SIZE];
+  unsigned char raw[ID_SIZE / 2];
+  size_t key_len, len;
+
+  if (argc < 3)
+    die("Usage: session FILE new | get COOKIE KEY | set COOKIE KEY VALUE "
+        "[TTL]");
+
+  open_store(argv[1]);
+
+  if (strcmp(argv[2], "new") == 0 && argc == 3) {
+    random_bytes(raw, sizeof raw);
+    hex(raw, sizeof raw, id);
+    sign(id, mac);
+    printf("%s.%s\n", id, mac);
+
+  } else if (strcmp(argv[2], "get") == 0 && argc == 5) {
+    if (!session_id(argv[3], id))
+      return 1;
+    make_key(id, argv[4], key, &key_len);
+    if (!store_get(key, key_len, value, &len))
+      return 1;
+    fwrite(value, 1, len, stdout);
+    putchar('\n');
+
+  } else if (strcmp(argv[2], "set") == 0 && (argc == 6 || argc == 7)) {
+    if (!session_id(argv[3], id))
+      return 2;
+    make_key(id, argv[4], key, &key_len);
+    len = strlen(argv[5]);
+    if (VALUE_SIZE < len)
+      die("Value too long");
+    if (!store_set(key, key_len, argv[5], len,
+        argc == 7 ? atoll(argv[6]) : DEFAULT_TTL))
+      die("Session store is full");
+
+  } else {
+    die("Unknown command");
+  }
+
+  return 0;
+}
+
+
+/**
+ * Map the store, creating it with a fresh secret if necessary.
+ */
+void open_store(const char *path)
+{
+  struct stat st;
+  uint32_t expected = 0;
+  const char *env;
+  int fd;
+
+  fd = open(path, O_RDWR | O_CREAT, 0600);
+  if (fd == -1)
+    die(strerror(errno));
+  if (fstat(fd, &st))
+    die(strerror(errno));
+  if ((size_t) st.st_size < sizeof *store && ftruncate(fd, sizeof *store))
+    die(strerror(errno));
+
+  store = mmap(0, sizeof *store, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (store == MAP_FAILED)
+    die(strerror(errno));
+  close(fd);
+
+  if (__atomic_load_n(&store->magic, __ATOMIC_ACQUIRE) != SESSION_MAGIC) {
+    if (__atomic_compare_exchange_n(&store->magic, &expected,
+        SESSION_MAGIC - 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      random_bytes(store->secret, sizeof store->secret);
+      store->buckets = BUCKETS;
+      __atomic_store_n(&store->magic, SESSION_MAGIC, __ATOMIC_RELEASE);
+    } else {
+      while (__atomic_load_n(&store->magic, __ATOMIC_ACQUIRE) !=
+          SESSION_MAGIC)
+        ;
+    }
+  }
+
+  env = getenv("SESSION_SECRET");
+  if (env && *env) {
+    /* hash the configured secret so any length can be used */
+    struct sha256 c;
+    sha256_init(&c);
+    sha256_update(&c, env, strlen(env));
+    sha256_final(&c, secret);
+  } else {
+    memcpy(secret, store->secret, sizeof secret);
+  }
+  secret_len = sizeof secret;
+}
+
+
+void random_bytes(unsigned char *p, size_t n)
+{
+  int fd = open("/dev/urandom", O_RDONLY);
+  if (fd == -1 || read(fd, p, n) != (ssize_t) n)
+    die("Failed to read /dev/urandom");
+  close(fd);
+}
+
+
+/**
+ * FNV-1a 64 bit hash. Zero is reserved for unused buckets.
+ */
+uint64_t hash_key(const char *key, size_t len)
+{
+  uint64_t h = 14695981039346656037ULL;
+  size_t i;
+  for (i = 0; i != len; i++)
+    h = (h ^ (unsigned char) key[i]) * 1099511628211ULL;
+  return h ? h : 1;
+}
+
+
+/**
+ * Check a cookie's signature and extract the session id from it.
+ */
+bool session_id(const char *cookie, char *id)
+{
+  char mac[MAC_SIZE + 1];
+  unsigned char diff = 0;
+  size_t i;
+
+  if (strlen(cookie) != COOKIE_SIZE || cookie[ID_SIZE] != '.')
+    return false;
+  memcpy(id, cookie, ID_SIZE);
+  id[ID_SIZE] = 0;
+  if (strspn(id, "0123456789abcdef") != ID_SIZE)
+    return false;
+
+  sign(id, mac);
+  for (i = 0; i != MAC_SIZE; i++)
+    diff |= mac[i] ^ cookie[ID_SIZE + 1 + i];
+  return diff == 0;
+}
+
+
+void make_key(const char *id, const char *name, char *key, size_t *len)
+{
+  size_t n = strlen(name);
+  if (KEY_SIZE < ID_SIZE + 1 + n)
+    die("Key too long");
+  memcpy(key, id, ID_SIZE);
+  key[ID_SIZE] = ' ';
+  memcpy(key + ID_SIZE + 1, name, n);
+  *len = ID_SIZE + 1 + n;
+}
+
+
+/**
+ * Copy a bucket without locking, retrying while a writer is active on it.
+ */
+void read_bucket(struct bucket *b, struct bucket *copy)
+{
+  uint32_t seq;
+
+  do {
+    seq = __atomic_load_n(&b->sequence, __ATOMIC_ACQUIRE);
+    if (seq & 1)
+      continue;
+    memcpy(copy, b, sizeof *copy);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  } while ((seq & 1) || __atomic_load_n(&b->sequence, __ATOMIC_RELAXED)
+      != seq);
+}
+
+
+/**
+ * Look up a key without taking any lock.
+ */
+bool store_get(const char *key, size_t key_len, char *value, size_t *len)
+{
+  uint64_t h = hash_key(key, key_len);
+  struct bucket copy;
+  unsigned int i, n;
+
+  for (n = 0, i = h % BUCKETS; n != BUCKETS; n++, i = (i + 1) % BUCKETS) {
+    read_bucket(&store->bucket[i], &copy);
+    if (copy.hash == 0)
+      return false;
+    if (copy.hash == h && copy.key_len == key_len &&
+        memcmp(copy.key, key, key_len) == 0) {
+      if (copy.expires <= time(0) || VALUE_SIZE < copy.value_len)
+        return false;
+      memcpy(value, copy.value, copy.value_len);
+      *len = copy.value_len;
+      return true;
+    }
+  }
+  return false;
+}
+
+
+/**
+ * Store a key, updating it in place if present or else taking the first
+ * empty or expired bucket on its probe chain.
+ *
+ * The chain is scanned without locks; only the chosen bucket is locked, and
+ * the scan is repeated if another writer changed it in the meantime.
+ */
+bool store_set(const char *key, size_t key_len, const char *value,
+    size_t len, int64_t ttl)
+{
+  uint64_t h = hash_key(key, key_len);
+  int64_t t = time(0);
+  struct bucket *b, copy;
+  uint32_t unlocked;
+  unsigned int i, n, target;
+  bool found, usable;
+
+  while (1) {
+    found = false;
+    target = BUCKETS;
+    for (n = 0, i = h % BUCKETS; n != BUCKETS; n++, i = (i + 1) % BUCKETS) {
+      read_bucket(&store->bucket[i], &copy);
+      if (copy.hash == h && copy.key_len == key_len &&
+          memcmp(copy.key, key, key_len) == 0) {
+        target = i;
+        found = true;
+        break;
+      }
+      if ((copy.hash == 0 || copy.expires <= t) && target == BUCKETS)
+        target = i;
+      if (copy.hash == 0)
+        break;
+    }
+    if (target == BUCKETS)
+      return false;
+
+    b = &store->bucket[target];
+    do {
+      unlocked = 0;
+    } while (!__atomic_compare_exchange_n(&b->lock, &unlocked, 1, true,
+        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+
+    if (found)
+      usable = b->hash == h && b->key_len == key_len &&
+          memcmp(b->key, key, key_len) == 0;
+    else
+      usable = b->hash == 0 || b->expires <= t;
+    if (usable)
+      break;
+    __atomic_store_n(&b->lock, 0, __ATOMIC_RELEASE);
+  }
+
+  __atomic_add_fetch(&b->sequence, 1, __ATOMIC_ACQ_REL);
+  b->hash = h;
+  b->expires = t + ttl;
+  b->key_len = key_len;
+  b->value_len = len;
+  memcpy(b->key, key, key_len);
+  memcpy(b->value, value, len);
+  __atomic_add_fetch(&b->sequence, 1, __ATOMIC_RELEASE);
+  __atomic_store_n(&b->lock, 0, __ATOMIC_RELEASE);
+  return true;
+}
+
+
+/**
+ * The truncated hex HMAC of a session id.
+ */
+void sign(const char *id, char *mac)
+{
+  unsigned char digest[32];
+  hmac_sha256(secret, secret_len, id, ID_SIZE, digest);
+  hex(digest, MAC_SIZE / 2, mac);
+}
+
+
+void hex(const unsigned char *p, size_t n, char *out)
+{
+  static const char digits[] = "0123456789abcdef";
+  size_t i;
+  for (i = 0; i != n; i++) {
+    out[i * 2] = digits[p[i] >> 4];
+    out[i * 2 + 1] = digits[p[i] & 15];
+  }
+  out[n * 2] = 0;
+}
+
+
+/* SHA-256 [FIPS 180-4] */
+static const uint32_t sha256_k[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+  0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+  0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+  0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+  0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+  0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+  0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+  0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+  0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+void sha256_init(struct sha256 *c)
+{
+  static const uint32_t h0[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+  };
+  memcpy(c->h, h0, sizeof h0);
+  c->len = 0;
+  c->used = 0;
+}
+
+void sha256_block(struct sha256 *c, const unsigned char *p)
+{
+  uint32_t w[64], a, b, d, e, f, g, h, cc, t1, t2;
+  unsigned int i;
+
+  for (i = 0; i != 16; i++)
+    w[i] = (uint32_t) p[i * 4] << 24 | p[i * 4 + 1] << 16 |
+        p[i * 4 + 2] << 8 | p[i * 4 + 3];
+  for (; i != 64; i++)
+    w[i] = (ROR(w[i - 2], 17) ^ ROR(w[i - 2], 19) ^ (w[i - 2] >> 10)) +
+        w[i - 7] + (ROR(w[i - 15], 7) ^ ROR(w[i - 15], 18) ^
+        (w[i - 15] >> 3)) + w[i - 16];
+
+  a = c->h[0]; b = c->h[1]; cc = c->h[2]; d = c->h[3];
+  e = c->h[4]; f = c->h[5]; g = c->h[6]; h = c->h[7];
+  for (i = 0; i != 64; i++) {
+    t1 = h + (ROR(e, 6) ^ ROR(e, 11) ^ ROR(e, 25)) + ((e & f) ^ (~e & g)) +
+        sha256_k[i] + w[i];
+    t2 = (ROR(a, 2) ^ ROR(a, 13) ^ ROR(a, 22)) +
+        ((a & b) ^ (a & cc) ^ (b & cc));
+    h = g; g = f; f = e; e = d + t1;
+    d = cc; cc = b; b = a; a = t1 + t2;
+  }
+  c->h[0] += a; c->h[1] += b; c->h[2] += cc; c->h[3] += d;
+  c->h[4] += e; c->h[5] += f; c->h[6] += g; c->h[7] += h;
+}
+
+void sha256_update(struct sha256 *c, const void *data, size_t n)
+{
+  const unsigned char *p = data;
+  size_t take;
+
+  c->len += n;
+  while (n) {
+    take = 64 - c->used;
+    if (n < take)
+      take = n;
+    memcpy(c->buf + c->used, p, take);
+    c->used += take;
+    p += take;
+    n -= take;
+    if (c->used == 64) {
+      sha256_block(c, c->buf);
+      c->used = 0;
+    }
+  }
+}
+
+void sha256_final(struct sha256 *c, unsigned char *digest)
+{
+  uint64_t bits = c->len * 8;
+  unsigned int i;
+
+  c->buf[c->used++] = 0x80;
+  if (56 < c->used) {
+    memset(c->buf + c->used, 0, 64 - c->used);
+    sha256_block(c, c->buf);
+    c->used = 0;
+  }
+  memset(c->buf + c->used, 0, 56 - c->used);
+  for (i = 0; i != 8; i++)
+    c->buf[56 + i] = bits >> (56 - i * 8);
+  sha256_block(c, c->buf);
+
+  for (i = 0; i != 8; i++) {
+    digest[i * 4] = c->h[i] >> 24;
+    digest[i * 4 + 1] = c->h[i] >> 16;
+    digest[i * 4 + 2] = c->h[i] >> 8;
+    digest[i * 4 + 3] = c->h[i];
+  }
+}
+
+/* HMAC [RFC 2104] */
+void hmac_sha256(const unsigned char *key, size_t key_len, const void *data,
+    size_t n, unsigned char *mac)
+{
+  unsigned char pad[64], inner[32];
+  struct sha256 c;
+  unsigned int i;
+
+  memset(pad, 0, sizeof pad);
+  memcpy(pad, key, key_len);
+  for (i = 0; i != 64; i++)
+    pad[i] ^= 0x36;
+  sha256_init(&c);
+  sha256_update(&c, pad, 64);
+  sha256_update(&c, data, n);
+  sha256_final(&c, inner);
+
+  for (i = 0; i != 64; i++)
+    pad[i] ^= 0x36 ^ 0x5c;
+  sha256_init(&c);
+  sha256_update(&c, pad, 64);
+  sha256_update(&c, inner, sizeof inner);
+  sha256_final(&c, mac);
+}
+
+
+/**
+ * Print an error message and exit.
+ */
+void die(const char *error)
+{
+  fprintf(stderr, "session: %s\n", error);
+  exit(EXIT_FAILURE);
+}
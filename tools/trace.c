@@ -0,0 +1,242 @@
+/*
+ * Per-request phase tracing for wwwoosh / martin
+ * Licensed under the MIT License
+ *                http://www.opensource.org/licenses/mit-license
+ */
+
+/*
+ * Compile using
+ *   gcc -W -Wall -O2 -o trace trace.c
+ *
+ * Usage:
+ *   trace now
+ *       print CLOCK_MONOTONIC in microseconds
+ *   trace FILE span m|r REQUEST_ID NAME START END [NAME START END ...]
+ *       append spans to the ring buffer in FILE. Times are microseconds on
+ *       the monotonic clock (m), or on the realtime clock (r), as given by
+ *       bash's EPOCHREALTIME without a fork; realtime stamps are converted
+ *       to the monotonic clock as they are recorded.
+ *   trace FILE dump [OUTPUT]
+ *       write the spans held in the ring buffer as Chrome trace-event JSON,
+ *       which chrome://tracing and Perfetto can open
+ *
+ * The ring buffer keeps the last RING_SIZE spans. Writers claim a slot with
+ * an atomic add and publish it by storing its sequence number last, so the
+ * buffer can be dumped while the server is running.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+#define TRACE_MAGIC 0x74726365
+#define RING_SIZE 16384
+
+struct span {
+  uint64_t sequence;
+  uint64_t start;
+  uint64_t duration;
+  uint32_t pid;
+  char request[28];
+  char name[24];
+};
+
+struct ring {
+  uint32_t magic;
+  uint32_t size;
+  uint64_t next;
+  struct span span[RING_SIZE];
+};
+
+struct ring *ring;
+
+
+void open_ring(const char *path);
+uint64_t clock_us(clockid_t clock);
+void add_spans(int argc, char *argv[]);
+void dump(const char *path);
+void print_string(FILE *f, const char *s);
+void die(const char *error);
+
+
+/**
+ * Main entry point.
+ */
+int main(int argc, char *argv[])
+{
+  if (argc == 2 && strcmp(argv[1], "now") == 0) {
+    printf("%llu\n", (unsigned long long) clock_us(CLOCK_MONOTONIC));
+    return 0;
+  }
+
+  if (argc < 3)
+    die("Usage: trace now | trace FILE span ... | trace FILE dump [output]");
+
+  open_ring(argv[1]);
+
+  if (strcmp(argv[2], "span") == 0)
+    add_spans(argc - 3, argv + 3);
+  else if (strcmp(argv[2], "dump") == 0)
+    dump(argc > 3 ? argv[3] : 0);
+  else
+    die("Unknown command");
+
+  return 0;
+}
+
+
+/**
+ * Map the ring buffer file, creating it if necessary.
+ */
+void open_ring(const char *path)
+{
+  struct stat st;
+  uint32_t expected = 0;
+  int fd;
+
+  fd = open(path, O_RDWR | O_CREAT, 0600);
+  if (fd == -1)
+    die(strerror(errno));
+  if (fstat(fd, &st))
+    die(strerror(errno));
+  if ((size_t) st.st_size < sizeof *ring && ftruncate(fd, sizeof *ring))
+    die(strerror(errno));
+
+  ring = mmap(0, sizeof *ring, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (ring == MAP_FAILED)
+    die(strerror(errno));
+  close(fd);
+
+  if (__atomic_compare_exchange_n(&ring->magic, &expected, TRACE_MAGIC,
+      false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    ring->size = RING_SIZE;
+  else if (expected != TRACE_MAGIC)
+    die("Not a trace file");
+}
+
+
+uint64_t clock_us(clockid_t clock)
+{
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+
+/**
+ * Record spans: m|r REQUEST_ID followed by NAME START END triples.
+ */
+void add_spans(int argc, char *argv[])
+{
+  int64_t offset = 0;
+  uint64_t start, end, n;
+  struct span *s;
+  int i;
+
+  if (argc < 2 || (argc - 2) % 3)
+    die("Usage: trace FILE span m|r REQUEST_ID NAME START END ...");
+
+  if (argv[0][0] == 'r')
+    offset = clock_us(CLOCK_REALTIME) - clock_us(CLOCK_MONOTONIC);
+
+  for (i = 2; i != argc; i += 3) {
+    start = strtoull(argv[i + 1], 0, 10) - offset;
+    end = strtoull(argv[i + 2], 0, 10) - offset;
+
+    n = __atomic_fetch_add(&ring->next, 1, __ATOMIC_RELAXED);
+    s = &ring->span[n % RING_SIZE];
+
+    /* mark the slot as being rewritten before touching its contents */
+    __atomic_store_n(&s->sequence, 0, __ATOMIC_RELEASE);
+    s->start = start;
+    s->duration = start < end ? end - start : 0;
+    s->pid = getppid();
+    snprintf(s->request, sizeof s->request, "%s", argv[1]);
+    snprintf(s->name, sizeof s->name, "%s", argv[i]);
+    __atomic_store_n(&s->sequence, n + 1, __ATOMIC_RELEASE);
+  }
+}
+
+
+/**
+ * Write the buffered spans, oldest first, as a Chrome trace-event file.
+ */
+void dump(const char *path)
+{
+  uint64_t next = __atomic_load_n(&ring->next, __ATOMIC_ACQUIRE), n;
+  struct span copy, *s;
+  bool first = true;
+  FILE *f = stdout;
+
+  if (path) {
+    f = fopen(path, "w");
+    if (!f)
+      die(strerror(errno));
+  }
+
+  fprintf(f, "{\"traceEvents\":[");
+  for (n = next < RING_SIZE ? 0 : next - RING_SIZE; n != next; n++) {
+    s = &ring->span[n % RING_SIZE];
+    if (__atomic_load_n(&s->sequence, __ATOMIC_ACQUIRE) != n + 1)
+      continue;
+    copy = *s;
+    copy.request[sizeof copy.request - 1] = 0;
+    copy.name[sizeof copy.name - 1] = 0;
+    /* skip a slot that was overwritten while we copied it */
+    if (__atomic_load_n(&s->sequence, __ATOMIC_ACQUIRE) != n + 1)
+      continue;
+
+    fprintf(f, "%s\n{\"name\":", first ? "" : ",");
+    print_string(f, copy.name);
+    fprintf(f, ",\"cat\":\"wwwoosh\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,"
+        "\"pid\":%u,\"tid\":%u,\"args\":{\"request\":",
+        (unsigned long long) copy.start, (unsigned long long) copy.duration,
+        copy.pid, copy.pid);
+    print_string(f, copy.request);
+    fprintf(f, "}}");
+    first = false;
+  }
+  fprintf(f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+  if (path)
+    fclose(f);
+}
+
+
+/**
+ * Print a JSON string literal.
+ */
+void print_string(FILE *f, const char *s)
+{
+  fputc('"', f);
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\')
+      fprintf(f, "\\%c", *s);
+    else if ((unsigned char) *s < 32)
+      fprintf(f, "\\u%04x", *s);
+    else
+      fputc(*s, f);
+  }
+  fputc('"', f);
+}
+
+
+/**
+ * Print an error message and exit.
+ */
+void die(const char *error)
+{
+  fprintf(stderr, "trace: %s\n", error);
+  exit(EXIT_FAILURE);
+}
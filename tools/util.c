@@ -1,4 +1,11 @@
+#include <ctype.h>
+#include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include "util.h"
 
 #define LF 10
 #define CR 13
@@ -70,7 +77,8 @@ void unescape_url(char *url) {
     register int x,y;
 
     for(x=0,y=0;url[y];++x,++y) {
-        if((url[x] = url[y]) == '%') {
+        if(((url[x] = url[y]) == '%') && isxdigit(url[y+1]) &&
+           isxdigit(url[y+2])) {
             url[x] = x2c(&url[y+1]);
             y+=2;
         }
@@ -91,20 +99,119 @@ int rind(char *s, char c) {
     return -1;
 }
 
-int getline(char *s, int n, FILE *f) {
-    register int i=0;
+/*
+ * Buffered line reader. Lines are found with memchr over a large buffer and
+ * returned as slices into it, without the LF or a CRLF. A line longer than
+ * max_line is reported once as LR_TOOLONG and then skipped. Setting left
+ * after lr_init stops the reader that many bytes in, as for a request body
+ * of CONTENT_LENGTH bytes.
+ */
+
+int lr_init(line_reader *r, int fd, long max_line) {
+    r->fd = fd;
+    r->max_line = max_line;
+    r->left = -1;
+    r->size = (max_line + 2 > LR_BLOCK_SIZE) ? max_line + 2 : LR_BLOCK_SIZE;
+    r->start = r->end = r->scan = 0;
+    r->eof = r->skipping = 0;
+    r->buf = (char *) malloc(r->size);
+    return r->buf ? LR_OK : LR_ERR_IO;
+}
+
+void lr_free(line_reader *r) {
+    free(r->buf);
+    r->buf = NULL;
+}
+
+static int lr_fill(line_reader *r) {
+    ssize_t n;
+    long want;
+
+    if(r->start) {
+        memmove(r->buf, r->buf + r->start, r->end - r->start);
+        r->end -= r->start;
+        r->scan -= r->start;
+        r->start = 0;
+    }
+    if(r->end == r->size)
+        return 0;
+    want = r->size - r->end;
+    if((r->left >= 0) && (want > r->left))
+        want = r->left;
+    if(want == 0) {
+        r->eof = 1;
+        return 0;
+    }
+    do
+        n = read(r->fd, r->buf + r->end, want);
+    while((n == -1) && (errno == EINTR));
+    if(n < 0)
+        return -1;
+    if(n == 0)
+        r->eof = 1;
+    if(r->left >= 0)
+        r->left -= n;
+    r->end += n;
+    return n;
+}
+
+int lr_next(line_reader *r, lr_slice *line) {
+    char *lf;
+    long len;
+    int n;
 
     while(1) {
-        s[i] = (char)fgetc(f);
+        lf = memchr(r->buf + r->scan, LF, r->end - r->scan);
 
-        if(s[i] == CR)
-            s[i] = fgetc(f);
+        if(r->skipping) {
+            /* discard the rest of an overlong line */
+            if(lf) {
+                r->start = r->scan = lf - r->buf + 1;
+                r->skipping = 0;
+                continue;
+            }
+            r->start = r->scan = r->end;
+        } else if(lf) {
+            len = lf - (r->buf + r->start);
+            line->data = r->buf + r->start;
+            if((len > 0) && (lf[-1] == CR))
+                len--;
+            if(len > r->max_line) {
+                r->start = r->scan = lf - r->buf + 1;
+                return LR_TOOLONG;
+            }
+            line->len = len;
+            r->start = r->scan = lf - r->buf + 1;
+            return LR_OK;
+        } else {
+            r->scan = r->end;
+            /* allow for the CR of a CRLF */
+            if(r->end - r->start > r->max_line + 1) {
+                r->skipping = 1;
+                r->start = r->scan = r->end;
+                return LR_TOOLONG;
+            }
+        }
 
-        if((s[i] == 0x4) || (s[i] == LF) || (i == (n-1))) {
-            s[i] = '\0';
-            return (feof(f) ? 1 : 0);
+        if(r->eof) {
+            if(r->end == r->start)
+                return LR_EOF;
+            /* a final line without a line ending */
+            line->data = r->buf + r->start;
+            line->len = r->end - r->start;
+            r->start = r->scan = r->end;
+            if(r->skipping) {
+                r->skipping = 0;
+                return LR_EOF;
+            }
+            if(line->len > r->max_line)
+                return LR_TOOLONG;
+            return LR_OK;
         }
-        ++i;
+
+        n = lr_fill(r);
+        if(n < 0)
+            return LR_ERR_IO;
     }
 }
 
@@ -145,3 +252,295 @@ void escape_shell_cmd(char *cmd) {
     }
 }
 
+/*
+ * Streaming multipart/form-data reader. The body is read in MP_BLOCK_SIZE
+ * blocks and searched for the "CRLF--boundary" delimiter with
+ * Boyer-Moore-Horspool; only the last delimiter-length bytes of a block are
+ * ever carried over, so memory use does not depend on the upload size.
+ */
+
+typedef struct {
+    FILE *f;
+    long cl;
+    char *buf;
+    long start, end;
+} mp_stream;
+
+static long mp_fill(mp_stream *s) {
+    long n;
+    size_t r;
+
+    if(s->start) {
+        memmove(s->buf, s->buf + s->start, s->end - s->start);
+        s->end -= s->start;
+        s->start = 0;
+    }
+    n = MP_BLOCK_SIZE - s->end;
+    if((s->cl >= 0) && (n > s->cl))
+        n = s->cl;
+    if(n <= 0)
+        return 0;
+    r = fread(s->buf + s->end, 1, n, s->f);
+    s->end += r;
+    if(s->cl >= 0)
+        s->cl -= r;
+    return r;
+}
+
+static void bmh_init(const unsigned char *p, int m, int *skip) {
+    register int x;
+
+    for(x=0;x<256;x++)
+        skip[x] = m;
+    for(x=0;x<m-1;x++)
+        skip[p[x]] = m - 1 - x;
+}
+
+static long bmh_find(const unsigned char *h, long n, const unsigned char *p,
+                     int m, const int *skip) {
+    register long x = 0;
+    unsigned char c;
+
+    while(x <= n - m) {
+        c = h[x + m - 1];
+        if((c == p[m - 1]) && (memcmp(h + x, p, m - 1) == 0))
+            return x;
+        x += skip[c];
+    }
+    return -1;
+}
+
+/* copy a parameter such as name="..." out of a Content-Disposition value */
+static int mp_param(const char *header, const char *param, char *out,
+                    int size) {
+    const char *p = header;
+    int l = strlen(param), x = 0;
+
+    while((p = strchr(p, ';'))) {
+        p++;
+        while((*p == ' ') || (*p == '\t'))
+            p++;
+        if(strncasecmp(p, param, l) || (p[l] != '='))
+            continue;
+        p += l + 1;
+        if(*p == '"') {
+            for(p++;(*p) && (*p != '"') && (x < size - 1);p++) {
+                if((*p == '\\') && p[1])
+                    p++;
+                out[x++] = *p;
+            }
+        } else {
+            for(;(*p) && (*p != ';') && (*p != ' ') && (x < size - 1);p++)
+                out[x++] = *p;
+        }
+        out[x] = '\0';
+        return 0;
+    }
+    out[0] = '\0';
+    return -1;
+}
+
+int multipart_boundary(const char *content_type, char *boundary) {
+    char b[MP_BOUNDARY_MAX + 2];
+
+    if(strncasecmp(content_type, "multipart/form-data", 19))
+        return -1;
+    if(mp_param(content_type, "boundary", b, sizeof(b)))
+        return -1;
+    if((!b[0]) || (strlen(b) > MP_BOUNDARY_MAX))
+        return -1;
+    strcpy(boundary, b);
+    return 0;
+}
+
+int read_multipart(FILE *f, long cl, const char *boundary, multipart *mp) {
+    mp_stream s;
+    unsigned char delim[MP_BOUNDARY_MAX + 4];
+    int skip[256], m, fd = -1, r = MP_OK, is_file;
+    long pos, n, size = 0, fsize = 0;
+    char header[MP_HEADER_MAX], name[256], filename[256], type[256];
+    char path[1024], *field = NULL;
+    char *eol;
+
+    m = strlen(boundary);
+    if((m == 0) || (m > MP_BOUNDARY_MAX))
+        return MP_ERR_MALFORMED;
+    memcpy(delim, "\r\n--", 4);
+    memcpy(delim + 4, boundary, m);
+    m += 4;
+    bmh_init(delim, m, skip);
+
+    s.f = f;
+    s.cl = cl;
+    s.buf = (char *) malloc(MP_BLOCK_SIZE);
+    if(!s.buf)
+        return MP_ERR_IO;
+    /* the first delimiter has no leading CRLF, so supply one */
+    s.buf[0] = CR;
+    s.buf[1] = LF;
+    s.start = 0;
+    s.end = 2;
+
+    /* skip the preamble */
+    while(1) {
+        pos = bmh_find((unsigned char *) s.buf + s.start, s.end - s.start,
+                       delim, m, skip);
+        if(pos >= 0) {
+            s.start += pos + m;
+            break;
+        }
+        if(s.end - s.start > m - 1)
+            s.start = s.end - (m - 1);
+        if(!mp_fill(&s)) {
+            r = MP_ERR_MALFORMED;
+            goto done;
+        }
+    }
+
+    while(1) {
+        /* after a delimiter: "--" ends the body, CRLF starts a part */
+        while((s.end - s.start < 2) && mp_fill(&s));
+        if(s.end - s.start < 2) {
+            r = MP_ERR_MALFORMED;
+            goto done;
+        }
+        if((s.buf[s.start] == '-') && (s.buf[s.start + 1] == '-'))
+            goto done;
+        if((s.buf[s.start] != CR) || (s.buf[s.start + 1] != LF)) {
+            r = MP_ERR_MALFORMED;
+            goto done;
+        }
+        s.start += 2;
+
+        /* part headers, one line at a time */
+        name[0] = filename[0] = '\0';
+        strcpy(type, "text/plain");
+        is_file = 0;
+        while(1) {
+            eol = memchr(s.buf + s.start, CR, s.end - s.start);
+            while((!eol) || (eol + 1 >= s.buf + s.end)) {
+                if(s.end - s.start >= MP_HEADER_MAX) {
+                    r = MP_ERR_TOOLARGE;
+                    goto done;
+                }
+                if(!mp_fill(&s)) {
+                    r = MP_ERR_MALFORMED;
+                    goto done;
+                }
+                eol = memchr(s.buf + s.start, CR, s.end - s.start);
+            }
+            if(eol[1] != LF) {
+                r = MP_ERR_MALFORMED;
+                goto done;
+            }
+            n = eol - (s.buf + s.start);
+            /* a block can hold far more than one header line */
+            if(n >= MP_HEADER_MAX) {
+                r = MP_ERR_TOOLARGE;
+                goto done;
+            }
+            memcpy(header, s.buf + s.start, n);
+            header[n] = '\0';
+            s.start += n + 2;
+            if(n == 0)
+                break;
+
+            if(strncasecmp(header, "Content-Disposition:", 20) == 0) {
+                mp_param(header, "name", name, sizeof(name));
+                if(mp_param(header, "filename", filename,
+                            sizeof(filename)) == 0)
+                    is_file = 1;
+            } else if(strncasecmp(header, "Content-Type:", 13) == 0) {
+                for(eol=header+13;(*eol == ' ') || (*eol == '\t');eol++);
+                strncpy(type, eol, sizeof(type) - 1);
+                type[sizeof(type) - 1] = '\0';
+            }
+        }
+
+        /* part body */
+        if(is_file) {
+            snprintf(path, sizeof(path), "%s/upload.XXXXXX",
+                     mp->spool_dir ? mp->spool_dir : "/tmp");
+            fd = mkstemp(path);
+            if(fd == -1) {
+                r = MP_ERR_IO;
+                goto done;
+            }
+            fsize = 0;
+        } else {
+            size = 0;
+            field = (char *) malloc(1);
+            if(!field) {
+                r = MP_ERR_IO;
+                goto done;
+            }
+        }
+
+        while(1) {
+            pos = bmh_find((unsigned char *) s.buf + s.start,
+                           s.end - s.start, delim, m, skip);
+            /* everything but a possible partial delimiter can go */
+            n = (pos >= 0) ? pos : s.end - s.start - (m - 1);
+            if(n > 0) {
+                if(is_file) {
+                    if((mp->max_file > 0) && (fsize + n > mp->max_file)) {
+                        r = MP_ERR_TOOLARGE;
+                        goto done;
+                    }
+                    if(write(fd, s.buf + s.start, n) != n) {
+                        r = MP_ERR_IO;
+                        goto done;
+                    }
+                    fsize += n;
+                } else {
+                    if((mp->max_field > 0) && (size + n > mp->max_field)) {
+                        r = MP_ERR_TOOLARGE;
+                        goto done;
+                    }
+                    eol = (char *) realloc(field, size + n + 1);
+                    if(!eol) {
+                        r = MP_ERR_IO;
+                        goto done;
+                    }
+                    field = eol;
+                    memcpy(field + size, s.buf + s.start, n);
+                    size += n;
+                }
+                s.start += n;
+            }
+            if(pos >= 0) {
+                s.start += m;
+                break;
+            }
+            if(!mp_fill(&s)) {
+                r = MP_ERR_MALFORMED;
+                goto done;
+            }
+        }
+
+        if(is_file) {
+            close(fd);
+            fd = -1;
+            /* nobody will take the spooled file, so do not leave it */
+            if(mp->file)
+                mp->file(mp->arg, name, filename, type, path, fsize);
+            else
+                unlink(path);
+        } else {
+            field[size] = '\0';
+            if(mp->field)
+                mp->field(mp->arg, name, field, size);
+            free(field);
+            field = NULL;
+        }
+    }
+
+done:
+    if(fd != -1) {
+        close(fd);
+        unlink(path);
+    }
+    free(field);
+    free(s.buf);
+    return r;
+}
@@ -0,0 +1,62 @@
+#ifndef UTIL_H
+#define UTIL_H
+
+#include <stdio.h>
+
+/* buffered line reader */
+
+#define LR_OK 0
+#define LR_EOF 1
+#define LR_TOOLONG -2
+#define LR_ERR_IO -3
+
+#define LR_BLOCK_SIZE 65536
+
+typedef struct {
+    const char *data;
+    long len;
+} lr_slice;
+
+/* left is how many bytes may still be read from fd, or -1 to read to EOF */
+typedef struct {
+    int fd;
+    long max_line;
+    long left;
+    char *buf;
+    long size, start, end, scan;
+    int eof, skipping;
+} line_reader;
+
+int lr_init(line_reader *r, int fd, long max_line);
+int lr_next(line_reader *r, lr_slice *line);
+void lr_free(line_reader *r);
+
+/* multipart/form-data [RFC 2388] */
+
+#define MP_OK 0
+#define MP_ERR_MALFORMED -1
+#define MP_ERR_TOOLARGE -2
+#define MP_ERR_IO -3
+
+#define MP_BOUNDARY_MAX 70
+#define MP_BLOCK_SIZE 262144
+#define MP_HEADER_MAX 8192
+
+typedef struct {
+    /* where file parts are spooled, and the per-part size limits */
+    const char *spool_dir;
+    long max_field;
+    long max_file;
+
+    /* a form field, with its value in memory */
+    void (*field)(void *arg, const char *name, const char *value, long len);
+    /* a file part, already written to path */
+    void (*file)(void *arg, const char *name, const char *filename,
+                 const char *type, const char *path, long size);
+    void *arg;
+} multipart;
+
+int multipart_boundary(const char *content_type, char *boundary);
+int read_multipart(FILE *f, long cl, const char *boundary, multipart *mp);
+
+#endif
@@ -1,36 +1,188 @@
 #!/bin/sh
 
+# one or more space-separated addresses, each a TCP port or unix:PATH; all of
+# them are bound with tools/listen, netcat only takes the first
 wwwoosh_port="8080"
+# given to apps as SERVER_PORT: the first TCP port in wwwoosh_port
+wwwoosh_server_port="8080"
 wwwoosh_http_version="HTTP/1.1"
 
 wwwoosh_fifo="/tmp/wwwoosh_fifo"
+wwwoosh_clock_file="$wwwoosh_fifo.$$.clock"
 wwwoosh_debug_enabled=""
+wwwoosh_tools="./tools"
 
-CR=$'\r'
-LF=$'\n'
+# per-request phase spans are recorded to this ring buffer file when set
+wwwoosh_trace_file="$WWWOOSH_TRACE"
+wwwoosh_request_id=0
+
+# worker processes sharing the listening socket when tools/listen is built
+wwwoosh_workers="${WWWOOSH_WORKERS:-4}"
+
+# admission control in tools/listen: requests per second allowed from each
+# client address (with bursts of up to wwwoosh_rate_burst), and connections
+# served at once across all workers. 0 turns a limit off.
+wwwoosh_rate_limit="${WWWOOSH_RATE:-0}"
+wwwoosh_rate_burst="$WWWOOSH_BURST"
+wwwoosh_max_in_flight="${WWWOOSH_MAX_IN_FLIGHT:-0}"
+
+# set by wwwoosh_vhost, which needs host names in lower case to look them up
+wwwoosh_vhosts=""
+
+# requests with more header lines than this are refused with a 431
+wwwoosh_max_headers=100
+wwwoosh_max_header_name=256
+
+# plain sh has no $'\r' quoting, so build these with printf
+CR="$(printf '\r')"
+LF="
+"
+TAB="$(printf '\t')"
 CRLF="$CR$LF"
 
 wwwoosh () {
-    local app="$1"
-
-    # TODO: is there a better way than a named pipe?
-    rm -f "$wwwoosh_fifo"
-    mkfifo "$wwwoosh_fifo"
+    local app="$1" address
 
     [ $# -gt 1 ] && wwwoosh_port="$2"
     [ $# -gt 2 ] && wwwoosh_debug_enabled="$3"
 
-    echo "Starting Wwwoosh on port $wwwoosh_port..."
+    wwwoosh_server_port=""
+    for address in $wwwoosh_port; do
+        case "$address" in
+            unix:*) ;;
+            *) wwwoosh_server_port="$address"; break ;;
+        esac
+    done
+
+    # use sockets already opened by systemd or another supervisor, which
+    # only tools/listen can accept from
+    if [ "$LISTEN_FDS" ] && [ "$LISTEN_PID" = "$$" ]; then
+        if [ ! -x "$wwwoosh_tools/listen" ]; then
+            echo "Wwwoosh: $LISTEN_FDS socket(s) passed in, but $wwwoosh_tools/listen is not built to accept from them" 1>&2
+            exit 1
+        fi
+        echo "Starting Wwwoosh on $LISTEN_FDS inherited socket(s)..."
+        export WWWOOSH_LISTEN_FD=3 WWWOOSH_LISTEN_FDS="$LISTEN_FDS"
+        unset LISTEN_FDS LISTEN_PID LISTEN_FDNAMES
+    fi
+
+    # bind every address once with tools/listen, which runs this script
+    # again holding the listening sockets; without it, fall back to netcat
+    if [ -x "$wwwoosh_tools/listen" ] && [ ! "$WWWOOSH_LISTEN_FD" ]; then
+        echo "Starting Wwwoosh on $wwwoosh_port..."
+        wwwoosh_reexec "$wwwoosh_tools/listen" $wwwoosh_port
+    fi
+    [ "$WWWOOSH_LISTEN_FD" ] || echo "Starting Wwwoosh on $wwwoosh_port..."
+
+    if [ "$wwwoosh_trace_file" ]; then
+        trap 'wwwoosh_trace_dump' USR1
+        echo "Tracing to $wwwoosh_trace_file (kill -USR1 $$ to dump)"
+    fi
+
+    if [ "$WWWOOSH_LISTEN_FD" ]; then
+        wwwoosh_master "$app"
+    else
+        # TODO: is there a better way than a named pipe?
+        rm -f "$wwwoosh_fifo"
+        mkfifo "$wwwoosh_fifo"
+        wwwoosh_clock &
+
+        while true; do
+            wwwoosh_serve "$app" "$wwwoosh_fifo"
+        done
+    fi
+}
+
+# serve one request, reading it from the listener and sending the response
+# back through the fifo
+wwwoosh_serve () {
+    local app="$1" fifo="$2"
+    wwwoosh_request_id=$((wwwoosh_request_id + 1))
+    wwwoosh_listen $wwwoosh_port < "$fifo" |
+    wwwoosh_debug |
+    wwwoosh_handle_request "$app" |
+    wwwoosh_debug |
+    wwwoosh_handle_response > "$fifo"
+}
+
+# Workers: with a listening socket inherited on $WWWOOSH_LISTEN_FD, the
+# server runs a generation of $wwwoosh_workers worker loops that all accept
+# from it. SIGHUP or SIGUSR2 starts a new generation by running the script
+# again in place, so the app is sourced afresh and the socket stays open,
+# while the old workers finish the request they are on and exit. Each
+# generation lives as long as its marker file. Workers share $$, so each is
+# given its own WWWOOSH_WORKER id for naming temporary files.
 
-    while true; do
-        wwwoosh_listen $wwwoosh_port < "$wwwoosh_fifo" |
-        wwwoosh_debug |
-        wwwoosh_handle_request "$app" |
-        wwwoosh_debug |
-        wwwoosh_handle_response > "$wwwoosh_fifo"
+wwwoosh_master () {
+    local app="$1" i=1
+    export WWWOOSH_GENERATION=$((${WWWOOSH_GENERATION:-0} + 1))
+    wwwoosh_generation="$wwwoosh_fifo.$$.$WWWOOSH_GENERATION"
+    : > "$wwwoosh_generation"
+
+    # the admission state outlives reloads, since the pid stays the same
+    wwwoosh_admission=""
+    if [ "$wwwoosh_rate_limit" != 0 ] || [ "$wwwoosh_max_in_flight" != 0 ]; then
+        wwwoosh_admission="-a $wwwoosh_fifo.$$.admission"
+        wwwoosh_admission="$wwwoosh_admission -r $wwwoosh_rate_limit"
+        wwwoosh_admission="$wwwoosh_admission -m $wwwoosh_max_in_flight"
+        [ "$wwwoosh_rate_burst" ] &&
+            wwwoosh_admission="$wwwoosh_admission -b $wwwoosh_rate_burst"
+    fi
+
+    wwwoosh_clock &
+    while [ $i -le $wwwoosh_workers ]; do
+        WWWOOSH_WORKER="$WWWOOSH_GENERATION.$i" \
+            wwwoosh_worker "$app" "$wwwoosh_generation.$i" &
+        i=$((i + 1))
+    done
+    echo "Generation $WWWOOSH_GENERATION: $wwwoosh_workers workers (kill -HUP $$ to reload)"
+
+    trap 'wwwoosh_reload "$app"' HUP USR2
+    trap 'wwwoosh_stop' INT TERM
+
+    # wait returns early whenever a trap runs
+    while [ -e "$wwwoosh_generation" ]; do
+        wait
+        sleep 1
     done
 }
 
+wwwoosh_worker () {
+    local app="$1" fifo="$2"
+    rm -f "$fifo"
+    mkfifo "$fifo"
+    while [ -e "$wwwoosh_generation" ]; do
+        wwwoosh_serve "$app" "$fifo"
+    done
+    rm -f "$fifo"
+}
+
+wwwoosh_reload () {
+    echo "Reloading, generation $WWWOOSH_GENERATION draining..." 1>&2
+    rm -f "$wwwoosh_generation"
+    wwwoosh_reexec
+}
+
+wwwoosh_stop () {
+    echo "Stopping, waiting for requests in progress..." 1>&2
+    rm -f "$wwwoosh_generation"
+    wait
+    rm -f "$wwwoosh_fifo.$$.admission" "$wwwoosh_clock_file"
+    exit 0
+}
+
+# run the script again in this process, keeping the pid and open files,
+# optionally through a wrapper command given as arguments
+wwwoosh_reexec () {
+    case "$0" in
+        *wwwoosh.sh)
+            exec "$@" "$0" "$app" "$wwwoosh_port" $wwwoosh_debug_enabled ;;
+        *)
+            export PORT="$wwwoosh_port"
+            exec "$@" "$0" ;;
+    esac
+}
+
 wwwoosh_debug () {
     if [ $wwwoosh_debug_enabled ]; then
         tee /dev/stderr
@@ -42,82 +194,373 @@ wwwoosh_debug () {
 wwwoosh_handle_request () {
     local app="$1"
 
-    # read the request line
-    read request_line
+    wwwoosh_trace_start
+
+    # read the request line, doing nothing if the listener gave up without
+    # a connection
+    IFS= read -r request_line || [ "$request_line" ] || return 0
+    request_line="${request_line%$CR}"
+    wwwoosh_trace_mark "listen"
 
-    # read the header lines until we reach a blank line
-    while read header && [ ! "$header" = $'\r' ]; do
-        # FIXME: multiline headers
-        header_name="HTTP_$(echo $header | cut -d ':' -f 1 | tr 'a-z-' 'A-Z_')"
-        export $header_name="$(echo $header | cut -d ':' -f 2 | sed 's/^ //')"
+    # read the header lines until we reach a blank line, folding obsolete
+    # continuation lines (starting with a space or tab) into the previous one
+    local line header="" count=0 seen=" "
+    while IFS= read -r line; do
+        line="${line%$CR}"
+        case "$line" in
+            "") break ;;
+            [" $TAB"]*)
+                [ "$header" ] && header="$header ${line#"${line%%[!" $TAB"]*}"}"
+                continue
+                ;;
+        esac
+        [ "$header" ] && wwwoosh_export_header "$header"
+        header="$line"
+        count=$((count + 1))
+        if [ $count -gt $wwwoosh_max_headers ]; then
+            printf 'Status: 431\nContent-Type: text/plain\nContent-Length: 32\n\nRequest Header Fields Too Large\n'
+            wwwoosh_trace_flush
+            return 0
+        fi
     done
+    [ "$header" ] && wwwoosh_export_header "$header"
 
     # extract HTTP method and HTTP version
-    export REQUEST_METHOD=$(echo $request_line | cut -d ' ' -f 1)
-    export wwwoosh_http_version=$(echo $request_line | cut -d ' ' -f 3 | tr -d $'\r')
+    local target="${request_line#* }"
+    [ "$target" = "$request_line" ] && target=""
+    export REQUEST_METHOD="${request_line%% *}"
+    wwwoosh_http_version="HTTP/1.0"
+    case "$target" in
+        *" "*) wwwoosh_http_version="${target#* }" ;;
+    esac
+    export wwwoosh_http_version
 
     # extract the request_path, then PATH_INFO and QUERY_STRING components
-    request_path=$(echo $request_line | cut -d ' ' -f 2)
-    export PATH_INFO=$(echo $request_path | cut -d '?' -f 1)
-    export QUERY_STRING=$(echo $request_path | cut -d '?' -f 2)
+    request_path="${target%% *}"
+    export PATH_INFO="${request_path%%\?*}"
+    case "$request_path" in
+        *\?*) export QUERY_STRING="${request_path#*\?}" ;;
+        *) export QUERY_STRING="" ;;
+    esac
 
+    export CONTENT_TYPE="$HTTP_CONTENT_TYPE"
+    export CONTENT_LENGTH="$HTTP_CONTENT_LENGTH"
     export SCRIPT_NAME=""
-    export SERVER_NAME="localhost"
-    export SERVER_PORT="$port"
+    wwwoosh_server_name "$HTTP_HOST"
+    export SERVER_NAME="$wwwoosh_server_name"
+    export SERVER_PORT="$wwwoosh_server_port"
+    wwwoosh_trace_mark "parse"
+
+    "$app"
+
+    wwwoosh_trace_flush
+}
+
+# export a "Name: value" header line as HTTP_NAME, joining repeated headers
+# with commas. Lines without a colon or with a bad or overlong field name are
+# dropped.
+wwwoosh_export_header () {
+    local name="${1%%:*}" value="${1#*:}"
+    [ "$name" = "$1" ] || [ ${#name} -gt $wwwoosh_max_header_name ] && return
+    case "$name" in
+        ""|*[!A-Za-z0-9!#\$%\&\'*+.^_\`\|~-]*) return ;;
+    esac
 
+    # trim optional whitespace around the value
+    value="${value#"${value%%[!" $TAB"]*}"}"
+    value="${value%"${value##*[!" $TAB"]}"}"
+
+    wwwoosh_header_var "$name"
+    case "$seen" in
+        *" $wwwoosh_header_var "*)
+            eval "value=\"\$$wwwoosh_header_var, \$value\""
+            ;;
+        *)
+            seen="$seen$wwwoosh_header_var "
+            ;;
+    esac
+    export "$wwwoosh_header_var=$value"
+}
+
+# map a header name to its CGI variable name, HTTP_ and upper case with
+# anything but letters and digits as _, without forking tr
+wwwoosh_header_var () {
+    local in="$1" c
+    wwwoosh_header_var="HTTP_"
+    while [ "$in" ]; do
+        c="${in%"${in#?}"}"
+        in="${in#?}"
+        case "$c" in
+            [A-Z0-9]) ;;
+            a) c=A ;; b) c=B ;; c) c=C ;; d) c=D ;; e) c=E ;; f) c=F ;;
+            g) c=G ;; h) c=H ;; i) c=I ;; j) c=J ;; k) c=K ;; l) c=L ;;
+            m) c=M ;; n) c=N ;; o) c=O ;; p) c=P ;; q) c=Q ;; r) c=R ;;
+            s) c=S ;; t) c=T ;; u) c=U ;; v) c=V ;; w) c=W ;; x) c=X ;;
+            y) c=Y ;; z) c=Z ;;
+            *) c=_ ;;
+        esac
+        wwwoosh_header_var="$wwwoosh_header_var$c"
+    done
+}
+
+# the host part of a Host header, without the port or a trailing dot, or
+# localhost if there is none. A Host longer than a DNS name can be is
+# ignored. The name is only lower-cased, with a single tr, when virtual
+# hosts need to look it up.
+wwwoosh_server_name () {
+    local host="$1"
+    [ ${#host} -gt 255 ] && host=""
+    case "$host" in
+        \[*) host="${host%%]*}]" ;;
+        *) host="${host%:*}" ;;
+    esac
+    host="${host%.}"
+    case "$wwwoosh_vhosts$host" in
+        1*[A-Z]*) host="$(printf '%s' "$host" | tr A-Z a-z)" ;;
+    esac
+    wwwoosh_server_name="${host:-localhost}"
+}
+
+# Virtual hosts: wwwoosh_vhost maps a host name to an app, which is either a
+# function run in the worker or a CGI script such as a martin app. Each host
+# is stored in a variable named after it, so the shell's own variable hash
+# table does the lookup. Serve them all with
+#   wwwoosh wwwoosh_vhost_dispatch PORT
+
+# route requests for NAME to APP, where NAME is a host name, "*.domain" for
+# any host under domain, or "default" for everything else
+wwwoosh_vhost () {
+    wwwoosh_vhosts=1
+    if [ "$1" = "default" ]; then
+        wwwoosh_vhost_default="$2"
+        return
+    fi
+    wwwoosh_server_name "$1"
+    if ! wwwoosh_vhost_key "$wwwoosh_server_name"; then
+        echo "wwwoosh: bad virtual host name: $1" 1>&2
+        return 1
+    fi
+    eval "$wwwoosh_vhost_key=\$2"
+}
+
+# run the app for SERVER_NAME: an exact match, then the closest wildcard
+wwwoosh_vhost_dispatch () {
+    local host="$SERVER_NAME" app=""
+    if wwwoosh_vhost_key "$host"; then
+        eval "app=\"\$$wwwoosh_vhost_key\""
+        while [ ! "$app" ]; do
+            case "$host" in
+                *.*) host="${host#*.}" ;;
+                *) break ;;
+            esac
+            wwwoosh_vhost_key "*.$host"
+            eval "app=\"\$$wwwoosh_vhost_key\""
+        done
+    fi
+    app="${app:-$wwwoosh_vhost_default}"
+
+    if [ ! "$app" ]; then
+        printf "Status: 404 Not Found\nContent-Type: text/plain\n\n"
+        echo "No site for $SERVER_NAME"
+        return
+    fi
     "$app"
 }
 
+# map a host name to its variable, wwwoosh_vhost_ followed by the name with
+# '.', '-' and '*' spelt _d, _h and _w. Only these and lower case letters and
+# digits are allowed, so the name cannot collide or inject.
+wwwoosh_vhost_key () {
+    local in="$1" out="" head c
+    case "$in" in
+        ""|*[!a-z0-9.*-]*) return 1 ;;
+    esac
+    while :; do
+        case "$in" in
+            *[.*-]*) ;;
+            *) break ;;
+        esac
+        head="${in%%[.*-]*}"
+        c="${in#"$head"}"
+        in="${c#?}"
+        case "$c" in
+            .*) c=_d ;;
+            -*) c=_h ;;
+            *) c=_w ;;
+        esac
+        out="$out$head$c"
+    done
+    wwwoosh_vhost_key="wwwoosh_vhost_$out$in"
+}
+
 wwwoosh_handle_response () {
-    local response_status="200 OK"
-    local response_headers=""
-
-    local content_length="-"
-
-    add_header () {
-      local header="$1"
-      if [ "$response_headers" ]; then
-          response_headers="$response_headers$CRLF$header"
-      else
-          response_headers="$header"
-      fi
-    }
-
-    while read header && [ ! "$header" = "" ]; do
-        local header_name="$(echo $header | cut -d ':' -f 1 | tr 'A-Z' 'a-z')"
-        local header_value="$(echo $header | cut -d ':' -f 2)"
-        if [ "$header_name" = "status" ]; then
-            response_status="$(echo $header | cut -d ':' -f 2 | sed 's/^ //')"
-        elif [ "$header_name" = "content-length" ]; then
-            content_length="$header_value"
-            add_header "$header"
-        else
-            add_header "$header"
-        fi
+    local status="200 OK" headers="" content_length="-" header
+
+    IFS= read -r header || return 0
+    header="${header%$CR}"
+    while [ "$header" ]; do
+        [ "$wwwoosh_trace_last" ] || wwwoosh_trace_start
+        case "${header%%:*}" in
+            [Ss][Tt][Aa][Tt][Uu][Ss])
+                status="${header#*:}"
+                status="${status# }"
+                ;;
+            [Cc][Oo][Nn][Tt][Ee][Nn][Tt]-[Ll][Ee][Nn][Gg][Tt][Hh])
+                content_length="${header#*:}"
+                content_length="${content_length# }"
+                headers="$headers$header$CRLF"
+                ;;
+            *)
+                headers="$headers$header$CRLF"
+                ;;
+        esac
+        IFS= read -r header || break
+        header="${header%$CR}"
     done
 
-    add_header "Connection: close"
-    add_header "Date: $(date -u '+%a, %d %b %Y %R:%S GMT')"
+    wwwoosh_date
+    wwwoosh_status_line "$status"
+    wwwoosh_trace_mark "response headers"
 
-    # echo status line, headers, blank line, body
-    echo "$wwwoosh_http_version $response_status$CRLF$response_headers$CRLF$CR"
+    # write the whole head at once, then stream the body
+    printf '%s' "$wwwoosh_status_line$CRLF${headers}Connection: close${CRLF}Date: $wwwoosh_http_date$CRLF$CRLF"
     cat
+    wwwoosh_trace_mark "response body"
 
     log_remote_host="-"
     log_user="-"
-    log_date="$(date -u '+%d/%b/%Y:%H:%M:%S')"
+    log_date="$wwwoosh_log_date"
     log_header="$REQUEST_METHOD $PATH_INFO $wwwoosh_http_version" # doesn't work
-    log_status="$(echo "$response_status" | cut -d " " -f1)"
+    log_status="${status%% *}"
     log_size="$content_length"
 
     echo "$log_remote_host - $log_user [$log_date] \"$log_header\" $log_status $log_size" 1>&2
+
+    wwwoosh_trace_flush
+}
+
+# the status line for a CGI Status value, adding the reason phrase when only
+# a code is given
+wwwoosh_status_line () {
+    local status="$1"
+    case "$status" in
+        200) status="200 OK" ;;
+        201) status="201 Created" ;;
+        204) status="204 No Content" ;;
+        206) status="206 Partial Content" ;;
+        301) status="301 Moved Permanently" ;;
+        302) status="302 Found" ;;
+        303) status="303 See Other" ;;
+        304) status="304 Not Modified" ;;
+        307) status="307 Temporary Redirect" ;;
+        308) status="308 Permanent Redirect" ;;
+        400) status="400 Bad Request" ;;
+        401) status="401 Unauthorized" ;;
+        403) status="403 Forbidden" ;;
+        404) status="404 Not Found" ;;
+        405) status="405 Method Not Allowed" ;;
+        413) status="413 Content Too Large" ;;
+        416) status="416 Range Not Satisfiable" ;;
+        429) status="429 Too Many Requests" ;;
+        431) status="431 Request Header Fields Too Large" ;;
+        500) status="500 Internal Server Error" ;;
+        502) status="502 Bad Gateway" ;;
+        503) status="503 Service Unavailable" ;;
+    esac
+    wwwoosh_status_line="$wwwoosh_http_version $status"
+}
+
+# Dates: bash formats the time itself with printf. Plain sh reads it from a
+# file that wwwoosh_clock rewrites once a second, and only runs date(1) if
+# that is missing. Either way a response needs no fork for its Date header.
+
+wwwoosh_date () {
+    local dates=""
+    if [ "$BASH_VERSION" ]; then
+        LC_ALL=C TZ=UTC0 printf -v dates \
+            '%(%a, %d %b %Y %H:%M:%S GMT|%d/%b/%Y:%H:%M:%S)T' -1
+    else
+        [ -r "$wwwoosh_clock_file" ] && read -r dates < "$wwwoosh_clock_file"
+        [ "$dates" ] ||
+            dates="$(LC_ALL=C date -u '+%a, %d %b %Y %H:%M:%S GMT|%d/%b/%Y:%H:%M:%S')"
+    fi
+    wwwoosh_http_date="${dates%|*}"
+    wwwoosh_log_date="${dates#*|}"
+}
+
+# run in the background for as long as the server (or this generation) is
+wwwoosh_clock () {
+    [ "$BASH_VERSION" ] && return
+    while kill -0 $$ 2> /dev/null &&
+          { [ ! "$wwwoosh_generation" ] || [ -e "$wwwoosh_generation" ]; }; do
+        LC_ALL=C date -u '+%a, %d %b %Y %H:%M:%S GMT|%d/%b/%Y:%H:%M:%S' \
+            > "$wwwoosh_clock_file.tmp" &&
+        mv -f "$wwwoosh_clock_file.tmp" "$wwwoosh_clock_file"
+        sleep 1
+    done
+}
+
+# Tracing: each stage of the pipeline buffers its spans and writes them to
+# the ring buffer in one call once the request is done. Timestamps come from
+# bash's EPOCHREALTIME when available, so marking a phase does not fork.
+
+wwwoosh_trace_clock () {
+    if [ "$EPOCHREALTIME" ]; then
+        wwwoosh_trace_now="${EPOCHREALTIME/[.,]/}"
+    else
+        wwwoosh_trace_now="$("$wwwoosh_tools/trace" now)"
+    fi
+}
+
+wwwoosh_trace_start () {
+    [ "$wwwoosh_trace_file" ] || return 0
+    wwwoosh_trace_clock
+    wwwoosh_trace_last="$wwwoosh_trace_now"
+    wwwoosh_trace_spans=""
+}
+
+# close the span NAME running from the previous mark until now
+wwwoosh_trace_mark () {
+    [ "$wwwoosh_trace_file" ] || return 0
+    wwwoosh_trace_clock
+    wwwoosh_trace_spans="$wwwoosh_trace_spans$1$LF$wwwoosh_trace_last$LF$wwwoosh_trace_now$LF"
+    wwwoosh_trace_last="$wwwoosh_trace_now"
+}
+
+# request ids are "PID-GENERATION.WORKER-N" under tools/listen, since the
+# workers of every generation share the pid and each counts from 1
+wwwoosh_trace_flush () {
+    [ "$wwwoosh_trace_file" ] && [ "$wwwoosh_trace_spans" ] || return 0
+    local clock="m"
+    [ "$EPOCHREALTIME" ] && clock="r"
+    local IFS="$LF"
+    "$wwwoosh_tools/trace" "$wwwoosh_trace_file" span "$clock" \
+        "$$-${WWWOOSH_WORKER:+$WWWOOSH_WORKER-}$wwwoosh_request_id" \
+        $wwwoosh_trace_spans
+}
+
+wwwoosh_trace_dump () {
+    "$wwwoosh_tools/trace" "$wwwoosh_trace_file" dump "$wwwoosh_trace_file.json" &&
+    echo "Trace written to $wwwoosh_trace_file.json" 1>&2
 }
 
 wwwoosh_listen () {
-  # first try the standard netcat, then the bsd netcat
-  nc -l -p $1 2> /dev/null || nc -l $1
+  if [ "$WWWOOSH_LISTEN_FD" ]; then
+    "$wwwoosh_tools/listen" accept -g "$wwwoosh_generation" $wwwoosh_admission
+    # back off instead of spinning if the socket is unusable
+    case $? in
+      0|3) ;;
+      *) sleep 1 ;;
+    esac
+    return
+  fi
+  case "$1" in
+    unix:*) nc -lU "${1#unix:}" ;;
+    # first try the standard netcat, then the bsd netcat
+    *) nc -l -p $1 2> /dev/null || nc -l $1 ;;
+  esac
 }
 
 case "$0" in
-  *wwwoosh.sh) wwwoosh $@ ;;
+  *wwwoosh.sh) wwwoosh "$@" ;;
 esac